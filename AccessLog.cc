@@ -0,0 +1,204 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <string>
+
+#include "./AccessLog.h"
+
+using std::min;
+using std::string;
+using std::string_view;
+
+namespace hw4 {
+
+// A record holds copies of an AccessEntry's strings, so the entry's
+// storage can go away as soon as Log() returns.
+struct AccessLog::Record {
+  uint64_t time_ns;
+  uint64_t latency_ns;
+  uint64_t bytes;
+  uint16_t status;
+  uint16_t uri_length;
+  bool uri_truncated;
+  uint8_t client_length;
+  uint8_t method_length;
+  char client[46];  // INET6_ADDRSTRLEN
+  char method[8];
+  char uri[kMaxUri];
+};
+
+// A single-producer, single-consumer ring: only the thread that owns it
+// advances head, and only the writer thread advances tail.  Both count
+// records ever, so head - tail is the number waiting.
+struct AccessLog::Ring {
+  Record records[kRingRecords];
+
+  // Written by the owning thread.
+  alignas(64) std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> dropped{0};
+
+  // Written by the writer thread.
+  alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+// Formatted output is written out whenever it grows past this.
+static const size_t kFlushBytes = 64 * 1024;
+
+// Copies up to "capacity" bytes of "from" into "to", returning how many.
+static size_t CopyTruncated(string_view from, char* to, size_t capacity) {
+  size_t length = min(from.size(), capacity);
+  memcpy(to, from.data(), length);
+  return length;
+}
+
+static void AppendNumber(uint64_t value, string* const out) {
+  char buffer[20];
+  char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+  out->append(buffer, end - buffer);
+}
+
+// Appends "text", escaping anything that would make the line ambiguous:
+// control characters, quotes, backslashes, and non-ASCII bytes.
+static void AppendQuotable(string_view text, string* const out) {
+  static const char kHex[] = "0123456789abcdef";
+  for (char c : text) {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (u < 0x20 || u >= 0x7f || c == '"' || c == '\\') {
+      char escaped[4] = {'\\', 'x', kHex[u >> 4], kHex[u & 0xf]};
+      out->append(escaped, sizeof(escaped));
+    } else {
+      out->push_back(c);
+    }
+  }
+}
+
+AccessLog::AccessLog(const string& file_name)
+  : file_name_(file_name), writer_(kFlushMillis) { }
+
+AccessLog::~AccessLog() {
+  Stop();
+}
+
+bool AccessLog::Start() {
+  int fd;
+  if (file_name_ == "-") {
+    fd = dup(STDOUT_FILENO);
+  } else {
+    fd = open(file_name_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+              0644);
+  }
+  if (fd == -1) {
+    return false;
+  }
+
+  writer_.Start(fd, [this](string* const out) {
+      for (Ring* ring : rings_.Shards()) {
+        Drain(ring, out);
+        if (out->size() >= kFlushBytes) {
+          writer_.Write(out);
+        }
+      }
+    });
+  return true;
+}
+
+void AccessLog::Stop() {
+  writer_.Stop();
+}
+
+void AccessLog::Log(const AccessEntry& entry) {
+  // The log owns the ring, so it outlives the thread if need be.
+  Ring* ring = rings_.Get();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) == kRingRecords) {
+    // Full.  Only this thread writes "dropped", so it needn't be atomic
+    // read-modify-write.
+    ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    return;
+  }
+
+  Record* record = &ring->records[head & (kRingRecords - 1)];
+  record->time_ns = entry.time_ns;
+  record->latency_ns = entry.latency_ns;
+  record->bytes = entry.bytes;
+  record->status = entry.status;
+  record->client_length =
+    CopyTruncated(entry.client, record->client, sizeof(record->client));
+  record->method_length =
+    CopyTruncated(entry.method, record->method, sizeof(record->method));
+  record->uri_length = CopyTruncated(entry.uri, record->uri, kMaxUri);
+  record->uri_truncated = entry.uri.size() > kMaxUri;
+
+  // Publish it to the writer thread.
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+AccessLog::Stats AccessLog::GetStats() const {
+  Stats stats = {0, 0};
+  for (Ring* ring : rings_.Shards()) {
+    stats.logged += ring->head.load(std::memory_order_relaxed);
+    stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+// static
+void AccessLog::Drain(Ring* ring, string* const out) {
+  // Timestamps only need formatting again when the second changes.
+  static thread_local time_t last_second = -1;
+  static thread_local char last_stamp[32];
+
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  for (; tail != head; tail++) {
+    const Record& record = ring->records[tail & (kRingRecords - 1)];
+
+    time_t second = record.time_ns / 1000000000;
+    if (second != last_second) {
+      struct tm tm;
+      gmtime_r(&second, &tm);
+      strftime(last_stamp, sizeof(last_stamp), "[%d/%b/%Y:%H:%M:%S +0000]",
+               &tm);
+      last_second = second;
+    }
+
+    out->append(record.client, record.client_length);
+    out->append(" - - ");
+    out->append(last_stamp);
+    out->append(" \"");
+    AppendQuotable(string_view(record.method, record.method_length), out);
+    out->push_back(' ');
+    AppendQuotable(string_view(record.uri, record.uri_length), out);
+    if (record.uri_truncated) {
+      out->append("...");
+    }
+    out->append("\" ");
+    AppendNumber(record.status, out);
+    out->push_back(' ');
+    AppendNumber(record.bytes, out);
+    out->push_back(' ');
+    AppendNumber(record.latency_ns / 1000, out);
+    out->push_back('\n');
+  }
+
+  // Hand the slots back to the owning thread.
+  ring->tail.store(tail, std::memory_order_release);
+}
+
+}  // namespace hw4
@@ -0,0 +1,108 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_ACCESSLOG_H_
+#define HW4_ACCESSLOG_H_
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+#include "./BatchWriter.h"
+#include "./ThreadShards.h"
+
+namespace hw4 {
+
+// One request, as the worker that answered it saw it.
+struct AccessEntry {
+  uint64_t time_ns;     // when the request arrived, since the Unix epoch
+  uint64_t latency_ns;  // how long it took to answer and write it out
+  std::string_view client;
+  std::string_view method;
+  std::string_view uri;
+  uint16_t status;
+  uint64_t bytes;  // of the response body
+};
+
+// An AccessLog writes a line per request to a file, without ever making
+// the thread that answered the request wait.
+//
+// Each thread that calls Log() gets a ring of fixed-size records of its
+// own, which only it writes and only the log's writer thread reads, so
+// logging a request is a copy into the ring and an atomic store: no lock,
+// no system call.  Every kFlushMillis the writer thread drains the rings,
+// formats their records, and appends them to the file in one write().
+// If a thread logs faster than that and fills its ring, further records
+// are dropped, and counted, until the writer catches up.
+//
+// Lines are in the Common Log Format, followed by the latency in
+// microseconds:
+//
+//   ::1 - - [19/Oct/2026:17:04:33 +0000] "GET /query?terms=x" 200 1534 87
+//
+// URIs longer than kMaxUri bytes are cut short, ending in "...".
+class AccessLog {
+ public:
+  // The constructor just memorizes its argument, the file to append to;
+  // "-" is standard output.  Call Start() to open it.
+  explicit AccessLog(const std::string& file_name);
+
+  // Calls Stop().
+  virtual ~AccessLog();
+
+  // Opens the file and starts the writer thread.  Returns false if the
+  // file can't be opened.
+  bool Start();
+
+  // Stops the writer thread, once it has written out whatever has been
+  // logged, and closes the file.  Call it once no thread will log any
+  // more, e.g. when the server shuts down; it does nothing if the log
+  // isn't running.
+  void Stop();
+
+  // Logs "entry".  Never blocks; safe to call from any number of threads.
+  void Log(const AccessEntry& entry);
+
+  // A snapshot of the log's counters.
+  struct Stats {
+    uint64_t logged;   // records handed to Log() and kept
+    uint64_t dropped;  // records dropped because a ring was full
+  };
+  Stats GetStats() const;
+
+ private:
+  // The longest URI kept, and the number of records in a thread's ring
+  // (a power of two).
+  static const size_t kMaxUri = 200;
+  static const uint64_t kRingRecords = 256;
+
+  // How often the writer thread drains the rings.
+  static const int kFlushMillis = 10;
+
+  struct Record;
+  struct Ring;
+
+  // Formats whatever is in "ring" onto "out".
+  static void Drain(Ring* ring, std::string* const out);
+
+  std::string file_name_;
+  ThreadShards<Ring> rings_;
+
+  // Drains rings_ into the file; declared after them, so it stops first.
+  BatchWriter writer_;
+
+  AccessLog(const AccessLog&) = delete;
+  AccessLog& operator=(const AccessLog&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_ACCESSLOG_H_
@@ -0,0 +1,115 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#include "./BatchWriter.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::string;
+
+namespace hw4 {
+
+BatchWriter::BatchWriter(int flush_millis)
+  : flush_millis_(flush_millis), fd_(-1), stop_(false), writing_(false) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+  Verify333(pthread_cond_init(&stop_cond_, nullptr) == 0);
+}
+
+BatchWriter::~BatchWriter() {
+  Stop();
+  Verify333(pthread_cond_destroy(&stop_cond_) == 0);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+void BatchWriter::Start(int fd, const DrainFn& drain) {
+  Verify333(!writing_);
+  fd_ = fd;
+  drain_ = drain;
+  stop_ = false;
+  Verify333(pthread_create(&writer_, nullptr, &WriteLoop,
+                           static_cast<void*>(this)) == 0);
+  writing_ = true;
+}
+
+void BatchWriter::Stop() {
+  if (!writing_) {
+    return;
+  }
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  stop_ = true;
+  Verify333(pthread_cond_signal(&stop_cond_) == 0);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  Verify333(pthread_join(writer_, nullptr) == 0);
+  writing_ = false;
+  close(fd_);
+  fd_ = -1;
+}
+
+// static
+void BatchWriter::WriteAll(int fd, string* const out) {
+  size_t written = 0;
+  while (written < out->size()) {
+    ssize_t res = write(fd, out->data() + written, out->size() - written);
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    written += res;
+  }
+  out->clear();
+}
+
+// static
+void* BatchWriter::WriteLoop(void* writer) {
+  static_cast<BatchWriter*>(writer)->WriteBatches();
+  return nullptr;
+}
+
+void BatchWriter::WriteBatches() {
+  string out;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  while (true) {
+    // Once told to stop, drain one last time, then quit.
+    bool stopping = stop_;
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+    drain_(&out);
+    Write(&out);
+
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    if (stopping) {
+      break;
+    }
+
+    // Sleep for a while, unless we're told to stop.
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += flush_millis_ * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    int res = pthread_cond_timedwait(&stop_cond_, &lock_, &deadline);
+    Verify333(res == 0 || res == ETIMEDOUT);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+}  // namespace hw4
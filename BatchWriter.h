@@ -0,0 +1,81 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_BATCHWRITER_H_
+#define HW4_BATCHWRITER_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <functional>  // for std::function
+#include <string>
+
+namespace hw4 {
+
+// A BatchWriter owns a file descriptor and a thread that, every
+// "flush_millis", asks for whatever has piled up to be written and
+// writes it out.  It's how AccessLog and TrafficRecorder get their
+// records from the threads that make them into a file without those
+// threads ever waiting on a write().
+class BatchWriter {
+ public:
+  // "drain" appends what is waiting onto its argument; it is only ever
+  // called on the writer thread.  It may call Write() itself, to keep
+  // the batch from growing without bound.
+  typedef std::function<void(std::string* const)> DrainFn;
+
+  explicit BatchWriter(int flush_millis);
+
+  // Calls Stop().
+  virtual ~BatchWriter();
+
+  // Takes ownership of "fd" and starts the writer thread, which calls
+  // "drain" and writes what it returns every flush_millis.
+  void Start(int fd, const DrainFn& drain);
+
+  // Stops the writer thread, once it has drained and written out one
+  // last time, and closes the file.  Does nothing if the writer isn't
+  // running.
+  void Stop();
+
+  // Writes all of "out" to the file, and empties it.  Only the writer
+  // thread may call it, from "drain".
+  void Write(std::string* const out) { WriteAll(fd_, out); }
+
+  // Writes all of "out" to "fd", and empties it.  A write error loses
+  // the batch: there's nowhere to report it, and stalling would be worse.
+  static void WriteAll(int fd, std::string* const out);
+
+ private:
+  // The writer thread.
+  static void* WriteLoop(void* writer);
+  void WriteBatches();
+
+  const int flush_millis_;
+  int fd_;
+  DrainFn drain_;
+
+  // How to tell the writer thread to stop: set stop_ and signal
+  // stop_cond_, holding lock_.
+  pthread_mutex_t lock_;
+  pthread_cond_t stop_cond_;
+  bool stop_;
+  bool writing_;
+  pthread_t writer_;
+
+  BatchWriter(const BatchWriter&) = delete;
+  BatchWriter& operator=(const BatchWriter&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_BATCHWRITER_H_
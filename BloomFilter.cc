@@ -0,0 +1,78 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "./BloomFilter.h"
+
+extern "C" {
+  #include "libhw1/HashTable.h"  // for FNVHash64()
+}
+
+using std::string;
+
+namespace hw4 {
+
+void BloomFilter::Reset(size_t num_words) {
+  size_t num_blocks = (num_words * kBitsPerWord + 511) / 512;
+  blocks_.assign(num_blocks == 0 ? 1 : num_blocks, Block());  // all zeros
+}
+
+// The high half of a hash picks the block, and these pick the bits within
+// it: a second, independent-looking hash, nine bits (0..511) per probe.
+static inline uint64_t ProbeBits(uint64_t hash) {
+  return hash * 0x9e3779b97f4a7c15ULL;
+}
+
+void BloomFilter::Add(uint64_t hash) {
+  Block& block = blocks_[BlockIndex(hash)];
+  uint64_t probes = ProbeBits(hash);
+  for (int i = 0; i < kNumProbes; i++, probes >>= 9) {
+    uint32_t bit = probes & 511;
+    block.bits[bit >> 6] |= 1ULL << (bit & 63);
+  }
+}
+
+bool BloomFilter::MayContain(uint64_t hash) const {
+  const Block& block = blocks_[BlockIndex(hash)];
+  uint64_t probes = ProbeBits(hash);
+  for (int i = 0; i < kNumProbes; i++, probes >>= 9) {
+    uint32_t bit = probes & 511;
+    if ((block.bits[bit >> 6] & (1ULL << (bit & 63))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// static
+uint64_t BloomFilter::Hash(const string& word) {
+  uint64_t hash =
+    FNVHash64(reinterpret_cast<unsigned char*>(const_cast<char*>(word.data())),
+              word.length());
+
+  // FNV's high bits are weak for short words; mix them all together (this
+  // is MurmurHash3's finalizer).
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+size_t BloomFilter::MemoryBytes() const {
+  return sizeof(*this) + blocks_.capacity() * sizeof(Block);
+}
+
+}  // namespace hw4
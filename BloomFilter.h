@@ -0,0 +1,73 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_BLOOMFILTER_H_
+#define HW4_BLOOMFILTER_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint64_t
+#include <string>    // for std::string
+#include <vector>    // for std::vector
+
+namespace hw4 {
+
+// A BloomFilter is a compact summary of a set of words that can say for
+// certain that a word is not in the set, and otherwise says it might be.
+// IndexSet keeps one over each index's dictionary, so a query can skip
+// every index that can't hold all of its words without probing it.
+//
+// This is a "blocked" Bloom filter: each word's bits all fall in one
+// 64-byte block, picked by the word's hash, so a check touches a single
+// cache line.  At kBitsPerWord bits per word it is wrong about roughly
+// one absent word in a hundred.
+class BloomFilter {
+ public:
+  BloomFilter() { }
+  virtual ~BloomFilter() { }
+
+  // Empties the filter and sizes it for "num_words" words.
+  void Reset(size_t num_words);
+
+  // Adds the word with hash "hash" (from Hash()) to the filter.
+  void Add(uint64_t hash);
+
+  // Returns false if the word with hash "hash" is certainly not in the
+  // filter, and true if it might be.
+  bool MayContain(uint64_t hash) const;
+
+  // Hashes "word" for Add() and MayContain().
+  static uint64_t Hash(const std::string& word);
+
+  // The number of bytes of memory the filter holds onto.
+  size_t MemoryBytes() const;
+
+ private:
+  // How many bits the filter spends per word, and how many of them it
+  // sets for each word.
+  static const size_t kBitsPerWord = 10;
+  static const int kNumProbes = 6;
+
+  // One cache line's worth of bits.
+  struct alignas(64) Block {
+    uint64_t bits[8];
+  };
+
+  // Returns the block "hash" falls in.
+  size_t BlockIndex(uint64_t hash) const {
+    return static_cast<size_t>(((hash >> 32) * blocks_.size()) >> 32);
+  }
+
+  std::vector<Block> blocks_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_BLOOMFILTER_H_
@@ -0,0 +1,195 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "./FileCache.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::shared_ptr;
+using std::string;
+
+namespace hw4 {
+
+// static
+const uint64_t FileCache::kRecheckNanos = 1000000000;
+// static
+const uint64_t FileCache::kMissingNanos = 2000000000;
+// static
+const size_t FileCache::kMaxMissing = 4096;
+
+// Returns the current time on the monotonic clock, in nanoseconds.
+static uint64_t NowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+FileInfo::~FileInfo() {
+  close(fd);
+}
+
+FileCache::FileCache(const FileRoot& root, const MimeTypes& mime_types,
+                     size_t max_files)
+  : root_(root), mime_types_(mime_types), max_files_(max_files),
+    hits_(0), misses_(0), missing_hits_(0) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+FileCache::~FileCache() {
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool FileCache::Lookup(const string& file_name,
+                       shared_ptr<const FileInfo>* const info) {
+  uint64_t now = NowNanos();
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  auto missing = missing_map_.find(file_name);
+  if (missing != missing_map_.end()) {
+    if (now < missing->second->expires_ns) {
+      missing_hits_++;
+      Verify333(pthread_mutex_unlock(&lock_) == 0);
+      return false;
+    }
+    missing_.erase(missing->second);
+    missing_map_.erase(missing);
+  }
+  auto file = file_map_.find(file_name);
+  if (file != file_map_.end() &&
+      now - file->second->info->opened_ns < kRecheckNanos) {
+    files_.splice(files_.begin(), files_, file->second);
+    *info = file->second->info;
+    hits_++;
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    return true;
+  }
+  misses_++;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+  // Opening the file can block on the disk, so do it without the lock.
+  // If another thread opens the same file meanwhile, the last one to
+  // finish is remembered; either is fine.
+  shared_ptr<const FileInfo> opened = Open(file_name);
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  Remember(file_name, opened, now);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  if (opened == nullptr) {
+    return false;
+  }
+  *info = opened;
+  return true;
+}
+
+// static
+bool FileCache::ReadContents(const FileInfo& info, string* const contents) {
+  // Read at most the size the file had when we opened it; it may have
+  // shrunk since.  pread() leaves the descriptor's offset alone, so any
+  // number of threads can read the same FileInfo at once.
+  size_t start = contents->size();
+  contents->resize(start + info.size);
+  size_t length = 0;
+  while (length < info.size) {
+    ssize_t res = pread(info.fd, &(*contents)[start + length],
+                        info.size - length, length);
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      contents->resize(start);
+      return false;
+    }
+    if (res == 0) {
+      break;
+    }
+    length += res;
+  }
+  contents->resize(start + length);
+  return true;
+}
+
+FileCache::Stats FileCache::GetStats() const {
+  Stats stats;
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.missing_hits = missing_hits_;
+  stats.files = files_.size();
+  stats.missing = missing_.size();
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return stats;
+}
+
+shared_ptr<const FileInfo> FileCache::Open(const string& file_name) const {
+  int fd = root_.OpenFile(file_name);
+  if (fd == -1) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+
+  shared_ptr<FileInfo> info(new FileInfo());
+  info->fd = fd;
+  info->size = st.st_size;
+  info->content_type = mime_types_.Lookup(file_name);
+  info->opened_ns = NowNanos();
+  return info;
+}
+
+void FileCache::Remember(const string& file_name,
+                         const shared_ptr<const FileInfo>& info,
+                         uint64_t now) {
+  // Forget whatever we knew before.
+  auto file = file_map_.find(file_name);
+  if (file != file_map_.end()) {
+    files_.erase(file->second);
+    file_map_.erase(file);
+  }
+  auto missing = missing_map_.find(file_name);
+  if (missing != missing_map_.end()) {
+    missing_.erase(missing->second);
+    missing_map_.erase(missing);
+  }
+
+  if (info == nullptr) {
+    if (missing_.size() >= kMaxMissing) {
+      missing_map_.erase(missing_.front().name);
+      missing_.pop_front();
+    }
+    missing_.push_back(MissingEntry{file_name, now + kMissingNanos});
+    missing_map_[file_name] = std::prev(missing_.end());
+    return;
+  }
+
+  if (max_files_ == 0) {
+    return;
+  }
+  if (files_.size() >= max_files_) {
+    file_map_.erase(files_.back().name);
+    files_.pop_back();
+  }
+  files_.push_front(FileEntry{file_name, info});
+  file_map_[file_name] = files_.begin();
+}
+
+}  // namespace hw4
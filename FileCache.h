@@ -0,0 +1,133 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_FILECACHE_H_
+#define HW4_FILECACHE_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "./FileReader.h"
+#include "./MimeTypes.h"
+
+namespace hw4 {
+
+// What the FileCache knows about a static file.  It holds the file open,
+// so the file can be read without walking its path again, and even if it
+// is renamed or replaced in the meantime; the descriptor is closed when
+// the last reference to the FileInfo goes away.
+struct FileInfo {
+  ~FileInfo();
+
+  int fd;
+  uint64_t size;
+  std::string_view content_type;  // empty if the suffix isn't known
+
+  // When the file was opened.
+  uint64_t opened_ns;
+};
+
+// A FileCache remembers the static files the server has recently served,
+// and the names it has recently failed to find.
+//
+// A hit on a file that was opened within the last kRecheckNanos needs no
+// system calls beyond reading the file: no path walk, no stat().  After
+// that, the next hit opens the file again, so that changes on disk show
+// up within kRecheckNanos.  A name that couldn't be served -- it doesn't
+// exist, it's outside the root, or it isn't a regular file -- is refused
+// without touching the disk for kMissingNanos, so clients probing for
+// files that aren't there cost little.
+//
+// The cache holds at most "max_files" files open, and remembers at most
+// kMaxMissing missing names; past either bound, the least recently used
+// file, or the oldest missing name, is dropped.
+class FileCache {
+ public:
+  // The constructor just memorizes its arguments; "root" and "mime_types"
+  // must outlive the cache.
+  FileCache(const FileRoot& root, const MimeTypes& mime_types,
+            size_t max_files);
+  virtual ~FileCache();
+
+  // Looks up "file_name", relative to the root.  Returns true and the
+  // file's info through "info" if it can be served, and false if not.
+  bool Lookup(const std::string& file_name,
+              std::shared_ptr<const FileInfo>* const info);
+
+  // Appends the contents of the file "info" to "contents".  Returns false
+  // if the file can't be read.
+  static bool ReadContents(const FileInfo& info, std::string* const contents);
+
+  // A snapshot of the cache's counters.
+  struct Stats {
+    uint64_t hits;          // served from the cache
+    uint64_t misses;        // had to open the file
+    uint64_t missing_hits;  // refused because we recently failed to find it
+    uint64_t files;         // files held open right now
+    uint64_t missing;       // missing names remembered right now
+  };
+  Stats GetStats() const;
+
+ private:
+  // How long a file is trusted before it is checked again, and how long
+  // a name that couldn't be served is refused.
+  static const uint64_t kRecheckNanos;
+  static const uint64_t kMissingNanos;
+
+  // The most missing names remembered at once.
+  static const size_t kMaxMissing;
+
+  struct FileEntry {
+    std::string name;
+    std::shared_ptr<const FileInfo> info;
+  };
+  struct MissingEntry {
+    std::string name;
+    uint64_t expires_ns;
+  };
+
+  // Opens "file_name" and returns its info, or nullptr if it can't be
+  // served.
+  std::shared_ptr<const FileInfo> Open(const std::string& file_name) const;
+
+  // Records that "file_name" is "info", or is missing if it is null.  The
+  // caller holds lock_.
+  void Remember(const std::string& file_name,
+                const std::shared_ptr<const FileInfo>& info, uint64_t now);
+
+  const FileRoot& root_;
+  const MimeTypes& mime_types_;
+  size_t max_files_;
+
+  // Everything below is guarded by lock_.
+  mutable pthread_mutex_t lock_;
+  std::list<FileEntry> files_;  // most recently used first
+  std::unordered_map<std::string, std::list<FileEntry>::iterator> file_map_;
+  std::list<MissingEntry> missing_;  // oldest first
+  std::unordered_map<std::string,
+                     std::list<MissingEntry>::iterator> missing_map_;
+  uint64_t hits_, misses_, missing_hits_;
+
+  FileCache(const FileCache&) = delete;
+  FileCache& operator=(const FileCache&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_FILECACHE_H_
@@ -9,60 +9,160 @@
  * author.
  */
 
-#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef SYS_openat2
+#include <linux/openat2.h>  // for struct open_how
+#endif
 #include <string>
-#include <cstdlib>
-#include <iostream>
-#include <sstream>
 
-extern "C" {
-  #include "libhw2/FileParser.h"
-}
-
-#include "./HttpUtils.h"
 #include "./FileReader.h"
 
 using std::string;
 
 namespace hw4 {
 
-bool FileReader::ReadFile(string* const contents) {
-  string full_file = basedir_ + "/" + fname_;
-
-  // Read the file into memory, and store the file contents in the
-  // output parameter "str."  Be careful to handle binary data
-  // correctly; i.e., you probably want to use the two-argument
-  // constructor to std::string (the one that includes a length as a
-  // second argument).
-  //
-  // You might find ::ReadFileToString() from HW2 useful here. Remember that
-  // this function uses malloc to allocate memory, so you'll need to use
-  // free() to free up that memory after copying to the string output
-  // parameter.
-  //
-  // Alternatively, you can use a unique_ptr with a malloc/free
-  // deleter to automatically manage this for you; see the comment in
-  // HttpUtils.h above the MallocDeleter class for details.
-
-  // STEP 1:
-
-  if (!IsPathSafe(basedir_, full_file)) {
+// How many times to retry an openat2() that fails with EAGAIN, which it
+// may do if the directory tree is being renamed around while it looks.
+static const int kOpenRetries = 8;
+
+// Opens "path" for reading, if it is beneath the directory "dir_fd".
+// glibc has no wrapper for openat2(), so this calls it directly; where
+// the system doesn't have it, this fails with ENOSYS.
+static int OpenBeneath(int dir_fd, const char* path) {
+#ifdef SYS_openat2
+  struct open_how how;
+  memset(&how, 0, sizeof(how));
+  how.flags = O_RDONLY | O_CLOEXEC;
+  how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+  int fd = -1;
+  for (int i = 0; i < kOpenRetries; i++) {
+    fd = syscall(SYS_openat2, dir_fd, path, &how, sizeof(how));
+    if (fd != -1 || errno != EAGAIN) {
+      break;
+    }
+  }
+  return fd;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Reads all of the regular file "fd" into "contents".
+static bool ReadWholeFile(int fd, string* const contents) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
     return false;
   }
 
-  // Get file contents
-  int size;
-  char* file_content = ::ReadFileToString(full_file.c_str(), &size);
+  // The file may change size as we read it; read what's there.
+  string buf(st.st_size, '\0');
+  size_t length = 0;
+  while (length < buf.size()) {
+    ssize_t res = read(fd, &buf[length], buf.size() - length);
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (res == 0) {
+      break;
+    }
+    length += res;
+  }
+  buf.resize(length);
+  contents->swap(buf);
+  return true;
+}
+
+FileRoot::~FileRoot() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
 
-  if (file_content == nullptr) {
+bool FileRoot::Open() {
+  fd_ = open(path_.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (fd_ == -1) {
     return false;
   }
 
-  // Store file contents and free
-  *contents = string(file_content, size);
-  free(file_content);
+  // See whether the kernel lets us use openat2(); it may be too old, or
+  // a seccomp filter may refuse it.
+  int probe = OpenBeneath(fd_, ".");
+  if (probe != -1) {
+    close(probe);
+    use_openat2_ = true;
+    return true;
+  }
 
+  char real_path[PATH_MAX];
+  if (realpath(path_.c_str(), real_path) == nullptr) {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  real_path_ = real_path;
+  if (real_path_.back() != '/') {
+    real_path_ += '/';
+  }
   return true;
 }
 
+int FileRoot::OpenFile(const string& file_name) const {
+  if (fd_ == -1) {
+    return -1;
+  }
+
+  // The name is relative to the directory even if it starts with '/', as
+  // it does when a URL has "//" after "/static".
+  size_t start = file_name.find_first_not_of('/');
+  if (start == string::npos) {
+    return -1;
+  }
+  const char* name = file_name.c_str() + start;
+  if (use_openat2_) {
+    return OpenBeneath(fd_, name);
+  }
+
+  // Without openat2(), check that the file's real path is within the
+  // directory's, and open that.  The file could still be swapped for a
+  // symlink in between; that's the race openat2() closes.
+  char real_path[PATH_MAX];
+  string full_path = path_ + "/" + name;
+  if (realpath(full_path.c_str(), real_path) == nullptr ||
+      strncmp(real_path, real_path_.c_str(), real_path_.size()) != 0) {
+    return -1;
+  }
+  return open(real_path, O_RDONLY | O_CLOEXEC);
+}
+
+bool FileReader::ReadFile(string* const contents) {
+  // Without an open root, open basedir_ just for this read.
+  FileRoot own_root(basedir_);
+  const FileRoot* root = root_;
+  if (root == nullptr) {
+    if (!own_root.Open()) {
+      return false;
+    }
+    root = &own_root;
+  }
+
+  int fd = root->OpenFile(fname_);
+  if (fd == -1) {
+    return false;
+  }
+  bool read = ReadWholeFile(fd, contents);
+  close(fd);
+  return read;
+}
+
 }  // namespace hw4
@@ -16,6 +16,56 @@
 
 namespace hw4 {
 
+// A FileRoot is a directory that files are served out of.  It opens the
+// directory once, and then opens files beneath it without walking the
+// directory's own path again.
+//
+// Where the kernel supports openat2() (Linux 5.6 and later), it is the
+// kernel that keeps a file name from escaping the directory, through
+// "..", absolute symlinks, or /proc magic links, in the same path walk
+// that opens the file; so there is no window between checking a path and
+// opening it.  Elsewhere, the FileRoot falls back to resolving the file's
+// real path and checking that it lies within the directory's, which it
+// resolves only once.
+//
+// A FileRoot is read-only once opened, so any number of threads can share
+// it.
+class FileRoot {
+ public:
+  // The constructor just memorizes "dir_path"; call Open() to open it.
+  explicit FileRoot(const std::string& dir_path)
+    : path_(dir_path), fd_(-1), use_openat2_(false) { }
+
+  // The destructor closes the directory, if it is open.
+  virtual ~FileRoot();
+
+  // Opens the directory.  Returns false if it isn't one, or can't be
+  // opened.
+  bool Open();
+
+  // Opens "file_name", a path relative to the directory, for reading.
+  // Returns the file descriptor, which the caller must close(), or -1 if
+  // the file can't be opened or isn't within the directory.
+  int OpenFile(const std::string& file_name) const;
+
+  // The directory's path, as it was passed to the constructor.
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+
+  // The open directory, or -1.
+  int fd_;
+
+  // Whether files are opened with openat2(); if not, real_path_ is the
+  // directory's canonical path, with a trailing '/'.
+  bool use_openat2_;
+  std::string real_path_;
+
+  FileRoot(const FileRoot&) = delete;
+  FileRoot& operator=(const FileRoot&) = delete;
+};
+
 // This class is used to read a file into memory and return its
 // contents as a string.
 class FileReader {
@@ -29,7 +79,13 @@ class FileReader {
   //
   // then we would read in "./hw4_htmldir/test/foo.html"
   FileReader(const std::string& base_dir, const std::string& file_name)
-    : basedir_(base_dir), fname_(file_name) { }
+    : basedir_(base_dir), fname_(file_name), root_(nullptr) { }
+
+  // Like the above, but looks for the file inside "root", which is
+  // already open and must outlive the FileReader.
+  FileReader(const FileRoot& root, const std::string& file_name)
+    : basedir_(root.path()), fname_(file_name), root_(&root) { }
+
   virtual ~FileReader() { }
 
   // Attempts to reads in the file specified by the constructor arguments.
@@ -45,6 +101,9 @@ class FileReader {
  private:
   std::string basedir_;
   std::string fname_;
+
+  // The open base directory, or nullptr to open basedir_ for each read.
+  const FileRoot* root_;
 };
 
 }  // namespace hw4
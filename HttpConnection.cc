@@ -9,7 +9,12 @@
  * author.
  */
 
+#include <errno.h>
+#include <poll.h>
 #include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <map>
@@ -19,6 +24,8 @@
 #include "./HttpRequest.h"
 #include "./HttpUtils.h"
 #include "./HttpConnection.h"
+#include "./RequestTracer.h"
+#include "./TrafficRecorder.h"
 
 #define BUFSIZE 1024
 
@@ -38,6 +45,12 @@ namespace hw4 {
 static const char* kHeaderEnd = "\r\n\r\n";
 static const int kHeaderEndLen = 4;
 
+// The largest request body we'll read; anything bigger is refused.
+static const size_t kMaxBodyBytes = 1 << 20;
+
+// How long DiscardInput() waits for the client to stop sending.
+static const int kDiscardMillis = 1000;
+
 bool HttpConnection::GetNextRequest(HttpRequest* const request) {
   // Use WrappedRead from HttpUtils.cc to read bytes from the files into
   // private buffer_ variable. Keep reading until:
@@ -56,7 +69,12 @@ bool HttpConnection::GetNextRequest(HttpRequest* const request) {
   // next time the caller invokes GetNextRequest()!
 
   // STEP 1:
+  error_code_ = 0;
 
+  // If the request is being traced, the time until its first bytes arrive
+  // is the connection waiting on the client; the rest is reading it.
+  uint64_t wait_start = RequestTracer::Now();
+  uint64_t read_start = buffer_.empty() ? 0 : wait_start;
 
   int size = 0;
   int res = -1;
@@ -75,16 +93,18 @@ bool HttpConnection::GetNextRequest(HttpRequest* const request) {
       return false;
     }
 
+    if (read_start == 0) {
+      RequestTracer::Span("wait", wait_start);
+      read_start = RequestTracer::Now();
+    }
+
     // Update buffer and check if it contains end of header
+    bytes_read_ += res;
     buffer_ += string(buf, res);
     size += res;
     size_t pos = buffer_.find(kHeaderEnd);
     if (pos != string::npos) {
-      string header = buffer_.substr(0, pos);
-      HttpRequest temp_req = ParseRequest(header);
-      buffer_.erase(0, pos + kHeaderEndLen);
-      *request = move(temp_req);
-      return true;
+      return FinishRequest(pos, read_start, request);
     }
   }
 
@@ -93,23 +113,140 @@ bool HttpConnection::GetNextRequest(HttpRequest* const request) {
     if (pos == string::npos) {
       return false;
     }
-    string header = buffer_.substr(0, pos);
-    HttpRequest temp_req = ParseRequest(header);
-    buffer_.erase(0, pos + kHeaderEndLen);
-    *request = move(temp_req);
-    return true;
+    return FinishRequest(pos, read_start, request);
   }
 
   return false;
 }
 
-bool HttpConnection::WriteResponse(const HttpResponse& response) const {
-  string str = response.GenerateResponseString();
-  int res = WrappedWrite(fd_,
-                         reinterpret_cast<const unsigned char*>(str.c_str()),
-                         str.length());
-  if (res != static_cast<int>(str.length()))
+bool HttpConnection::FinishRequest(size_t header_end, uint64_t read_start,
+                                   HttpRequest* const request) {
+  string header = buffer_.substr(0, header_end);
+  RequestTracer::Span("read", read_start);
+  uint64_t parse_start = RequestTracer::Now();
+  HttpRequest temp_req = ParseRequest(header);
+  RequestTracer::Span("parse", parse_start);
+  buffer_.erase(0, header_end + kHeaderEndLen);
+  *request = move(temp_req);
+  if (!ReadBody(request)) {
+    return false;
+  }
+  if (recorder_ != nullptr) {
+    recorder_->Record(header, request->body());
+  }
+  return true;
+}
+
+bool HttpConnection::ReadBody(HttpRequest* const request) {
+  // We don't speak chunked transfer encoding, so a body has to come with
+  // its length up front.
+  string encoding = request->GetHeaderValue("transfer-encoding");
+  if (!encoding.empty()) {
+    to_lower(encoding);
+    error_code_ = (encoding.find("chunked") != string::npos) ? 411 : 501;
     return false;
+  }
+  string length_str = request->GetHeaderValue("content-length");
+  if (length_str.empty()) {
+    return true;
+  }
+  size_t length;
+  try {
+    length = boost::lexical_cast<size_t>(length_str);
+  } catch (const boost::bad_lexical_cast&) {
+    error_code_ = 400;
+    return false;
+  }
+  if (length > kMaxBodyBytes) {
+    error_code_ = 413;
+    return false;
+  }
+
+  // Part or all of the body may have arrived along with the headers.
+  uint64_t body_start = RequestTracer::Now();
+  while (buffer_.size() < length) {
+    char buf[BUFSIZE];
+    int res = WrappedRead(fd_, reinterpret_cast<unsigned char*>(buf),
+                          BUFSIZE);
+    if (res <= 0) {
+      return false;
+    }
+    bytes_read_ += res;
+    buffer_.append(buf, res);
+  }
+  request->set_body(buffer_.substr(0, length));
+  buffer_.erase(0, length);
+  RequestTracer::Span("read body", body_start);
+  return true;
+}
+
+void HttpConnection::DiscardInput() {
+  shutdown(fd_, SHUT_WR);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t deadline_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000 +
+                        kDiscardMillis;
+  while (1) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t left_ms = deadline_ms -
+                      (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+    if (left_ms <= 0) {
+      return;
+    }
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    int res = poll(&pfd, 1, static_cast<int>(left_ms));
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      return;
+    }
+    char buf[BUFSIZE * 16];
+    ssize_t got = read(fd_, buf, sizeof(buf));
+    if (got == -1 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    }
+    if (got <= 0) {
+      return;
+    }
+    bytes_read_ += got;
+  }
+}
+
+bool HttpConnection::WriteResponse(const HttpResponse& response) const {
+  // Hand the headers and the body to the kernel together, so the body
+  // isn't copied into one big response string first.
+  string header = response.GenerateHeaderString();
+  const string& body = response.body();
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char*>(header.data());
+  iov[0].iov_len = header.size();
+  iov[1].iov_base = const_cast<char*>(body.data());
+  iov[1].iov_len = body.size();
+
+  // writev() may write only part of it; pick up where it left off.
+  struct iovec* next = iov;
+  int count = 2;
+  while (count > 0) {
+    ssize_t res = writev(fd_, next, count);
+    if (res == -1) {
+      if ((errno == EAGAIN) || (errno == EINTR))
+        continue;
+      return false;
+    }
+    if (res == 0)
+      return false;
+    bytes_written_ += res;
+    while (count > 0 && static_cast<size_t>(res) >= next->iov_len) {
+      res -= next->iov_len;
+      next++;
+      count--;
+    }
+    if (count > 0) {
+      next->iov_base = static_cast<char*>(next->iov_base) + res;
+      next->iov_len -= res;
+    }
+  }
   return true;
 }
 
@@ -143,6 +280,7 @@ HttpRequest HttpConnection::ParseRequest(const string& request) const {
     vector<string> tokens;
     split(tokens, lines[0], is_any_of(" "), token_compress_on);
     if (tokens.size() >= 2) {
+      req.set_method(tokens[0]);
       req.set_uri(tokens[1]);
     }
   }
@@ -19,16 +19,27 @@
 
 #include "./HttpRequest.h"
 #include "./HttpResponse.h"
+#include "./TrafficRecorder.h"
 
 namespace hw4 {
 
 // The HttpConnection class represents a connection to a single client
 class HttpConnection {
  public:
-  explicit HttpConnection(int fd) : fd_(fd) { }
-  virtual ~HttpConnection() {
-    close(fd_);
-    fd_ = -1;
+  explicit HttpConnection(int fd)
+    : fd_(fd), bytes_read_(0), bytes_written_(0), recorder_(nullptr),
+      error_code_(0) { }
+  virtual ~HttpConnection() { Close(); }
+
+  // Closes the connection, if it isn't already.  The HttpConnection owns
+  // its file descriptor: nothing else may close it, or a number another
+  // thread has just been given for a new file or connection could be
+  // closed out from under it.
+  void Close() {
+    if (fd_ != -1) {
+      close(fd_);
+      fd_ = -1;
+    }
   }
 
   // Read and parse the next request from the file descriptor fd_,
@@ -40,6 +51,13 @@ class HttpConnection {
   // returns false
   bool GetNextRequest(HttpRequest* const request);
 
+  // If GetNextRequest() last returned false because it refused to read
+  // the request's body, the status to answer with before closing the
+  // connection: 411 for a chunked body, 501 for another transfer
+  // encoding, 400 for a malformed Content-Length, or 413 for a body that
+  // is too large.  Otherwise 0.
+  uint16_t error_code() const { return error_code_; }
+
   // Write the response to the file descriptor fd_.
   //
   // Returns true if the response was successfully written, false if the
@@ -49,16 +67,50 @@ class HttpConnection {
   // returns false
   bool WriteResponse(const HttpResponse& response) const;
 
+  // Stops writing to the client, then reads and throws away whatever it
+  // is still sending, for up to a second or until it closes.  Call it
+  // before closing a connection whose request wasn't read in full:
+  // closing with unread data resets the connection, and the client could
+  // lose the response written just before.
+  void DiscardInput();
+
+  // The number of bytes read from, and written to, the client so far.
+  uint64_t bytes_read() const { return bytes_read_; }
+  uint64_t bytes_written() const { return bytes_written_; }
+
+  // Offers every request read from now on, as the client sent it, to
+  // "recorder" (which may be nullptr, to stop).
+  void set_recorder(TrafficRecorder* recorder) { recorder_ = recorder; }
+
  private:
   // A helper function to parse the contents of data read from
   // the HTTP connection.
   HttpRequest ParseRequest(const std::string& request) const;
 
+  // Reads the body of "request", whose headers have just been parsed, if
+  // its Content-Length says it has one, and stores it in the request.
+  // Returns false if the body is malformed or too large, or the
+  // connection drops before all of it arrives.
+  bool ReadBody(HttpRequest* const request);
+
+  // Parses the headers at the front of buffer_, which end at
+  // "header_end", into "request", removes them from buffer_, and reads the
+  // body.  "read_start" is when reading them began, for the tracer.
+  bool FinishRequest(size_t header_end, uint64_t read_start,
+                     HttpRequest* const request);
+
   // The file descriptor associated with the client.
   int fd_;
 
   // A buffer storing data read from the client.
   std::string buffer_;
+
+  uint64_t bytes_read_;
+  mutable uint64_t bytes_written_;
+
+  TrafficRecorder* recorder_;
+
+  uint16_t error_code_;
 };
 
 }  // namespace hw4
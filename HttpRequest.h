@@ -20,7 +20,7 @@
 namespace hw4 {
 
 // This class represents an HTTP Request. For our website search engine, we
-// will only handle "GET"-style requests, meaning the request will have the
+// mostly handle "GET"-style requests, meaning the request will have the
 // following format:
 //
 // GET [URI] [http_protocol]\r\n
@@ -35,15 +35,27 @@ namespace hw4 {
 // GET /foo/bar?baz=bam HTTP/1.1\r\n
 // Host: www.news.com\r\n
 //
+// A request may also carry a body (e.g., a "POST" to the batch query
+// endpoint), in which case its headers include a Content-Length, and
+// exactly that many bytes follow the blank line that ends them.
+//
 class HttpRequest {
  public:
   HttpRequest() { }
-  explicit HttpRequest(const std::string& uri) : uri_(uri) { }
+  explicit HttpRequest(const std::string& uri) : uri_(uri), method_("GET") { }
   virtual ~HttpRequest() { }
 
   const std::string& uri() const { return uri_; }
   void set_uri(const std::string& uri) { uri_ = uri; }
 
+  // The request method, e.g., "GET" or "POST".
+  const std::string& method() const { return method_; }
+  void set_method(const std::string& method) { method_ = method; }
+
+  // The request body; empty unless the request had a Content-Length.
+  const std::string& body() const { return body_; }
+  void set_body(const std::string& body) { body_ = body; }
+
   // Returns the value associated with the passed-in header name, or empty
   // string if it does not exist in the header map.  The passed-in name must
   // be entirely lowercase to comply with our implementation of RFC 2616:4.2.
@@ -68,8 +80,12 @@ class HttpRequest {
   }
 
  private:
-  // Which URI did the client request?
+  // Which URI did the client request, and how?
   std::string uri_;
+  std::string method_;
+
+  // What did the client send after the headers?
+  std::string body_;
 
   // A map from mapping a header name to a header value, which represents the
   // headers a client would supply to us. Due to RFC 2616:4.2 stating that
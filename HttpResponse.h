@@ -48,6 +48,7 @@ class HttpResponse {
 
   void set_protocol(const std::string& protocol) { protocol_ = protocol; }
   void set_response_code(uint16_t code) { response_code_ = code; }
+  uint16_t response_code() const { return response_code_; }
   void set_message(const std::string& msg) { message_ = msg; }
   void set_content_type(const std::string& type) { content_type_ = type; }
 
@@ -55,6 +56,11 @@ class HttpResponse {
     body_ += body_fragment;
   }
 
+  // The body, for serializers that write straight into it rather than
+  // building up fragments to append.
+  std::string* mutable_body() { return &body_; }
+  const std::string& body() const { return body_; }
+
   // A method to generate a std::string of the HTTP response, suitable for
   // writing back to the client.
   //
@@ -62,6 +68,13 @@ class HttpResponse {
   // last header in the block. The value of that Content-length header is the
   // size of the response body (in bytes).
   std::string GenerateResponseString() const {
+    return GenerateHeaderString() + body_;
+  }
+
+  // Generates just the status line and headers, through the blank line
+  // that ends them; the body follows.  Lets a large body be written out
+  // without first being copied into the whole response string.
+  std::string GenerateHeaderString() const {
     std::stringstream resp;
 
     resp << protocol_ << " " << response_code_ << " " << message_ << "\r\n";
@@ -70,7 +83,6 @@ class HttpResponse {
     }
     resp << "Content-length: " << body_.size() << "\r\n";
     resp << "\r\n";
-    resp << body_;
     return resp.str();
   }
 
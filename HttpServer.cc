@@ -9,7 +9,12 @@
  * author.
  */
 
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -17,22 +22,32 @@
 #include <string>
 #include <sstream>
 
-#include "./FileReader.h"
+#include "./AccessLog.h"
+#include "./FileCache.h"
 #include "./HttpConnection.h"
 #include "./HttpRequest.h"
 #include "./HttpUtils.h"
 #include "./HttpServer.h"
-#include "./libhw3/QueryProcessor.h"
+#include "./Profiler.h"
+#include "./QueryEngine.h"
+#include "./RequestTracer.h"
+#include "./ServerMetrics.h"
+#include "./TrafficRecorder.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
 
 using std::cerr;
 using std::cout;
 using std::endl;
-using std::list;
-using std::map;
+using std::min;
+using std::shared_ptr;
 using std::string;
 using std::stringstream;
 using std::unique_ptr;
 using std::to_string;
+using std::vector;
 
 using boost::trim;
 using boost::to_lower;
@@ -59,38 +74,204 @@ static const char* kThreegleStr =
   "<div style=\"height:20px;\"></div>\n"
   "<center>\n"
   "<form action=\"/query\" method=\"get\">\n"
-  "<input type=\"text\" size=30 name=\"terms\" />\n"
+  "<input type=\"text\" size=30 name=\"terms\" list=\"suggestions\" "
+    "autocomplete=\"off\" />\n"
+  "<datalist id=\"suggestions\"></datalist>\n"
   "<input type=\"submit\" value=\"Search\" />\n"
   "</form>\n"
-  "</center><p>\n";
+  "</center>\n"
+  "<script>\n"
+  "var box = document.querySelector('input[name=terms]');\n"
+  "var list = document.getElementById('suggestions');\n"
+  "box.addEventListener('input', function() {\n"
+  "  fetch('/suggest?prefix=' + encodeURIComponent(box.value))\n"
+  "    .then(function(r) { return r.json(); })\n"
+  "    .then(function(words) {\n"
+  "      list.replaceChildren.apply(list, words.map(function(w) {\n"
+  "        var option = document.createElement('option');\n"
+  "        option.value = w;\n"
+  "        return option;\n"
+  "      }));\n"
+  "    });\n"
+  "});\n"
+  "</script><p>\n";
 
 // static
 const int HttpServer::kNumThreads = 100;
 
 static const int staticHeaderLen = 8;
 
+// The most static files the server holds open at once.
+static const size_t kMaxCachedFiles = 256;
+
+// How many query results to show per page, unless the request asks for a
+// different number with "&per_page=", and the most it may ask for.
+static const size_t kDefaultResultsPerPage = 50;
+static const size_t kMaxResultsPerPage = 1000;
+
+// The highest page number we'll honor in "&page=".
+static const size_t kMaxPageNumber = 100000;
+
+// How many completions "/suggest" returns, unless the request asks for a
+// different number with "&n=", and the most it may ask for.
+static const size_t kDefaultSuggestions = 8;
+static const size_t kMaxSuggestions = 50;
+
+// How many results "/batch" returns per query, unless the request asks for
+// a different number with "&n=", and the most queries one batch may hold.
+static const size_t kDefaultBatchResults = 10;
+static const size_t kMaxBatchQueries = 1000;
+
+// How long "/debug/profile" samples for, and how often per CPU second,
+// unless the request asks otherwise with "?seconds=" and "&hz=".
+static const uint32_t kDefaultProfileSeconds = 5;
+static const uint32_t kDefaultProfileHz = 99;
+
 // This is the function that threads are dispatched into
 // in order to process new client connections.
 static void HttpServer_ThrFn(ThreadPool::Task* t);
 
-// Given a request, produce a response.
+// Given a request, produce a response, using what "hst" holds.  Returns
+// which kind of request it was through "route".
 static HttpResponse ProcessRequest(const HttpRequest& req,
-                            const string& base_dir,
-                            const list<string>& indices);
+                                   const HttpServerTask& hst,
+                                   Route* const route);
 
 // Process a file request.
 static HttpResponse ProcessFileRequest(const string& uri,
-                                const string& base_dir);
+                                FileCache* const file_cache);
 
 // Process a query request.
 static HttpResponse ProcessQueryRequest(const string& uri,
-                                 const list<string>& indices);
+                                 QueryEngine* const engine);
+
+// Process a request for search box completions.
+static HttpResponse ProcessSuggestRequest(const string& uri,
+                                          QueryEngine* const engine);
+
+// Process a batch of queries, sent as repeated "q=" arguments or in the
+// body of a POST.
+static HttpResponse ProcessBatchRequest(const HttpRequest& req,
+                                        QueryEngine* const engine);
+
+// Process a query from a program, answered in JSON or in binary.
+static HttpResponse ProcessApiQueryRequest(const HttpRequest& req,
+                                           QueryEngine* const engine);
+
+// Process a request for the server's counters, in the Prometheus text
+// format.
+static HttpResponse ProcessStatsRequest(const HttpServerTask& hst);
+
+// Answers a request whose body HttpConnection refused to read, with its
+// error_code().
+static HttpResponse RefusedRequestResponse(uint16_t code);
+
+// Process a request for the traced requests, or to change how often
+// requests are traced.
+static HttpResponse ProcessTraceRequest(const string& uri,
+                                        RequestTracer* const tracer);
+
+// Process a request for a CPU profile, "/debug/profile?seconds=N&hz=N",
+// answering with the profiled stacks, folded.  See Profiler.
+static HttpResponse ProcessProfileRequest(const string& uri,
+                                          Profiler* const profiler);
+
+// Appends "summary" to "out" as the Prometheus summary "name", with the
+// label "labels" (e.g., route="query"), if it isn't empty.
+static void AppendLatencySummary(const string& name,
+                                 const string& labels,
+                                 const LatencySummary& summary,
+                                 stringstream* const out);
+
+// Returns the time on "clock", in nanoseconds.
+static uint64_t ClockNanos(clockid_t clock);
+
+// Returns the positive integer in the query argument "name", or
+// "default_value" if the argument is missing or isn't a positive integer.
+// The result is clamped to at most "max_value".
+static size_t GetPositiveArg(const URLParser& parser,
+                             const string& name,
+                             size_t default_value,
+                             size_t max_value);
+
+// Appends the answer to "query" to "out" as a compact JSON object:
+//
+//   {"query":"foo bar","matches":2,"results":[["doc.txt",7],["a.txt",3]]}
+//
+// where "matches" counts every matching document, and "results" holds up
+// to "count" of them, starting with the "first"-best, as (document name,
+// rank) pairs.
+static void AppendAnswerJson(const string& query,
+                             const QueryAnswer& answer,
+                             size_t first,
+                             size_t count,
+                             string* const out);
+
+// Appends the same results as AppendAnswerJson() to "out" in binary,
+// every integer a 4-byte big-endian unsigned number:
+//
+//   [matches] [number of results]
+//   then, for each result: [rank] [name length] [name bytes]
+static void AppendAnswerBinary(const QueryAnswer& answer,
+                               size_t first,
+                               size_t count,
+                               string* const out);
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // HttpServer
 ///////////////////////////////////////////////////////////////////////////////
 bool HttpServer::Run(void) {
+  // Map the indices once; every worker thread shares them.
+  QueryEngine engine(indices_, options_.preload_indices,
+                     options_.in_memory_indices,
+                     options_.query_cache_entries,
+                     options_.query_cache_mb << 20);
+  cout << "  " << (options_.in_memory_indices ? "loading " : "mapping ")
+       << indices_.size() << " index file(s)..." << endl;
+  if (!engine.Start()) {
+    cerr << endl << "Couldn't load the index files." << endl;
+    return false;
+  }
+
+  // Open the static files directory once; every request reads beneath it.
+  FileRoot file_root(static_file_dir_path_);
+  if (!file_root.Open()) {
+    cerr << endl << "Couldn't open " << static_file_dir_path_ << endl;
+    return false;
+  }
+  MimeTypes mime_types;
+  if (!options_.mime_types_file.empty()) {
+    if (!mime_types.Load(options_.mime_types_file)) {
+      cerr << endl << "Couldn't read " << options_.mime_types_file << endl;
+      return false;
+    }
+    cout << "  loaded " << mime_types.size() << " MIME type(s) from "
+         << options_.mime_types_file << endl;
+  }
+  FileCache file_cache(file_root, mime_types, kMaxCachedFiles);
+
+  // Start the access log, if there is to be one.
+  unique_ptr<AccessLog> access_log;
+  if (!options_.access_log_file.empty()) {
+    access_log.reset(new AccessLog(options_.access_log_file));
+    if (!access_log->Start()) {
+      cerr << endl << "Couldn't open " << options_.access_log_file << endl;
+      return false;
+    }
+  }
+
+  // Start recording requests, if asked to.
+  unique_ptr<TrafficRecorder> recorder;
+  if (!options_.record_file.empty()) {
+    recorder.reset(new TrafficRecorder(options_.record_file,
+                                       options_.record_sample));
+    if (!recorder->Start()) {
+      cerr << endl << "Couldn't open " << options_.record_file << endl;
+      return false;
+    }
+  }
+
   // Create the server listening socket.
   int listen_fd;
   cout << "  creating and binding the listening socket..." << endl;
@@ -98,37 +279,115 @@ bool HttpServer::Run(void) {
     cerr << endl << "Couldn't bind to the listening socket." << endl;
     return false;
   }
+  // If Stop() came before this, it couldn't shut the socket down, so
+  // the loop below has to see stopping_ instead.
+  listening_ = true;
 
   // Spin, accepting connections and dispatching them.  Use a
   // threadpool to dispatch connections into their own thread.
   cout << "  accepting connections..." << endl << endl;
-  ThreadPool tp(kNumThreads);
-  while (1) {
-    HttpServerTask* hst = new HttpServerTask(HttpServer_ThrFn);
-    hst->base_dir = static_file_dir_path_;
-    hst->indices = &indices_;
-    if (!socket_.Accept(&hst->client_fd,
-                    &hst->c_addr,
-                    &hst->c_port,
-                    &hst->c_dns,
-                    &hst->s_addr,
-                    &hst->s_dns)) {
-      // The accept failed for some reason, so quit out of the server.
-      // (Will happen when kill command is used to shut down the server.)
-      break;
+  ServerMetrics metrics;
+  RequestTracer tracer(options_.trace_sample);
+  Profiler profiler;
+  ConnectionSet connections;
+  {
+    ThreadPool tp(kNumThreads);
+    while (!stopping_) {
+      HttpServerTask* hst = new HttpServerTask(HttpServer_ThrFn);
+      hst->file_cache = &file_cache;
+      hst->engine = &engine;
+      hst->access_log = access_log.get();
+      hst->recorder = recorder.get();
+      hst->metrics = &metrics;
+      hst->tracer = &tracer;
+      hst->profiler = &profiler;
+      hst->pool = &tp;
+      hst->connections = &connections;
+      if (!socket_.Accept(&hst->client_fd,
+                      &hst->c_addr,
+                      &hst->c_port,
+                      &hst->c_dns,
+                      &hst->s_addr,
+                      &hst->s_dns)) {
+        // The accept failed for some reason, so quit out of the server.
+        // (Will happen when Stop() shuts the listening socket down.)
+        delete hst;
+        break;
+      }
+      // The accept succeeded; dispatch it.
+      metrics.RecordAccept();
+      hst->accepted_ns = ClockNanos(CLOCK_MONOTONIC);
+      tp.Dispatch(hst);
     }
-    // The accept succeeded; dispatch it.
-    tp.Dispatch(hst);
+
+    // Wake the workers waiting on idle connections; the pool's destructor
+    // then waits for the rest to finish their requests.
+    cout << "  stopping..." << endl;
+    connections.ShutdownAll();
+  }
+
+  // Every worker is done, so write out what the recorder and the access
+  // log still hold.
+  if (recorder) {
+    recorder->Stop();
+  }
+  if (access_log) {
+    access_log->Stop();
   }
   return true;
 }
 
+void HttpServer::Stop() {
+  stopping_ = true;
+  if (listening_) {
+    socket_.Shutdown();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ConnectionSet
+///////////////////////////////////////////////////////////////////////////////
+ConnectionSet::ConnectionSet() : shut_down_(false) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+ConnectionSet::~ConnectionSet() {
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+void ConnectionSet::Add(int fd) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  fds_.insert(fd);
+  if (shut_down_) {
+    shutdown(fd, SHUT_RD);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void ConnectionSet::Remove(int fd) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  fds_.erase(fd);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+void ConnectionSet::ShutdownAll() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  shut_down_ = true;
+  for (int fd : fds_) {
+    shutdown(fd, SHUT_RD);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
 static void HttpServer_ThrFn(ThreadPool::Task* t) {
   // Cast back our HttpServerTask structure with all of our new
   // client's information in it.
   unique_ptr<HttpServerTask> hst(static_cast<HttpServerTask*>(t));
-  cout << "  client " << hst->c_dns << ":" << hst->c_port << " "
-       << "(IP address " << hst->c_addr << ")" << " connected." << endl;
+  AccessLog* access_log = hst->access_log;
+  ServerMetrics* metrics = hst->metrics;
+  RequestTracer* tracer = hst->tracer;
+  metrics->RecordConnectionOpened(ClockNanos(CLOCK_MONOTONIC) -
+                                  hst->accepted_ns);
 
   // Read in the next request, process it, and write the response.
 
@@ -142,19 +401,72 @@ static void HttpServer_ThrFn(ThreadPool::Task* t) {
   // creating/destroying the same connection repeatedly.
 
   // STEP 1:
+  hst->connections->Add(hst->client_fd);
   HttpConnection hc(hst->client_fd);
+  hc.set_recorder(hst->recorder);
+  uint64_t bytes_read = 0, bytes_written = 0;
   bool done = false;
   while (!done) {
     HttpRequest request;
+    tracer->BeginRequest();
+    // A request whose body we won't read is still answered, telling the
+    // client why rather than just hanging up, and counted like any other;
+    // then the connection closes.
+    bool refused = false;
     if (!hc.GetNextRequest(&request)) {
+      if (hc.error_code() == 0) {
+        tracer->AbortRequest();
+        done = true;
+        break;
+      }
+      refused = true;
+    }
+
+    metrics->RecordRequestStarted();
+    uint64_t start_ns = ClockNanos(CLOCK_MONOTONIC);
+    // The access log stamps each request with when it arrived.
+    uint64_t arrival_ns =
+        access_log != nullptr ? ClockNanos(CLOCK_REALTIME) : 0;
+    Route route = Route::kRefused;
+    HttpResponse response;
+    uint64_t phase_start;
+    if (refused) {
+      response = RefusedRequestResponse(hc.error_code());
+    } else {
+      phase_start = RequestTracer::Now();
+      response = ProcessRequest(request, *hst, &route);
+      RequestTracer::Span(RouteName(route), phase_start);
+    }
+    phase_start = RequestTracer::Now();
+    bool written = hc.WriteResponse(response);
+    RequestTracer::Span("write", phase_start);
+    tracer->EndRequest(request.uri(), response.response_code());
+    uint64_t latency_ns = ClockNanos(CLOCK_MONOTONIC) - start_ns;
+    if (response.response_code() == 404) {
+      route = Route::kNotFound;
+    }
+    metrics->RecordRequestFinished(route, latency_ns,
+                                   hc.bytes_read() - bytes_read,
+                                   hc.bytes_written() - bytes_written);
+    bytes_read = hc.bytes_read();
+    bytes_written = hc.bytes_written();
+    if (access_log != nullptr) {
+      AccessEntry entry;
+      entry.time_ns = arrival_ns;
+      entry.latency_ns = latency_ns;
+      entry.client = hst->c_addr;
+      entry.method = request.method();
+      entry.uri = request.uri();
+      entry.status = response.response_code();
+      entry.bytes = response.body().size();
+      access_log->Log(entry);
+    }
+    if (refused) {
+      hc.DiscardInput();
       done = true;
       break;
     }
-
-    HttpResponse response = ProcessRequest(request,
-                                           hst->base_dir,
-                                           *hst->indices);
-    if (!hc.WriteResponse(response)) {
+    if (!written) {
       done = true;
       break;
     }
@@ -164,84 +476,80 @@ static void HttpServer_ThrFn(ThreadPool::Task* t) {
       break;
     }
   }
-  close(hst->client_fd);
+  hst->connections->Remove(hst->client_fd);
+  hc.Close();
+  metrics->RecordConnectionClosed();
 }
 
 static HttpResponse ProcessRequest(const HttpRequest& req,
-                            const string& base_dir,
-                            const list<string>& indices) {
+                                   const HttpServerTask& hst,
+                                   Route* const route) {
   // Is the user asking for a static file?
   if (req.uri().substr(0, staticHeaderLen) == "/static/") {
-    return ProcessFileRequest(req.uri(), base_dir);
+    *route = Route::kStatic;
+    return ProcessFileRequest(req.uri(), hst.file_cache);
+  }
+
+  // Is the search box asking for completions?
+  if (req.uri().substr(0, 9) == "/suggest?") {
+    *route = Route::kSuggest;
+    return ProcessSuggestRequest(req.uri(), hst.engine);
+  }
+
+  // Is a program asking for a query's results?
+  if (req.uri().substr(0, 11) == "/api/query?") {
+    *route = Route::kApiQuery;
+    return ProcessApiQueryRequest(req, hst.engine);
+  }
+
+  // Is a program sending us a batch of queries?
+  if (req.uri() == "/batch" || req.uri().substr(0, 7) == "/batch?") {
+    *route = Route::kBatch;
+    return ProcessBatchRequest(req, hst.engine);
+  }
+
+  // Is the user asking for the server's counters?
+  if (req.uri() == "/stats") {
+    *route = Route::kStats;
+    return ProcessStatsRequest(hst);
+  }
+
+  // Is the user asking for traced requests?
+  if (req.uri() == "/debug/trace" ||
+      req.uri().substr(0, 13) == "/debug/trace?") {
+    *route = Route::kDebug;
+    return ProcessTraceRequest(req.uri(), hst.tracer);
+  }
+
+  // Is the user asking for a CPU profile?
+  if (req.uri() == "/debug/profile" ||
+      req.uri().substr(0, 15) == "/debug/profile?") {
+    *route = Route::kDebug;
+    return ProcessProfileRequest(req.uri(), hst.profiler);
   }
 
   // The user must be asking for a query.
-  return ProcessQueryRequest(req.uri(), indices);
+  *route = Route::kQuery;
+  return ProcessQueryRequest(req.uri(), hst.engine);
 }
 
 static HttpResponse ProcessFileRequest(const string& uri,
-                                const string& base_dir) {
+                                FileCache* const file_cache) {
   // The response we'll build up.
   HttpResponse ret;
 
-  // Steps to follow:
-  // 1. Use the URLParser class to figure out what file name
-  //    the user is asking for. Note that we identify a request
-  //    as a file request if the URI starts with '/static/'
-  //
-  // 2. Use the FileReader class to read the file into memory
-  //
-  // 3. Copy the file content into the ret.body
-  //
-  // 4. Depending on the file name suffix, set the response
-  //    Content-type header as appropriate, e.g.,:
-  //      --> for ".html" or ".htm", set to "text/html"
-  //      --> for ".jpeg" or ".jpg", set to "image/jpeg"
-  //      --> for ".png", set to "image/png"
-  //      etc.
-  //    You should support the file types mentioned above,
-  //    as well as ".txt", ".js", ".css", ".xml", ".gif",
-  //    and any other extensions to get bikeapalooza
-  //    to match the solution server.
-  //
-  // be sure to set the response code, protocol, and message
-  // in the HttpResponse as well.
-  string file_name = "";
-
-  // STEP 2:
+  // Figure out which file the user is asking for: the path after
+  // "/static/", relative to the static files directory.
   URLParser url_parser;
   url_parser.Parse(uri);
+  string file_name = url_parser.path().substr(staticHeaderLen);
 
-  // remove "/static/"
-  file_name = url_parser.path().substr(staticHeaderLen);
-
-  FileReader file_reader(base_dir, file_name);
-  string buf;
-
-  if (file_reader.ReadFile(&buf)) {
-    ret.AppendToBody(buf);
-
-    // figure out suffix
-    int pos = file_name.rfind(".");
-    string suffix = file_name.substr(pos);
-
-    // set the content type
-    if (suffix == ".html" || suffix == ".htm") {
-      ret.set_content_type("text/html");
-    } else if (suffix == ".jpeg" || suffix == ".jpg") {
-      ret.set_content_type("image/jpeg");
-    } else if (suffix == ".png") {
-      ret.set_content_type("image/png");
-    } else if (suffix == ".txt") {
-      ret.set_content_type("text/plain");
-    } else if (suffix == ".js") {
-      ret.set_content_type("text/javascript");
-    } else if (suffix == ".css") {
-      ret.set_content_type("text/css");
-    } else if (suffix == ".xml") {
-      ret.set_content_type("text/xml");
-    } else if (suffix == ".gif") {
-      ret.set_content_type("image/gif");
+  // Read it straight into the response, and label it by its suffix.
+  shared_ptr<const FileInfo> info;
+  if (file_cache->Lookup(file_name, &info) &&
+      FileCache::ReadContents(*info, ret.mutable_body())) {
+    if (!info->content_type.empty()) {
+      ret.set_content_type(string(info->content_type));
     }
 
     // protocol, response code, and message
@@ -263,8 +571,34 @@ static HttpResponse ProcessFileRequest(const string& uri,
   return ret;
 }
 
+static HttpResponse RefusedRequestResponse(uint16_t code) {
+  HttpResponse ret;
+  ret.set_protocol("HTTP/1.1");
+  ret.set_content_type("text/plain");
+  ret.set_response_code(code);
+  switch (code) {
+    case 411:
+      ret.set_message("Length Required");
+      ret.AppendToBody("send the body with a Content-Length, not chunked\n");
+      break;
+    case 413:
+      ret.set_message("Payload Too Large");
+      ret.AppendToBody("a request body may hold at most 1 MiB\n");
+      break;
+    case 501:
+      ret.set_message("Not Implemented");
+      ret.AppendToBody("unsupported Transfer-Encoding\n");
+      break;
+    default:
+      ret.set_message("Bad Request");
+      ret.AppendToBody("malformed Content-Length\n");
+      break;
+  }
+  return ret;
+}
+
 static HttpResponse ProcessQueryRequest(const string& uri,
-                                 const list<string>& indices) {
+                                 QueryEngine* const engine) {
   // The response we're building up.
   HttpResponse ret;
 
@@ -281,8 +615,8 @@ static HttpResponse ProcessQueryRequest(const string& uri,
   //    search terms from a typed-in search query.  convert them
   //    to lower case.
   //
-  // 4. Initialize and use hw3::QueryProcessor to process queries with the
-  //    search indices.
+  // 4. Use the server's QueryEngine to process queries with the search
+  //    indices.
   //
   // 5. With your results, try figuring out how to hyperlink results to file
   //    contents, like in solution_binaries/http333d. (Hint: Look into HTML
@@ -295,51 +629,85 @@ static HttpResponse ProcessQueryRequest(const string& uri,
   if (uri.find("query?terms=") != string::npos) {
     URLParser parser;
     parser.Parse(uri);
-    string query = parser.args()["terms"];
+    string query;
+    parser.GetArg("terms", &query);
     trim(query);
     to_lower(query);
 
-    // Store each query word into query_vec
+    // Which window of the results does the user want to see?
+    size_t per_page = GetPositiveArg(parser, "per_page",
+                                     kDefaultResultsPerPage,
+                                     kMaxResultsPerPage);
+    size_t page = GetPositiveArg(parser, "page", 1, kMaxPageNumber);
+    size_t first = (page - 1) * per_page;
+
+    // Store each query word into query_vec, in the normalized form the
+    // query cache is keyed by.
     vector<string> query_vec;
     split(query_vec, query, is_any_of(" "),
                  token_compress_on);
+    QueryEngine::NormalizeQuery(&query_vec);
 
-    hw3::QueryProcessor qp(indices, false);
-    vector<hw3::QueryProcessor::QueryResult> results =
-      qp.ProcessQuery(query_vec);
+    // Only rank as many results as it takes to fill this page.
+    shared_ptr<const QueryAnswer> answer =
+      engine->ProcessQuery(query_vec, first + per_page);
+    const vector<IndexSet::QueryResult>& results = answer->results;
+    size_t num_results = answer->num_matches;
 
     // regardless of our query, escape html when we print it for security
     ret.AppendToBody("<p><br>\n");
-    if (results.size() == 0) {
+    if (num_results == 0) {
       ret.AppendToBody("No results found for <b>");
-      ret.AppendToBody(EscapeHtml(query));
+      AppendEscapedHtml(query, ret.mutable_body());
       ret.AppendToBody("</b>\n</p>\n");
     } else {
-      ret.AppendToBody(to_string(results.size()));
+      ret.AppendToBody(to_string(num_results));
       ret.AppendToBody(" result");
-      if (results.size() > 1) {
+      if (num_results > 1) {
         ret.AppendToBody("s");
       }
       ret.AppendToBody(" found for <b>");
-      ret.AppendToBody(EscapeHtml(query));
+      AppendEscapedHtml(query, ret.mutable_body());
       ret.AppendToBody("</b>\n</p>\n");
 
       // show results and escape HTML for security
       ret.AppendToBody("<ul>\n");
-      for (uint64_t i = 0; i < results.size(); i++) {
+      // A cached answer may hold more results than this page shows.
+      size_t last = min(results.size(), first + per_page);
+      for (uint64_t i = first; i < last; i++) {
         ret.AppendToBody(" <li> <a href=\"");
         if (results[i].document_name.substr(0, 7) != "http://") {
           ret.AppendToBody("/static/");
         }
         ret.AppendToBody(results[i].document_name);
         ret.AppendToBody("\">");
-        ret.AppendToBody(EscapeHtml(results[i].document_name));
+        AppendEscapedHtml(results[i].document_name, ret.mutable_body());
         ret.AppendToBody("</a> [");
         ret.AppendToBody(to_string(results[i].rank));
         ret.AppendToBody("]<br>\n");
         ret.AppendToBody("</li>");
       }
       ret.AppendToBody("</ul>\n");
+
+      // Link to the neighboring pages, if there are any.
+      if (num_results > per_page) {
+        string page_link = "<a href=\"/query?terms=" + URIEncode(query) +
+                           "&amp;per_page=" + to_string(per_page) +
+                           "&amp;page=";
+        ret.AppendToBody("<p>\n");
+        if (page > 1) {
+          ret.AppendToBody(page_link + to_string(page - 1) +
+                           "\">&laquo; Previous</a>\n");
+        }
+        ret.AppendToBody("Page " + to_string(page) + " of " +
+                         to_string((num_results + per_page - 1) / per_page) +
+                         "\n");
+        if (first + per_page < num_results) {
+          ret.AppendToBody(page_link + to_string(page + 1) +
+                           "\">Next &raquo;</a>\n");
+        }
+        ret.AppendToBody("</p>\n");
+      }
     }
   }
 
@@ -354,4 +722,428 @@ static HttpResponse ProcessQueryRequest(const string& uri,
   return ret;
 }
 
+static HttpResponse ProcessSuggestRequest(const string& uri,
+                                          QueryEngine* const engine) {
+  HttpResponse ret;
+  URLParser parser;
+  parser.Parse(uri);
+  string prefix;
+  parser.GetArg("prefix", &prefix);
+  to_lower(prefix);
+  size_t max_results = GetPositiveArg(parser, "n", kDefaultSuggestions,
+                                      kMaxSuggestions);
+
+  // Complete the last word, keeping the ones before it, so that each
+  // suggestion can replace what's in the search box.
+  size_t space = prefix.find_last_of(' ');
+  string head = space == string::npos ? "" : prefix.substr(0, space + 1);
+  string word = prefix.substr(head.size());
+  vector<SuggestTrie::Suggestion> suggestions;
+  if (!word.empty()) {
+    engine->Suggest(word, max_results, &suggestions);
+  }
+
+  // The answer is a JSON array of strings.
+  string body = "[";
+  for (size_t i = 0; i < suggestions.size(); i++) {
+    body += (i == 0 ? "\"" : ",\"");
+    body += EscapeJson(head + suggestions[i].word);
+    body += "\"";
+  }
+  body += "]\n";
+  ret.AppendToBody(body);
+
+  ret.set_content_type("application/json");
+  ret.set_protocol("HTTP/1.1");
+  ret.set_response_code(200);
+  ret.set_message("OK");
+  return ret;
+}
+
+static HttpResponse ProcessBatchRequest(const HttpRequest& req,
+                                        QueryEngine* const engine) {
+  HttpResponse ret;
+  ret.set_protocol("HTTP/1.1");
+  URLParser parser;
+  parser.Parse(req.uri());
+  size_t max_results = GetPositiveArg(parser, "n", kDefaultBatchResults,
+                                      kMaxResultsPerPage);
+
+  // The queries come in the URL's "q=" arguments, or in a POST body: as
+  // "q=" fields if it is form-encoded, otherwise one query per line.
+  vector<string> queries;
+  parser.GetArgs("q", &queries);
+  if (req.method() == "POST") {
+    string content_type = req.GetHeaderValue("content-type");
+    to_lower(content_type);
+    if (content_type.substr(0, 33) == "application/x-www-form-urlencoded") {
+      URLParser form;
+      form.ParseArgs(req.body());
+      form.GetArgs("q", &queries);
+    } else {
+      vector<string> lines;
+      split(lines, req.body(), is_any_of("\n"));
+      for (const string& line : lines) {
+        if (!line.empty()) {
+          queries.push_back(line);
+        }
+      }
+    }
+  } else if (req.method() != "GET") {
+    ret.set_content_type("text/plain");
+    ret.set_response_code(405);
+    ret.set_message("Method Not Allowed");
+    ret.AppendToBody("/batch takes GET or POST requests\n");
+    return ret;
+  }
+  if (queries.size() > kMaxBatchQueries) {
+    ret.set_content_type("text/plain");
+    ret.set_response_code(400);
+    ret.set_message("Bad Request");
+    ret.AppendToBody("a batch may hold at most " +
+                     to_string(kMaxBatchQueries) + " queries\n");
+    return ret;
+  }
+
+  vector<vector<string>> query_vecs(queries.size());
+  for (size_t i = 0; i < queries.size(); i++) {
+    trim(queries[i]);
+    to_lower(queries[i]);
+    split(query_vecs[i], queries[i], is_any_of(" \t\r"), token_compress_on);
+    QueryEngine::NormalizeQuery(&query_vecs[i]);
+  }
+  vector<shared_ptr<const QueryAnswer>> answers =
+    engine->ProcessQueries(query_vecs, max_results);
+
+  // The answer is a JSON array with one object per query, in order.
+  string body = "[";
+  for (size_t i = 0; i < queries.size(); i++) {
+    if (i > 0) {
+      body += ",";
+    }
+    AppendAnswerJson(queries[i], *answers[i], 0, max_results, &body);
+  }
+  body += "]\n";
+  ret.AppendToBody(body);
+
+  ret.set_content_type("application/json");
+  ret.set_response_code(200);
+  ret.set_message("OK");
+  return ret;
+}
+
+static HttpResponse ProcessApiQueryRequest(const HttpRequest& req,
+                                           QueryEngine* const engine) {
+  HttpResponse ret;
+  ret.set_protocol("HTTP/1.1");
+  URLParser parser;
+  parser.Parse(req.uri());
+  string query;
+  parser.GetArg("terms", &query);
+  trim(query);
+  to_lower(query);
+  size_t per_page = GetPositiveArg(parser, "n", kDefaultResultsPerPage,
+                                   kMaxResultsPerPage);
+  size_t page = GetPositiveArg(parser, "page", 1, kMaxPageNumber);
+  size_t first = (page - 1) * per_page;
+
+  // "&format=" picks the format; failing that, the Accept header does.
+  bool binary;
+  string format;
+  if (parser.GetArg("format", &format)) {
+    if (format != "json" && format != "binary") {
+      ret.set_content_type("text/plain");
+      ret.set_response_code(400);
+      ret.set_message("Bad Request");
+      ret.AppendToBody("format must be \"json\" or \"binary\"\n");
+      return ret;
+    }
+    binary = format == "binary";
+  } else {
+    string accept = req.GetHeaderValue("accept");
+    to_lower(accept);
+    binary = accept.find("application/octet-stream") != string::npos &&
+             accept.find("application/json") == string::npos;
+  }
+
+  vector<string> query_vec;
+  split(query_vec, query, is_any_of(" "), token_compress_on);
+  QueryEngine::NormalizeQuery(&query_vec);
+  shared_ptr<const QueryAnswer> answer =
+    engine->ProcessQuery(query_vec, first + per_page);
+
+  // Write the answer straight into the response.
+  if (binary) {
+    AppendAnswerBinary(*answer, first, per_page, ret.mutable_body());
+    ret.set_content_type("application/octet-stream");
+  } else {
+    AppendAnswerJson(query, *answer, first, per_page, ret.mutable_body());
+    ret.mutable_body()->append("\n");
+    ret.set_content_type("application/json");
+  }
+  ret.set_response_code(200);
+  ret.set_message("OK");
+  return ret;
+}
+
+static HttpResponse ProcessStatsRequest(const HttpServerTask& hst) {
+  HttpResponse ret;
+  QueryEngine::Stats engine_stats = hst.engine->GetStats();
+  const QueryCache::Stats& stats = engine_stats.cache;
+  uint64_t lookups = stats.hits + stats.misses;
+
+  // Most of these are counters or gauges in the Prometheus sense, but are
+  // left untyped, as they always have been.
+  stringstream ss;
+  ss << "query_evaluations " << engine_stats.evaluations << "\n";
+  ss << "query_coalesced " << engine_stats.coalesced << "\n";
+  ss << "index_searches " << engine_stats.index_searches << "\n";
+  ss << "index_searches_skipped " << engine_stats.index_searches_skipped
+     << "\n";
+  ss << "query_cache_hits " << stats.hits << "\n";
+  ss << "query_cache_misses " << stats.misses << "\n";
+  ss << "query_cache_hit_ratio "
+     << (lookups == 0 ? 0.0 : static_cast<double>(stats.hits) / lookups)
+     << "\n";
+  ss << "query_cache_saved_seconds " << stats.saved_ns / 1e9 << "\n";
+  ss << "query_cache_entries " << stats.entries << "\n";
+  ss << "query_cache_bytes " << stats.bytes << "\n";
+  ss << "query_cache_evictions " << stats.evictions << "\n";
+  FileCache::Stats file_stats = hst.file_cache->GetStats();
+  uint64_t file_lookups =
+    file_stats.hits + file_stats.misses + file_stats.missing_hits;
+  ss << "static_file_hits " << file_stats.hits << "\n";
+  ss << "static_file_misses " << file_stats.misses << "\n";
+  ss << "static_file_missing_hits " << file_stats.missing_hits << "\n";
+  ss << "static_file_hit_ratio "
+     << (file_lookups == 0 ? 0.0 :
+         static_cast<double>(file_stats.hits + file_stats.missing_hits) /
+         file_lookups)
+     << "\n";
+  ss << "static_files_open " << file_stats.files << "\n";
+  ss << "static_files_missing " << file_stats.missing << "\n";
+  if (hst.access_log != nullptr) {
+    AccessLog::Stats log_stats = hst.access_log->GetStats();
+    ss << "access_log_records " << log_stats.logged << "\n";
+    ss << "access_log_dropped " << log_stats.dropped << "\n";
+  }
+  if (hst.recorder != nullptr) {
+    TrafficRecorder::Stats record_stats = hst.recorder->GetStats();
+    ss << "traffic_recorded " << record_stats.recorded << "\n";
+    ss << "traffic_record_dropped " << record_stats.dropped << "\n";
+    ss << "traffic_record_oversize " << record_stats.oversize << "\n";
+  }
+  Profiler::Stats profile_stats = hst.profiler->GetStats();
+  ss << "profiles " << profile_stats.profiles << "\n";
+  ss << "profile_samples " << profile_stats.samples << "\n";
+  ss << "profile_samples_dropped " << profile_stats.dropped << "\n";
+  ss << "profile_cpu_seconds " << profile_stats.cpu_ns / 1e9 << "\n";
+  ss << "profile_handler_seconds " << profile_stats.handler_ns / 1e9 << "\n";
+
+  ServerMetrics::Snapshot snapshot = hst.metrics->GetSnapshot();
+  ss << "# TYPE process_uptime_seconds gauge\n";
+  ss << "process_uptime_seconds " << snapshot.uptime_ns / 1e9 << "\n";
+  ss << "# TYPE http_accepts_total counter\n";
+  ss << "http_accepts_total " << snapshot.accepts << "\n";
+  ss << "# TYPE http_connections_total counter\n";
+  ss << "http_connections_total " << snapshot.connections << "\n";
+  ss << "# TYPE http_connections gauge\n";
+  ss << "http_connections{state=\"active\"} "
+     << snapshot.active_connections << "\n";
+  ss << "http_connections{state=\"idle\"} "
+     << snapshot.open_connections - snapshot.active_connections << "\n";
+  ss << "# TYPE http_received_bytes_total counter\n";
+  ss << "http_received_bytes_total " << snapshot.bytes_in << "\n";
+  ss << "# TYPE http_sent_bytes_total counter\n";
+  ss << "http_sent_bytes_total " << snapshot.bytes_out << "\n";
+  ss << "# TYPE thread_pool_threads gauge\n";
+  ss << "thread_pool_threads " << hst.pool->NumThreads() << "\n";
+  ss << "# TYPE thread_pool_queue_depth gauge\n";
+  ss << "thread_pool_queue_depth " << hst.pool->QueueLength() << "\n";
+  ss << "# TYPE thread_pool_wait_seconds summary\n";
+  AppendLatencySummary("thread_pool_wait_seconds", "", snapshot.queue_wait,
+                       &ss);
+  ss << "# TYPE http_request_duration_seconds summary\n";
+  for (int i = 0; i < kNumRoutes; i++) {
+    AppendLatencySummary("http_request_duration_seconds",
+                         string("route=\"") +
+                         RouteName(static_cast<Route>(i)) + "\"",
+                         snapshot.routes[i], &ss);
+  }
+  ret.AppendToBody(ss.str());
+
+  ret.set_content_type("text/plain; version=0.0.4");
+  ret.set_protocol("HTTP/1.1");
+  ret.set_response_code(200);
+  ret.set_message("OK");
+  return ret;
+}
+
+static HttpResponse ProcessTraceRequest(const string& uri,
+                                        RequestTracer* const tracer) {
+  HttpResponse ret;
+  ret.set_protocol("HTTP/1.1");
+
+  // "?sample=N" changes the sampling rate; N = 0 turns tracing off.
+  URLParser parser;
+  parser.Parse(uri);
+  string sample;
+  if (parser.GetArg("sample", &sample)) {
+    char* end;
+    unsigned long value = strtoul(sample.c_str(), &end, 10);  // NOLINT
+    if (sample.empty() || *end != '\0' || value > UINT32_MAX) {
+      ret.set_content_type("text/plain");
+      ret.set_response_code(400);
+      ret.set_message("Bad Request");
+      ret.AppendToBody("sample must be a non-negative integer\n");
+      return ret;
+    }
+    tracer->set_sample_every(value);
+    ret.set_content_type("text/plain");
+    ret.AppendToBody(value == 0 ? string("tracing off\n") :
+                     "tracing 1 in " + sample + " requests\n");
+  } else {
+    tracer->AppendChromeTrace(ret.mutable_body());
+    ret.set_content_type("application/json");
+  }
+  ret.set_response_code(200);
+  ret.set_message("OK");
+  return ret;
+}
+
+static HttpResponse ProcessProfileRequest(const string& uri,
+                                          Profiler* const profiler) {
+  HttpResponse ret;
+  ret.set_protocol("HTTP/1.1");
+  ret.set_content_type("text/plain");
+
+  URLParser parser;
+  parser.Parse(uri);
+  uint32_t seconds = GetPositiveArg(parser, "seconds", kDefaultProfileSeconds,
+                                    Profiler::kMaxSeconds);
+  uint32_t hz = GetPositiveArg(parser, "hz", kDefaultProfileHz,
+                               Profiler::kMaxHz);
+  Profiler::Result result;
+  string error;
+  if (!profiler->Profile(seconds, hz, &result, &error)) {
+    ret.set_response_code(503);
+    ret.set_message("Service Unavailable");
+    ret.AppendToBody(error + "\n");
+    return ret;
+  }
+
+  // The signal handler's own time goes in as a stack of its own, in
+  // samples' worth, so the flame graph shows what profiling cost.
+  ret.AppendToBody(result.folded);
+  uint64_t overhead = (result.handler_ns * hz + 500000000) / 1000000000;
+  if (overhead > 0) {
+    ret.AppendToBody("[profiler overhead] " + std::to_string(overhead) +
+                     "\n");
+  }
+  ret.set_response_code(200);
+  ret.set_message("OK");
+  return ret;
+}
+
+static void AppendLatencySummary(const string& name,
+                                 const string& labels,
+                                 const LatencySummary& summary,
+                                 stringstream* const out) {
+  const char* sep = labels.empty() ? "" : ",";
+  const struct {
+    const char* quantile;
+    uint64_t value_ns;
+  } quantiles[] = {
+    {"0.5", summary.p50_ns},
+    {"0.9", summary.p90_ns},
+    {"0.99", summary.p99_ns},
+    {"0.999", summary.p999_ns},
+    {"1", summary.max_ns},
+  };
+  for (const auto& q : quantiles) {
+    *out << name << "{" << labels << sep << "quantile=\"" << q.quantile
+         << "\"} " << q.value_ns / 1e9 << "\n";
+  }
+  string braced = labels.empty() ? "" : "{" + labels + "}";
+  *out << name << "_sum" << braced << " " << summary.sum_ns / 1e9 << "\n";
+  *out << name << "_count" << braced << " " << summary.count << "\n";
+}
+
+static uint64_t ClockNanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static size_t GetPositiveArg(const URLParser& parser,
+                             const string& name,
+                             size_t default_value,
+                             size_t max_value) {
+  string arg;
+  if (!parser.GetArg(name, &arg) || arg.empty()) {
+    return default_value;
+  }
+
+  char* end;
+  unsigned long value = strtoul(arg.c_str(), &end, 10);  // NOLINT
+  if (*end != '\0' || value == 0 || arg[0] == '-') {
+    return default_value;
+  }
+  return min<size_t>(value, max_value);
+}
+
+// Appends "value" to "out" in decimal.
+static void AppendDecimal(uint64_t value, string* const out) {
+  char digits[20];
+  char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+  out->append(digits, end - digits);
+}
+
+// Appends "value" to "out" as 4 big-endian bytes.
+static void AppendUint32(uint32_t value, string* const out) {
+  char bytes[4] = {
+    static_cast<char>(value >> 24), static_cast<char>(value >> 16),
+    static_cast<char>(value >> 8), static_cast<char>(value),
+  };
+  out->append(bytes, sizeof(bytes));
+}
+
+static void AppendAnswerJson(const string& query,
+                             const QueryAnswer& answer,
+                             size_t first,
+                             size_t count,
+                             string* const out) {
+  out->append("{\"query\":\"");
+  AppendEscapedJson(query, out);
+  out->append("\",\"matches\":");
+  AppendDecimal(answer.num_matches, out);
+  out->append(",\"results\":[");
+  // A cached answer may hold more results than were asked for.
+  size_t last = min(answer.results.size(), first + count);
+  for (size_t i = first; i < last; i++) {
+    out->append(i == first ? "[\"" : ",[\"");
+    AppendEscapedJson(answer.results[i].document_name, out);
+    out->append("\",");
+    AppendDecimal(answer.results[i].rank, out);
+    out->append("]");
+  }
+  out->append("]}");
+}
+
+static void AppendAnswerBinary(const QueryAnswer& answer,
+                               size_t first,
+                               size_t count,
+                               string* const out) {
+  size_t last = min(answer.results.size(), first + count);
+  first = min(first, last);
+  AppendUint32(answer.num_matches, out);
+  AppendUint32(last - first, out);
+  for (size_t i = first; i < last; i++) {
+    const IndexSet::QueryResult& result = answer.results[i];
+    AppendUint32(result.rank, out);
+    AppendUint32(result.document_name.size(), out);
+    out->append(result.document_name);
+  }
+}
+
 }  // namespace hw4
@@ -12,15 +12,64 @@
 #ifndef HW4_HTTPSERVER_H_
 #define HW4_HTTPSERVER_H_
 
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
 #include <stdint.h>
+#include <atomic>
 #include <string>
 #include <list>
+#include <set>
 
+#include "./AccessLog.h"
+#include "./FileCache.h"
+#include "./Profiler.h"
+#include "./QueryEngine.h"
+#include "./RequestTracer.h"
+#include "./ServerMetrics.h"
 #include "./ThreadPool.h"
 #include "./ServerSocket.h"
+#include "./TrafficRecorder.h"
 
 namespace hw4 {
 
+// Knobs that change how an HttpServer runs, but not what it serves.
+// http333d sets them from "--name" command-line flags; the defaults
+// reproduce the server's original behavior.
+struct ServerOptions {
+  // Pre-fault the index files into memory and try to mlock() them when
+  // the server starts, so that queries never wait on a page fault.
+  bool preload_indices = false;
+
+  // Copy the index files into compact in-memory indices when the server
+  // starts, and answer queries from those instead of the files.
+  bool in_memory_indices = false;
+
+  // Bounds on the query result cache: at most this many answers, using
+  // about this many megabytes.  Either one set to zero turns the cache off.
+  size_t query_cache_entries = 10000;
+  size_t query_cache_mb = 64;
+
+  // A file in the format of /etc/mime.types, whose types are added to the
+  // built-in ones; empty for none.
+  std::string mime_types_file;
+
+  // Where to write a line per request, or "-" for standard output; empty
+  // for no access log.  See AccessLog.
+  std::string access_log_file;
+
+  // Where to record the requests the server reads, for http333replay;
+  // empty for none.  One in every record_sample requests is recorded.
+  // See TrafficRecorder.
+  std::string record_file;
+  uint32_t record_sample = 1;
+
+  // Trace one in every this many requests on each worker thread, for
+  // /debug/trace; 0 for none.  It can be changed while the server runs.
+  uint32_t trace_sample = 0;
+};
+
 // The HttpServer class contains the main logic for the web server.
 class HttpServer {
  public:
@@ -30,30 +79,71 @@ class HttpServer {
   // does not do anything except memorize these variables.
   explicit HttpServer(uint16_t port,
                       const std::string& static_file_dir_path,
-                      const std::list<std::string>& indices)
+                      const std::list<std::string>& indices,
+                      const ServerOptions& options = ServerOptions())
     : socket_(port), static_file_dir_path_(static_file_dir_path),
-      indices_(indices) { }
+      indices_(indices), options_(options) { }
 
   // The destructor closes the listening socket if it is open and
   // also terminates any threads in the threadpool.
   virtual ~HttpServer() { }
 
-  // Creates a listening socket for the server and launches it, accepting
-  // connections and dispatching them to worker threads.
+  // Maps the index files, creates a listening socket for the server and
+  // launches it, accepting connections and dispatching them to worker
+  // threads.
   //
   // Returns: true if the server was able to start and run and false otherwise.
   //
-  // The server continues to run until a kill command is used to send
-  // a SIGTERM signal to the server process (i.e., kill pid, ctrl+C).
+  // The server continues to run until Stop() is called; http333d calls
+  // it when a kill command sends the process a SIGTERM (i.e., kill pid,
+  // ctrl+C).  Run() then stops accepting connections, closes the idle
+  // ones, waits for the requests in progress to be answered, shuts the
+  // access log and the recorder down, and returns true.
   bool Run();
 
+  // Tells Run() to stop, as above, and returns at once.  Safe to call
+  // from any thread, before or while Run() runs.
+  void Stop();
+
  private:
   ServerSocket socket_;
+  // stopping_ is set by Stop(); listening_ once socket_ is listening.
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> listening_{false};
   std::string static_file_dir_path_;
   std::list<std::string> indices_;
+  ServerOptions options_;
   static const int kNumThreads;
 };
 
+// The connections a server's worker threads have open, so that a server
+// that is stopping can wake the workers waiting on idle ones.
+class ConnectionSet {
+ public:
+  ConnectionSet();
+  virtual ~ConnectionSet();
+
+  // Adds the connection "fd" to the set, and takes it out again.  Remove
+  // a connection before closing it.  A connection added after
+  // ShutdownAll() is shut down at once.
+  void Add(int fd);
+  void Remove(int fd);
+
+  // Shuts down reading on every connection in the set, so that a worker
+  // waiting for a request sees the connection close, while one in the
+  // middle of a request can still write its response.
+  void ShutdownAll();
+
+ private:
+  // fds_ and shut_down_ are guarded by lock_.
+  pthread_mutex_t lock_;
+  std::set<int> fds_;
+  bool shut_down_;
+
+  ConnectionSet(const ConnectionSet&) = delete;
+  ConnectionSet& operator=(const ConnectionSet&) = delete;
+};
+
 class HttpServerTask : public ThreadPool::Task {
  public:
   explicit HttpServerTask(ThreadPool::thread_task_fn f)
@@ -62,8 +152,18 @@ class HttpServerTask : public ThreadPool::Task {
   int client_fd;
   uint16_t c_port;
   std::string c_addr, c_dns, s_addr, s_dns;
-  std::string base_dir;
-  std::list<std::string>* indices;
+  FileCache* file_cache;
+  QueryEngine* engine;
+  AccessLog* access_log;  // null if there isn't one
+  TrafficRecorder* recorder;  // null if there isn't one
+  ServerMetrics* metrics;
+  RequestTracer* tracer;
+  Profiler* profiler;
+  ThreadPool* pool;       // the pool the task runs in
+  ConnectionSet* connections;
+
+  // When the connection was accepted, on the monotonic clock.
+  uint64_t accepted_ns;
 };
 
 }  // namespace hw4
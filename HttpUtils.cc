@@ -16,8 +16,6 @@
 #include <errno.h>
 #include <limits.h>
 #include <netdb.h>
-#include <boost/algorithm/string/replace.hpp>
-#include <boost/algorithm/string.hpp>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,19 +23,20 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>  // for the SSE2 intrinsics
+#endif
 
 #include <iostream>
 #include <vector>
 #include "./HttpUtils.h"
 
-using boost::algorithm::replace_all;
-using boost::split;
-using boost::is_any_of;
 using std::cerr;
 using std::endl;
 using std::map;
 using std::pair;
 using std::string;
+using std::string_view;
 using std::vector;
 
 namespace hw4 {
@@ -78,120 +77,259 @@ bool IsPathSafe(const string& root_dir, const string& test_file) {
 }
 
 string EscapeHtml(const string& from) {
-  string ret = from;
-  // Read through the passed in string, and replace any unsafe
-  // html tokens with the proper escape codes. The characters
-  // that need to be escaped in HTML are the same five as those
-  // that need to be escaped for XML documents. You can see an
-  // example in the comment for this function in HttpUtils.h and
-  // the rest of the characters that need to be replaced can be
-  // looked up online.
-
-  // STEP 2
-
-  replace_all(ret, "&", "&amp;");
-  replace_all(ret, "<", "&lt;");
-  replace_all(ret, ">", "&gt;");
-  replace_all(ret, "\"", "&quot;");
-  replace_all(ret, "\'", "&apos;");
-
+  string ret;
+  AppendEscapedHtml(from, &ret);
   return ret;
 }
 
-// Look for a "%XY" token in the string, where XY is a
-// hex number.  Replace the token with the appropriate ASCII
-// character, but only if 32 <= dec(XY) <= 127.
+// Returns the escape code for "c" if it is one of the characters that must
+// be escaped in HTML (the same five as in XML), and nullptr otherwise.
+static inline const char* HtmlEscapeCode(char c) {
+  switch (c) {
+    case '&': return "&amp;";
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    case '"': return "&quot;";
+    case '\'': return "&apos;";
+    default: return nullptr;
+  }
+}
+
+void AppendEscapedHtml(const string& from, string* const to) {
+  const char* p = from.data();
+  size_t n = from.length();
+  to->reserve(to->length() + n);
+
+  // from[run, i) needs no escaping, and hasn't been copied yet.
+  size_t run = 0, i = 0;
+#ifdef __SSE2__
+  const __m128i amp = _mm_set1_epi8('&');
+  const __m128i lt = _mm_set1_epi8('<');
+  const __m128i gt = _mm_set1_epi8('>');
+  const __m128i quot = _mm_set1_epi8('"');
+  const __m128i apos = _mm_set1_epi8('\'');
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, lt)),
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, gt),
+                                  _mm_cmpeq_epi8(v, quot)),
+                     _mm_cmpeq_epi8(v, apos)));
+    // Bit k of "mask" is set if p[i + k] must be escaped.
+    unsigned int mask = _mm_movemask_epi8(hits);
+    while (mask != 0) {
+      size_t j = i + __builtin_ctz(mask);
+      to->append(p + run, j - run);
+      to->append(HtmlEscapeCode(p[j]));
+      run = j + 1;
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    const char* code = HtmlEscapeCode(p[i]);
+    if (code != nullptr) {
+      to->append(p + run, i - run);
+      to->append(code);
+      run = i + 1;
+    }
+  }
+  to->append(p + run, n - run);
+}
+
+// Returns the value of the hex digit "c", or -1 if it isn't one.
+static inline int HexDigitValue(char c) {
+  if ('0' <= c && c <= '9') {
+    return c - '0';
+  }
+  if ('A' <= c && c <= 'F') {
+    return 10 + (c - 'A');
+  }
+  if ('a' <= c && c <= 'f') {
+    return 10 + (c - 'a');
+  }
+  return -1;
+}
+
 string URIDecode(const string& from) {
   string retstr;
+  AppendURIDecoded(from, &retstr);
+  return retstr;
+}
 
-  // Loop through the characters in the string.
-  for (unsigned int pos = 0; pos < from.length(); pos++) {
-    // note: use pos+n<from.length() instead of pos<from.length-n
-    // to avoid overflow problems with unsigned int values
-    char c1 = from[pos];
-    char c2 = (pos+1 < from.length()) ? toupper(from[pos+1]) : ' ';
-    char c3 = (pos+2 < from.length()) ? toupper(from[pos+2]) : ' ';
-
-    // Special case the '+' for old encoders.
-    if (c1 == '+') {
-      retstr.append(1, ' ');
+// Look for a "%XY" token in the string, where XY is a
+// hex number.  Replace the token with the appropriate ASCII
+// character, but only if 32 <= dec(XY) <= 127.
+void AppendURIDecoded(string_view from, string* const to) {
+  to->reserve(to->length() + from.length());
+
+  // from[run, pos) needs no decoding, and hasn't been copied yet.
+  size_t run = 0;
+  for (size_t pos = 0; pos < from.length(); pos++) {
+    char c = from[pos];
+    if (c != '+' && c != '%') {
       continue;
     }
+    to->append(from.data() + run, pos - run);
+    run = pos + 1;
 
-    // Is this an escape sequence?
-    if (c1 != '%') {
-      retstr.append(1, c1);
+    // Special case the '+' for old encoders.
+    if (c == '+') {
+      to->append(1, ' ');
       continue;
     }
 
-    // Yes.  Are the next two characters hex digits?
-    if (!((('0' <= c2) && (c2 <= '9')) ||
-          (('A' <= c2) && (c2 <= 'F')))) {
-      retstr.append(1, c1);
-      continue;
-    }
-    if (!((('0' <= c3) && (c3 <= '9')) ||
-           (('A' <= c3) && (c3 <= 'F')))) {
-      retstr.append(1, c1);
+    // Is this an escape sequence, with two hex digits and a reasonable
+    // code?  If not, the '%' stands for itself.
+    int high = pos + 1 < from.length() ? HexDigitValue(from[pos + 1]) : -1;
+    int low = pos + 2 < from.length() ? HexDigitValue(from[pos + 2]) : -1;
+    int code = 16 * high + low;
+    if (high < 0 || low < 0 || code < 32 || code > 127) {
+      to->append(1, '%');
       continue;
     }
 
-    // Yes.  Convert to a code.
-    uint8_t code = 0;
-    if (c2 >= 'A') {
-      code = 16 * (10 + (c2 - 'A'));
+    // Great!  Convert and append.
+    to->append(1, static_cast<char>(code));
+    pos += 2;
+    run = pos + 1;
+  }
+  to->append(from.data() + run, from.length() - run);
+}
+
+string URIEncode(const string& from) {
+  static const char* kHexDigits = "0123456789ABCDEF";
+  string retstr;
+  retstr.reserve(from.length());
+
+  for (unsigned char c : from) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+      retstr.append(1, c);
     } else {
-      code = 16 * (c2 - '0');
+      retstr.append(1, '%');
+      retstr.append(1, kHexDigits[c >> 4]);
+      retstr.append(1, kHexDigits[c & 0xF]);
+    }
+  }
+  return retstr;
+}
+
+string EscapeJson(const string& from) {
+  string retstr;
+  retstr.reserve(from.length());
+  AppendEscapedJson(from, &retstr);
+  return retstr;
+}
+
+void AppendEscapedJson(const string& from, string* const to) {
+  static const char* kHexDigits = "0123456789abcdef";
+
+  // Copy runs of characters that need no escaping in one go.
+  size_t run = 0;
+  for (size_t i = 0; i < from.length(); i++) {
+    unsigned char c = from[i];
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
     }
-    if (c3 >= 'A') {
-      code += 10 + (c3 - 'A');
+    to->append(from, run, i - run);
+    run = i + 1;
+    if (c == '"' || c == '\\') {
+      to->append(1, '\\');
+      to->append(1, c);
+    } else if (c == '\n') {
+      to->append("\\n");
+    } else if (c == '\r') {
+      to->append("\\r");
+    } else if (c == '\t') {
+      to->append("\\t");
     } else {
-      code += (c3 - '0');
+      to->append("\\u00");
+      to->append(1, kHexDigits[c >> 4]);
+      to->append(1, kHexDigits[c & 0xF]);
     }
+  }
+  to->append(from, run, from.length() - run);
+}
+
+void URLParser::Parse(string_view url) {
+  // Split the URL into the path and the args components.  (Anything after
+  // a second '?' is ignored.)
+  size_t question = url.find('?');
+  if (question == string_view::npos) {
+    ParseArgs(string_view());
+  } else {
+    string_view args = url.substr(question + 1);
+    ParseArgs(args.substr(0, args.find('?')));
+  }
+  AppendURIDecoded(url.substr(0, question), &path_);
+}
 
-    // Is the code reasonable?
-    if (!((code >= 32) && (code <= 127))) {
-      retstr.append(1, c1);
+void URLParser::ParseArgs(string_view args) {
+  path_.clear();
+  raw_args_.clear();
+  args_.clear();
+  args_built_ = false;
+
+  // Split the args into each field=val; chunk, and each chunk into its
+  // field and value.  A chunk without exactly one '=' is skipped.
+  while (!args.empty()) {
+    size_t amp = args.find('&');
+    string_view chunk = args.substr(0, amp);
+    args = amp == string_view::npos ? string_view()
+                                         : args.substr(amp + 1);
+    size_t equals = chunk.find('=');
+    if (equals == string_view::npos ||
+        chunk.find('=', equals + 1) != string_view::npos) {
       continue;
     }
+    raw_args_.push_back(Arg{chunk.substr(0, equals),
+                            chunk.substr(equals + 1)});
+  }
+}
 
-    // Great!  Convert and append.
-    retstr.append(1, static_cast<char>(code));
-    pos += 2;
+bool URLParser::ArgNameIs(const Arg& arg, string_view name) {
+  // Names are almost never encoded, so compare them as they are if we can.
+  if (arg.name.find_first_of("%+") == string_view::npos) {
+    return arg.name == name;
+  }
+  string decoded;
+  AppendURIDecoded(arg.name, &decoded);
+  return decoded == name;
+}
+
+bool URLParser::GetArg(string_view name, string* const value) const {
+  for (auto it = raw_args_.rbegin(); it != raw_args_.rend(); ++it) {
+    if (ArgNameIs(*it, name)) {
+      value->clear();
+      AppendURIDecoded(it->value, value);
+      return true;
+    }
+  }
+  return false;
+}
+
+void URLParser::GetArgs(string_view name,
+                        vector<string>* const values) const {
+  for (const Arg& arg : raw_args_) {
+    if (ArgNameIs(arg, name)) {
+      values->emplace_back();
+      AppendURIDecoded(arg.value, &values->back());
+    }
   }
-  return retstr;
 }
 
-void URLParser::Parse(const string& url) {
-  url_ = url;
-
-  // Split the URL into the path and the args components.
-  vector<string> ps;
-  split(ps, url, is_any_of("?"));
-  if (ps.size() < 1)
-    return;
-
-  // Store the URI-decoded path.
-  path_ = URIDecode(ps[0]);
-
-  if (ps.size() < 2)
-    return;
-
-  // Split the args into each field=val; chunk.
-  vector<string> vals;
-  split(vals, ps[1], is_any_of("&"));
-
-  // Iterate through the chunks.
-  for (unsigned int i = 0; i < vals.size(); i++) {
-    // Split the chunk into field, value.
-    string val = vals[i];
-    vector<string> fv;
-    split(fv, val, is_any_of("="));
-    if (fv.size() == 2) {
-      // Add the field, value to the args_ map.
-      args_[URIDecode(fv[0])] = URIDecode(fv[1]);
+const map<string, string>& URLParser::args() const {
+  if (!args_built_) {
+    for (const Arg& arg : raw_args_) {
+      string name;
+      AppendURIDecoded(arg.name, &name);
+      string& value = args_[name];
+      value.clear();
+      AppendURIDecoded(arg.value, &value);
     }
+    args_built_ = true;
   }
+  return args_;
 }
 
 uint16_t GetRandPort() {
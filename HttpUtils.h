@@ -18,8 +18,10 @@
 #include <stdint.h>
 
 #include <string>
+#include <string_view>
 #include <utility>
 #include <map>
+#include <vector>
 
 namespace hw4 {
 
@@ -50,6 +52,12 @@ bool IsPathSafe(const std::string& root_dir, const std::string& test_file);
 // XSS attacks.
 std::string EscapeHtml(const std::string& from);
 
+// Like EscapeHtml(), but appends the escaped string to "to" instead of
+// returning a new one.  It makes a single pass over "from", looking for
+// the five dangerous characters 16 bytes at a time and copying the runs
+// between them whole.
+void AppendEscapedHtml(const std::string& from, std::string* const to);
+
 // This function performs URI decoding.  It scans a string for
 // the "%" escape character and converts the token to the
 // appropriate ASCII character.  See the wikipedia article on
@@ -59,6 +67,24 @@ std::string EscapeHtml(const std::string& from);
 //
 std::string URIDecode(const std::string& from);
 
+// Like URIDecode(), but appends the decoded string to "to" instead of
+// returning a new one, copying the runs between escapes whole.
+void AppendURIDecoded(std::string_view from, std::string* const to);
+
+// This function performs URI encoding, the inverse of URIDecode().  Every
+// character other than letters, digits, and "-_.~" is replaced by its
+// "%XY" escape, so the result can be safely embedded in a URL.
+std::string URIEncode(const std::string& from);
+
+// This function escapes a string for use inside a JSON string literal:
+// quotes, backslashes and control characters become "\"", "\\",
+// "\n", "\u001f", and so on.  The surrounding quotes aren't added.
+std::string EscapeJson(const std::string& from);
+
+// Like EscapeJson(), but appends the escaped string to "to" instead of
+// returning a new one, for serializers that build a response in place.
+void AppendEscapedJson(const std::string& from, std::string* const to);
+
 // A URL that's part of a web request has the following structure:
 //
 //   /foo/bar/baz?field=value&field2=value2
@@ -68,24 +94,63 @@ std::string URIDecode(const std::string& from);
 // This class accepts a URL and splits it into these components and
 // URIDecode()'s them, allowing the caller to access the components
 // through convenient methods.
+//
+// The parser doesn't copy the URL: it remembers where each argument is,
+// and decodes one only when it is asked for.  So the URL must not change
+// or go away while the parser is in use.  Parsing again reuses the
+// parser's buffers, so one parser can parse many URLs without allocating.
 class URLParser {
  public:
-  URLParser() { }
+  URLParser() : args_built_(false) { }
   virtual ~URLParser() { }
 
-  void Parse(const std::string& url);
+  void Parse(std::string_view url);
+
+  // Parses just an "args" component, such as "field=value&field2=value2"
+  // (e.g., a form-encoded request body), leaving the path empty.
+  void ParseArgs(std::string_view args);
+
+  // A temporary string would go away while the parser still points into
+  // it, so parsing one doesn't compile.  String literals last forever.
+  void Parse(std::string&& url) = delete;
+  void ParseArgs(std::string&& args) = delete;
+  void Parse(const char* url) { Parse(std::string_view(url)); }
+  void ParseArgs(const char* args) { ParseArgs(std::string_view(args)); }
 
   // Return the "path" component of the url, post-uri-decoding.
-  std::string path() const { return path_; }
+  const std::string& path() const { return path_; }
+
+  // Sets "value" to the value of the argument "name", post-uri-decoding,
+  // and returns true; returns false if there is no such argument.  If the
+  // argument is repeated, the last value wins, as in args().
+  bool GetArg(std::string_view name, std::string* const value) const;
+
+  // Appends every value of the argument "name", post-uri-decoding, to
+  // "values", in the order they appear.
+  void GetArgs(std::string_view name,
+               std::vector<std::string>* const values) const;
 
   // Return the "args" component of the url post-uri-decoding.
   // The args component is parsed into a map from field to value.
-  std::map<std::string, std::string> args() const { return args_; }
+  // The map is built the first time it's asked for.
+  const std::map<std::string, std::string>& args() const;
 
  private:
-  std::string url_;
+  // An argument, as it appears in the URL (still URI-encoded).
+  struct Arg {
+    std::string_view name;
+    std::string_view value;
+  };
+
+  // Returns true if "arg" is named "name".
+  static bool ArgNameIs(const Arg& arg, std::string_view name);
+
   std::string path_;
-  std::map<std::string, std::string> args_;
+  std::vector<Arg> raw_args_;
+
+  // Built from raw_args_ by args().
+  mutable std::map<std::string, std::string> args_;
+  mutable bool args_built_;
 };
 
 // Return a randomly generated port number between 10000 and 40000.
@@ -0,0 +1,417 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "./IndexSet.h"
+#include "./PostingIntersect.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::cerr;
+using std::endl;
+using std::list;
+using std::map;
+using std::max;
+using std::min;
+using std::nth_element;
+using std::pair;
+using std::priority_queue;
+using std::sort;
+using std::string;
+using std::unique_ptr;
+using std::move;
+using std::vector;
+
+namespace hw4 {
+
+// static
+const uint32_t IndexSet::kMaxComputeThreads = 16;
+
+// Tracks how many IndexTasks of one query are still running, so that the
+// thread that issued the query can wait for all of them to finish.
+struct QueryLatch {
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  int remaining;
+};
+
+class IndexSet::IndexTask : public ThreadPool::Task {
+ public:
+  explicit IndexTask(ThreadPool::thread_task_fn f) : ThreadPool::Task(f) { }
+
+  const IndexSet* index_set;
+  size_t index;
+  const vector<string>* query;
+  size_t max_results;
+  vector<QueryResult>* results;
+  size_t* num_matches;
+  QueryLatch* latch;
+};
+
+// Orders postings from highest to lowest rank (the total number of
+// positions), breaking ties by document ID so the order is repeatable.
+template <typename Posting>
+static bool PostingRankLess(const Posting& a, const Posting& b) {
+  if (a.num_positions != b.num_positions) {
+    return a.num_positions > b.num_positions;
+  }
+  return a.doc_id < b.doc_id;
+}
+
+bool IndexSet::Load(const list<string>& index_files, bool preload,
+                    bool in_memory) {
+  // How many documents each word appears in, across all the indices.
+  map<string, uint32_t> doc_counts;
+  for (const string& file : index_files) {
+    unique_ptr<MappedIndex> index(new MappedIndex(file));
+    if (!index->Map(preload && !in_memory)) {
+      return false;
+    }
+    vector<uint64_t> hashes;
+    if (!index->ForEachDictionaryWord(
+            [&hashes, &doc_counts](const string& word, uint32_t num_docs) {
+              hashes.push_back(BloomFilter::Hash(word));
+              doc_counts[word] += num_docs;
+            })) {
+      cerr << file << " is not a valid index file" << endl;
+      return false;
+    }
+    filters_.emplace_back();
+    filters_.back().Reset(hashes.size());
+    for (uint64_t hash : hashes) {
+      filters_.back().Add(hash);
+    }
+    if (in_memory) {
+      unique_ptr<MemoryIndex> memory_index(new MemoryIndex());
+      if (!memory_index->Build(*index)) {
+        cerr << file << " is not a valid index file" << endl;
+        return false;
+      }
+      index->Unmap();
+      memory_indices_.push_back(move(memory_index));
+    }
+    indices_.push_back(move(index));
+  }
+
+  suggest_trie_.Build(vector<pair<string, uint32_t>>(doc_counts.begin(),
+                                                     doc_counts.end()));
+
+  // The thread running a query searches one index itself, so it needs
+  // help with the rest.
+  if (indices_.size() > 1) {
+    uint32_t num_threads = min<uint32_t>(indices_.size() - 1,
+                                         kMaxComputeThreads);
+    num_threads = min<uint32_t>(
+        num_threads, max(2u, std::thread::hardware_concurrency()));
+    compute_pool_.reset(new ThreadPool(num_threads));
+  }
+  return true;
+}
+
+size_t IndexSet::MemoryBytes() const {
+  size_t bytes = 0;
+  if (!memory_indices_.empty()) {
+    for (const unique_ptr<MemoryIndex>& index : memory_indices_) {
+      bytes += index->MemoryBytes();
+    }
+  } else {
+    for (const unique_ptr<MappedIndex>& index : indices_) {
+      bytes += index->length();
+    }
+  }
+  for (const BloomFilter& filter : filters_) {
+    bytes += filter.MemoryBytes();
+  }
+  return bytes;
+}
+
+void IndexSet::Suggest(const string& prefix, size_t max_results,
+                       vector<SuggestTrie::Suggestion>* const suggestions)
+    const {
+  suggest_trie_.Complete(prefix, max_results, suggestions);
+}
+
+bool IndexSet::Changed() const {
+  for (const unique_ptr<MappedIndex>& index : indices_) {
+    if (index->Changed()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+vector<IndexSet::QueryResult> IndexSet::ProcessQuery(
+    const vector<string>& query) const {
+  size_t num_matches;
+  return ProcessQuery(query, SIZE_MAX, &num_matches);
+}
+
+vector<IndexSet::QueryResult> IndexSet::ProcessQuery(
+    const vector<string>& query,
+    size_t max_results,
+    size_t* const num_matches,
+    size_t* const num_searched) const {
+  *num_matches = 0;
+  if (num_searched != nullptr) {
+    *num_searched = 0;
+  }
+  if (query.empty() || indices_.empty() || max_results == 0) {
+    return vector<QueryResult>();
+  }
+
+  // Only search the indices that might hold every word.
+  vector<uint64_t> hashes;
+  for (const string& word : query) {
+    hashes.push_back(BloomFilter::Hash(word));
+  }
+  vector<size_t> candidates;
+  for (size_t i = 0; i < indices_.size(); i++) {
+    bool may_match = true;
+    for (size_t j = 0; j < hashes.size() && may_match; j++) {
+      may_match = filters_[i].MayContain(hashes[j]);
+    }
+    if (may_match) {
+      candidates.push_back(i);
+    }
+  }
+  if (num_searched != nullptr) {
+    *num_searched = candidates.size();
+  }
+  if (candidates.empty()) {
+    return vector<QueryResult>();
+  }
+  if (candidates.size() == 1) {
+    return SearchIndex(candidates[0], query, max_results, num_matches);
+  }
+
+  // Fan the query out: all but the first candidate go to the compute
+  // pool, and we search the first while they run.  The partial results
+  // stay in index order, so MergeByRank() breaks ties the same way no
+  // matter which indices were skipped.
+  vector<vector<QueryResult>> partials(candidates.size());
+  vector<size_t> partial_matches(candidates.size());
+  QueryLatch latch;
+  Verify333(pthread_mutex_init(&latch.lock, nullptr) == 0);
+  Verify333(pthread_cond_init(&latch.done, nullptr) == 0);
+  latch.remaining = candidates.size() - 1;
+
+  for (size_t i = 1; i < candidates.size(); i++) {
+    IndexTask* task = new IndexTask(IndexTask_ThrFn);
+    task->index_set = this;
+    task->index = candidates[i];
+    task->query = &query;
+    task->max_results = max_results;
+    task->results = &partials[i];
+    task->num_matches = &partial_matches[i];
+    task->latch = &latch;
+    compute_pool_->Dispatch(task);
+  }
+  partials[0] = SearchIndex(candidates[0], query, max_results,
+                            &partial_matches[0]);
+
+  Verify333(pthread_mutex_lock(&latch.lock) == 0);
+  while (latch.remaining > 0) {
+    Verify333(pthread_cond_wait(&latch.done, &latch.lock) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&latch.lock) == 0);
+  Verify333(pthread_cond_destroy(&latch.done) == 0);
+  Verify333(pthread_mutex_destroy(&latch.lock) == 0);
+
+  for (size_t matches : partial_matches) {
+    *num_matches += matches;
+  }
+  return MergeByRank(&partials, max_results);
+}
+
+void IndexSet::IndexTask_ThrFn(ThreadPool::Task* t) {
+  unique_ptr<IndexTask> task(static_cast<IndexTask*>(t));
+  *task->results = task->index_set->SearchIndex(task->index, *task->query,
+                                                task->max_results,
+                                                task->num_matches);
+
+  // The latch lives on the issuing thread's stack, and that thread may
+  // return as soon as remaining hits zero; don't touch it after unlocking.
+  QueryLatch* latch = task->latch;
+  Verify333(pthread_mutex_lock(&latch->lock) == 0);
+  if (--latch->remaining == 0) {
+    Verify333(pthread_cond_signal(&latch->done) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&latch->lock) == 0);
+}
+
+vector<IndexSet::QueryResult> IndexSet::SearchIndex(
+    size_t i, const vector<string>& query,
+    size_t max_results, size_t* const num_matches) const {
+  if (!memory_indices_.empty()) {
+    return ProcessIndex(*memory_indices_[i], query, max_results,
+                        num_matches);
+  }
+  return ProcessIndex(*indices_[i], query, max_results, num_matches);
+}
+
+// Finds the documents in "index" that contain every word of "query", and
+// returns the best "max_results" of them, best first, through "top".
+template <typename Index>
+static void RankMatches(const Index& index, const vector<string>& query,
+                        size_t max_results,
+                        vector<typename Index::Posting>* const top,
+                        size_t* const num_matches) {
+  typedef typename Index::Posting Posting;
+  typedef decltype(Posting::doc_id) DocID;
+  vector<Posting>& matches = *top;
+  matches.clear();
+  *num_matches = 0;
+
+  // Look up every word first; if any of them is missing, nothing matches.
+  vector<vector<Posting>> lists(query.size());
+  for (size_t i = 0; i < query.size(); i++) {
+    if (!index.LookupWord(query[i], &lists[i])) {
+      return;
+    }
+  }
+
+  // Intersect from the rarest word up, so the running set of matches is
+  // as small as it can be from the start, and the intersection can gallop
+  // through the longer lists instead of reading all of them.
+  sort(lists.begin(), lists.end(),
+       [](const vector<Posting>& a, const vector<Posting>& b) {
+         return a.size() < b.size();
+       });
+
+  // "matches" holds the documents that contain every word so far, with
+  // their running totals; "ids" holds just their IDs, which is what the
+  // intersection works on.  Posting lists come sorted by document ID.
+  vector<Posting> merged;
+  vector<DocID> ids, list_ids;
+  vector<uint32_t> in_matches, in_list;
+  matches.swap(lists[0]);
+  ids.reserve(matches.size());
+  for (const Posting& p : matches) {
+    ids.push_back(p.doc_id);
+  }
+
+  for (size_t i = 1; i < lists.size() && !matches.empty(); i++) {
+    const vector<Posting>& list = lists[i];
+    list_ids.resize(list.size());
+    for (size_t j = 0; j < list.size(); j++) {
+      list_ids[j] = list[j].doc_id;
+    }
+    in_matches.resize(ids.size());
+    in_list.resize(ids.size());
+    size_t num_common = IntersectPostings(ids.data(), ids.size(),
+                                          list_ids.data(), list_ids.size(),
+                                          in_matches.data(), in_list.data());
+
+    // Keep the common documents, adding up the number of times each word
+    // appears in them.
+    merged.resize(num_common);
+    for (size_t j = 0; j < num_common; j++) {
+      merged[j] = matches[in_matches[j]];
+      merged[j].num_positions += list[in_list[j]].num_positions;
+      ids[j] = merged[j].doc_id;
+    }
+    ids.resize(num_common);
+    matches.swap(merged);
+  }
+
+  // Rank only as many matches as were asked for: select the best
+  // max_results, then sort just those.
+  *num_matches = matches.size();
+  if (matches.size() > max_results) {
+    nth_element(matches.begin(), matches.begin() + max_results,
+                matches.end(), PostingRankLess<Posting>);
+    matches.resize(max_results);
+  }
+  sort(matches.begin(), matches.end(), PostingRankLess<Posting>);
+}
+
+// A MemoryIndex keeps upper bounds on its position counts, so it can find
+// the best matches without scoring all of them.
+static void RankMatches(const MemoryIndex& index, const vector<string>& query,
+                        size_t max_results,
+                        vector<MemoryIndex::Posting>* const top,
+                        size_t* const num_matches) {
+  index.TopMatches(query, max_results, top, num_matches);
+}
+
+template <typename Index>
+vector<IndexSet::QueryResult> IndexSet::ProcessIndex(
+    const Index& index, const vector<string>& query,
+    size_t max_results, size_t* const num_matches) {
+  vector<typename Index::Posting> matches;
+  RankMatches(index, query, max_results, &matches, num_matches);
+
+  // Turn the surviving document IDs into names.
+  vector<QueryResult> results;
+  results.reserve(matches.size());
+  for (const typename Index::Posting& match : matches) {
+    QueryResult result;
+    if (!index.LookupDocID(match.doc_id, &result.document_name)) {
+      continue;
+    }
+    result.rank = match.num_positions;
+    results.push_back(result);
+  }
+  return results;
+}
+
+vector<IndexSet::QueryResult> IndexSet::MergeByRank(
+    vector<vector<QueryResult>>* const partials,
+    size_t max_results) {
+  // A k-way merge: the heap holds the next unmerged result of each
+  // partial list, with the highest-ranked one (or, among equals, the one
+  // from the earliest list) on top.
+  typedef std::pair<size_t, size_t> Cursor;  // (list, position in list)
+  auto lower = [partials](const Cursor& a, const Cursor& b) {
+    int a_rank = (*partials)[a.first][a.second].rank;
+    int b_rank = (*partials)[b.first][b.second].rank;
+    if (a_rank != b_rank) {
+      return a_rank < b_rank;
+    }
+    return a.first > b.first;
+  };
+  priority_queue<Cursor, vector<Cursor>, decltype(lower)> heap(lower);
+
+  size_t total = 0;
+  for (size_t i = 0; i < partials->size(); i++) {
+    total += (*partials)[i].size();
+    if (!(*partials)[i].empty()) {
+      heap.push(Cursor(i, 0));
+    }
+  }
+
+  vector<QueryResult> results;
+  results.reserve(min(total, max_results));
+  while (!heap.empty() && results.size() < max_results) {
+    Cursor top = heap.top();
+    heap.pop();
+    results.push_back(move((*partials)[top.first][top.second]));
+    if (++top.second < (*partials)[top.first].size()) {
+      heap.push(top);
+    }
+  }
+  return results;
+}
+
+}  // namespace hw4
@@ -0,0 +1,161 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXSET_H_
+#define HW4_INDEXSET_H_
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./BloomFilter.h"
+#include "./MappedIndex.h"
+#include "./MemoryIndex.h"
+#include "./SuggestTrie.h"
+#include "./ThreadPool.h"
+
+namespace hw4 {
+
+// An IndexSet is the collection of index files that the server answers
+// queries from.  The files are mapped once, when the server starts, and
+// then shared read-only by every worker thread; it plays the role that a
+// per-request hw3::QueryProcessor used to, and ranks results the same
+// way.
+//
+// When there is more than one index, a query searches them concurrently:
+// the calling thread takes the first index and hands the rest to an
+// internal pool of compute threads, so a query takes about as long as
+// its slowest index rather than the sum of all of them.
+//
+// Each index also gets a BloomFilter over its dictionary when it loads.
+// A query only searches the indices whose filters say they might hold
+// every one of its words, so with many index files, a query for rare
+// words touches just the few that contain them.
+//
+// The words of all the indices also go into a SuggestTrie, weighted by
+// the number of documents they appear in, to complete what users type
+// into the search box.
+//
+// Queries are normally answered straight from the mapped files.  An
+// IndexSet can instead copy each file into a MemoryIndex when it loads,
+// and answer from those; that takes longer to start and uses memory
+// outside the page cache, but each query does far less work.
+class IndexSet {
+ public:
+  IndexSet() { }
+  virtual ~IndexSet() { }
+
+  // Maps each of the index files in "index_files", builds their filters
+  // and the suggestion trie, and starts the compute threads if there is
+  // more than one.  See MappedIndex::Map() for the
+  // meaning of "preload".  If "in_memory" is true, each file is then
+  // copied into a MemoryIndex and unmapped.  Returns false if any of them
+  // couldn't be loaded.
+  bool Load(const std::list<std::string>& index_files, bool preload,
+            bool in_memory = false);
+
+  // Returns how many bytes of memory the indices occupy: the size of the
+  // mapped files, or of the MemoryIndexes that replaced them.
+  size_t MemoryBytes() const;
+
+  // Returns true if any of the index files changed on disk since they
+  // were loaded.  See MappedIndex::Changed().
+  bool Changed() const;
+
+  // Fills "suggestions" with up to "max_results" words that start with
+  // "prefix", from the most to the least widely used; see
+  // SuggestTrie::Complete().
+  void Suggest(const std::string& prefix, size_t max_results,
+               std::vector<SuggestTrie::Suggestion>* const suggestions) const;
+
+  // The number of indices in the set.
+  size_t size() const { return indices_.size(); }
+
+  // A single search result: a matching document and its rank.
+  class QueryResult {
+   public:
+    // Sorts results so that the highest rank comes first.
+    bool operator<(const QueryResult& rhs) const { return rank > rhs.rank; }
+
+    std::string document_name;  // The name of a matching document.
+    int rank;                   // The rank of the matching document.
+  };
+
+  // Processes a query against every index in the set.  "query" is a
+  // vector of lower-case words; a document matches if it contains every
+  // one of them, and its rank is the total number of times they appear
+  // in it.  Returns the matches, sorted from highest to lowest rank.
+  std::vector<QueryResult> ProcessQuery(
+      const std::vector<std::string>& query) const;
+
+  // Like ProcessQuery() above, but only ranks, names and returns the
+  // "max_results" best matches; the total number of matching documents
+  // is returned through "num_matches".  Matches with equal rank are
+  // always returned in the same order, so asking for a larger
+  // "max_results" extends the list rather than reshuffling it, which is
+  // what paging through results needs.  If "num_searched" isn't null,
+  // it is set to the number of indices that the filters didn't rule out.
+  std::vector<QueryResult> ProcessQuery(
+      const std::vector<std::string>& query,
+      size_t max_results,
+      size_t* const num_matches,
+      size_t* const num_searched = nullptr) const;
+
+ private:
+  // Runs "query" against index number "i", returning its "max_results"
+  // best matches sorted from highest to lowest rank, and the number of
+  // documents that matched through "num_matches".
+  std::vector<QueryResult> SearchIndex(
+      size_t i, const std::vector<std::string>& query,
+      size_t max_results, size_t* const num_matches) const;
+
+  // Does the work of SearchIndex() for either kind of index.
+  template <typename Index>
+  static std::vector<QueryResult> ProcessIndex(
+      const Index& index, const std::vector<std::string>& query,
+      size_t max_results, size_t* const num_matches);
+
+  // Merges per-index results, each already sorted by rank, into one list
+  // sorted by rank, stopping after "max_results".  Ties go to the index
+  // that comes first.
+  static std::vector<QueryResult> MergeByRank(
+      std::vector<std::vector<QueryResult>>* const partials,
+      size_t max_results);
+
+  // The ThreadPool task that runs ProcessIndex() for one index.
+  class IndexTask;
+  static void IndexTask_ThrFn(ThreadPool::Task* t);
+
+  // The upper bound on the number of compute threads.
+  static const uint32_t kMaxComputeThreads;
+
+  std::vector<std::unique_ptr<MappedIndex>> indices_;
+
+  // filters_[i] holds every word of indices_[i].
+  std::vector<BloomFilter> filters_;
+
+  // Every word of every index, for Suggest().
+  SuggestTrie suggest_trie_;
+
+  // If the IndexSet was loaded "in_memory", the copies of indices_ that
+  // queries are answered from; otherwise empty.
+  std::vector<std::unique_ptr<MemoryIndex>> memory_indices_;
+
+  // Searches all but the first index of a query; null if there is only
+  // one index.  Declared after indices_ so that it is destroyed (and its
+  // threads joined) before the indices are unmapped.
+  std::unique_ptr<ThreadPool> compute_pool_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXSET_H_
@@ -0,0 +1,495 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+extern "C" {
+#include <pthread.h>
+}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "./HttpUtils.h"
+#include "./LoadGenerator.h"
+#include "./MappedIndex.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+static const char* const kKindNames[kNumLoadKinds] = {
+  "small", "medium", "large", "missing", "query", "api"
+};
+
+// Files up to this size are "small", and up to the next "medium".
+static const uintmax_t kSmallFileBytes = 4 * 1024;
+static const uintmax_t kMediumFileBytes = 64 * 1024;
+
+// How many requests to generate; the connections cycle through them.
+static const size_t kNumRequests = 20000;
+
+// How many results an "api" request asks for.
+static const int kApiResults = 10;
+
+// What one connection thread measured.
+struct Measurements {
+  vector<uint64_t> latencies_ns[kNumLoadKinds];
+  uint64_t bytes[kNumLoadKinds] = {};
+  uint64_t errors[kNumLoadKinds] = {};
+};
+
+struct LoadGenerator::Worker {
+  const LoadGenerator* generator;
+  size_t first_request;       // where in requests_ it starts
+  uint64_t measure_start_ns;  // responses before this are warmup
+  uint64_t end_ns;            // stop sending at this time
+  Measurements measurements;
+};
+
+static uint64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+const char* LoadKindName(int kind) {
+  return kind >= 0 && kind < kNumLoadKinds ? kKindNames[kind] : "all";
+}
+
+bool ParseLoadMix(LoadOptions* const options) {
+  std::fill(options->weights, options->weights + kNumLoadKinds, 0);
+  std::stringstream mix(options->mix);
+  string item;
+  double sum = 0;
+  while (std::getline(mix, item, ',')) {
+    size_t colon = item.find(':');
+    string name = item.substr(0, colon);
+    double weight = colon == string::npos ? 1 :
+                    atof(item.c_str() + colon + 1);
+    int kind = std::find(kKindNames, kKindNames + kNumLoadKinds, name) -
+               kKindNames;
+    if (kind == kNumLoadKinds || weight < 0) {
+      return false;
+    }
+    options->weights[kind] += weight;
+    sum += weight;
+  }
+  return sum > 0;
+}
+
+void AppendLoadResultsJson(const vector<LoadResult>& results,
+                           string* const out) {
+  out->append("[");
+  for (size_t i = 0; i < results.size(); i++) {
+    const LoadResult& result = results[i];
+    char line[512];
+    snprintf(line, sizeof(line),
+             "%s\n  {\"kind\":\"%s\",\"requests\":%llu,"
+             "\"requests_per_second\":%.1f,\"mib_per_second\":%.1f,"
+             "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,"
+             "\"errors\":%llu}",
+             i == 0 ? "" : ",", result.kind.c_str(),
+             static_cast<unsigned long long>(result.requests),  // NOLINT
+             result.requests_per_second, result.mib_per_second,
+             result.p50_us, result.p99_us, result.p999_us,
+             static_cast<unsigned long long>(result.errors));  // NOLINT
+    out->append(line);
+  }
+  out->append("\n]");
+}
+
+// Returns the number that follows "key" in "json", starting the search
+// at "from" and giving up at "to"; 0 if it isn't there.
+static double NumberAfter(const string& json, const char* key, size_t from,
+                          size_t to) {
+  size_t pos = json.find(key, from);
+  if (pos == string::npos || pos >= to) {
+    return 0;
+  }
+  return atof(json.c_str() + pos + strlen(key));
+}
+
+bool ReadLoadResultsJson(const string& json,
+                         vector<LoadResult>* const results) {
+  static const char kKind[] = "{\"kind\":\"";
+  results->clear();
+  size_t pos = json.find(kKind);
+  while (pos != string::npos) {
+    size_t name_start = pos + strlen(kKind);
+    size_t name_end = json.find('"', name_start);
+    size_t next = json.find(kKind, name_start);
+    size_t end = json.find('}', name_start);
+    if (name_end == string::npos || end == string::npos) {
+      return false;
+    }
+    LoadResult result;
+    result.kind = json.substr(name_start, name_end - name_start);
+    result.requests = NumberAfter(json, "\"requests\":", name_end, end);
+    result.errors = NumberAfter(json, "\"errors\":", name_end, end);
+    result.requests_per_second =
+      NumberAfter(json, "\"requests_per_second\":", name_end, end);
+    result.mib_per_second =
+      NumberAfter(json, "\"mib_per_second\":", name_end, end);
+    result.p50_us = NumberAfter(json, "\"p50_us\":", name_end, end);
+    result.p99_us = NumberAfter(json, "\"p99_us\":", name_end, end);
+    result.p999_us = NumberAfter(json, "\"p999_us\":", name_end, end);
+    results->push_back(result);
+    pos = next;
+  }
+  return !results->empty();
+}
+
+LoadGenerator::LoadGenerator(const LoadOptions& options)
+  : options_(options) { }
+
+LoadGenerator::~LoadGenerator() { }
+
+// Returns the URI of "path", relative to the static files directory.
+static string StaticUri(const std::filesystem::path& path) {
+  string uri = "/static";
+  for (const std::filesystem::path& part : path) {
+    uri += "/" + URIEncode(part.string());
+  }
+  return uri;
+}
+
+// Adds the words of the index files to "words", each with the weight it
+// is to be drawn with, as a running total in "tickets".
+static bool ReadVocabulary(const LoadOptions& options,
+                           vector<string>* const words,
+                           vector<uint64_t>* const tickets,
+                           string* const error) {
+  for (const string& file : options.index_files) {
+    MappedIndex index(file);
+    if (!index.Map(false) ||
+        !index.ForEachDictionaryWord([&](const string& word,
+                                         uint32_t num_docs) {
+          words->push_back(word);
+          tickets->push_back((tickets->empty() ? 0 : tickets->back()) +
+                             (options.uniform_terms ? 1 : num_docs));
+        })) {
+      *error = "couldn't read " + file;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LoadGenerator::Prepare(string* const error) {
+  double* weights = options_.weights;
+
+  // Sort the static files by size.
+  vector<string> files[kNumLoadKinds];
+  if (weights[kSmall] + weights[kMedium] + weights[kLarge] > 0) {
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(options_.docroot, ec);
+    for (; !ec && it != std::filesystem::end(it); it.increment(ec)) {
+      if (!it->is_regular_file()) {
+        continue;
+      }
+      uintmax_t size = it->file_size();
+      LoadKind kind = size <= kSmallFileBytes ? kSmall :
+                      size <= kMediumFileBytes ? kMedium : kLarge;
+      files[kind].push_back(StaticUri(
+          std::filesystem::relative(it->path(), options_.docroot)));
+    }
+    // Directory order isn't stable; sort, so the requests are.
+    for (vector<string>& uris : files) {
+      std::sort(uris.begin(), uris.end());
+    }
+  }
+  for (LoadKind kind : {kSmall, kMedium, kLarge}) {
+    if (weights[kind] > 0 && files[kind].empty()) {
+      if (!options_.drop_unavailable_kinds) {
+        *error = string("no ") + kKindNames[kind] + " files under \"" +
+                 options_.docroot + "\"";
+        return false;
+      }
+      weights[kind] = 0;
+    }
+  }
+
+  vector<string> words;
+  vector<uint64_t> tickets;
+  if (weights[kQuery] + weights[kApi] > 0) {
+    if (!ReadVocabulary(options_, &words, &tickets, error)) {
+      return false;
+    }
+    if (words.empty() || tickets.back() == 0) {
+      if (!options_.drop_unavailable_kinds) {
+        *error = "query and api requests need words from index files";
+        return false;
+      }
+      weights[kQuery] = weights[kApi] = 0;
+    }
+  }
+  if (std::all_of(weights, weights + kNumLoadKinds,
+                  [](double w) { return w == 0; })) {
+    *error = "nothing in the mix can be generated";
+    return false;
+  }
+
+  // Use a fixed seed, so runs are comparable.
+  std::mt19937_64 rng(333);
+  std::discrete_distribution<int> kind_dist(weights, weights + kNumLoadKinds);
+  std::uniform_int_distribution<uint64_t> ticket(
+      0, tickets.empty() ? 0 : tickets.back() - 1);
+  std::uniform_int_distribution<size_t> length(1, options_.max_terms);
+  string connection = options_.close ? "Connection: close\r\n" : "";
+  requests_.clear();
+  for (size_t i = 0; i < kNumRequests; i++) {
+    LoadKind kind = static_cast<LoadKind>(kind_dist(rng));
+    string uri;
+    if (kind == kSmall || kind == kMedium || kind == kLarge) {
+      uri = files[kind][rng() % files[kind].size()];
+    } else if (kind == kMissing) {
+      uri = "/static/no-such-file-" + std::to_string(rng() % 1000);
+    } else {
+      string terms;
+      for (size_t n = length(rng); n > 0; n--) {
+        size_t w = std::upper_bound(tickets.begin(), tickets.end(),
+                                    ticket(rng)) - tickets.begin();
+        terms += (terms.empty() ? "" : "+") + URIEncode(words[w]);
+      }
+      uri = kind == kQuery ? "/query?terms=" + terms :
+            "/api/query?terms=" + terms + "&n=" + std::to_string(kApiResults);
+    }
+    requests_.push_back(Request{kind, "GET " + uri + " HTTP/1.1\r\n"
+                                "Host: " + options_.host + "\r\n" +
+                                connection + "\r\n"});
+  }
+  return true;
+}
+
+// Returns the "q"-quantile of "sorted", in microseconds.
+static double QuantileMicros(const vector<uint64_t>& sorted, double q) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[static_cast<size_t>(q * (sorted.size() - 1))] / 1e3;
+}
+
+LoadResult SummarizeLoad(const string& kind,
+                         vector<uint64_t>* const latencies,
+                         uint64_t bytes, uint64_t errors, double seconds) {
+  std::sort(latencies->begin(), latencies->end());
+  LoadResult result;
+  result.kind = kind;
+  result.requests = latencies->size();
+  result.errors = errors;
+  result.requests_per_second = latencies->size() / seconds;
+  result.mib_per_second = bytes / seconds / 1048576.0;
+  result.p50_us = QuantileMicros(*latencies, 0.5);
+  result.p99_us = QuantileMicros(*latencies, 0.99);
+  result.p999_us = QuantileMicros(*latencies, 0.999);
+  return result;
+}
+
+bool LoadGenerator::Run(vector<LoadResult>* const results) {
+  // Make sure the server is there before starting the clock.
+  int fd;
+  if (requests_.empty() ||
+      !ConnectToServer(options_.host, options_.port, &fd)) {
+    return false;
+  }
+  close(fd);
+
+  uint64_t start = MonotonicNanos();
+  vector<Worker> workers(options_.connections);
+  vector<pthread_t> threads(options_.connections);
+  int started = 0;
+  for (; started < options_.connections; started++) {
+    Worker* worker = &workers[started];
+    worker->generator = this;
+    worker->first_request =
+      started * requests_.size() / options_.connections;
+    worker->measure_start_ns = start + options_.warmup * 1e9;
+    worker->end_ns = worker->measure_start_ns + options_.seconds * 1e9;
+    if (pthread_create(&threads[started], nullptr, &RunWorker, worker) != 0) {
+      break;
+    }
+  }
+
+  Measurements total;
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], nullptr);
+    const Measurements& m = workers[i].measurements;
+    for (int k = 0; k < kNumLoadKinds; k++) {
+      total.latencies_ns[k].insert(total.latencies_ns[k].end(),
+                                   m.latencies_ns[k].begin(),
+                                   m.latencies_ns[k].end());
+      total.bytes[k] += m.bytes[k];
+      total.errors[k] += m.errors[k];
+    }
+  }
+  if (started == 0) {
+    return false;
+  }
+
+  results->clear();
+  vector<uint64_t> all;
+  uint64_t all_bytes = 0, all_errors = 0;
+  for (int k = 0; k < kNumLoadKinds; k++) {
+    if (options_.weights[k] == 0) {
+      continue;
+    }
+    all.insert(all.end(), total.latencies_ns[k].begin(),
+               total.latencies_ns[k].end());
+    all_bytes += total.bytes[k];
+    all_errors += total.errors[k];
+    results->push_back(SummarizeLoad(kKindNames[k], &total.latencies_ns[k],
+                                     total.bytes[k], total.errors[k],
+                                     options_.seconds));
+  }
+  results->push_back(SummarizeLoad("all", &all, all_bytes, all_errors,
+                                   options_.seconds));
+  return true;
+}
+
+// static
+void* LoadGenerator::RunWorker(void* arg) {
+  Worker* worker = static_cast<Worker*>(arg);
+  const LoadOptions& options = worker->generator->options_;
+  const vector<Request>& requests = worker->generator->requests_;
+  Measurements* m = &worker->measurements;
+  size_t next = worker->first_request;
+
+  // The requests in flight, oldest first, with when each was sent.
+  struct InFlight {
+    const Request* request;
+    uint64_t sent_ns;
+  };
+  vector<InFlight> in_flight;
+  string buffer;
+  int fd = -1;
+  uint64_t connect_ns = 0;
+
+  while (true) {
+    // Connect if need be, and top up the pipeline.
+    uint64_t now = MonotonicNanos();
+    if (fd == -1) {
+      if (now >= worker->end_ns) {
+        break;
+      }
+      connect_ns = now;
+      if (!ConnectToServer(options.host, options.port, &fd)) {
+        m->errors[requests[next].kind]++;
+        usleep(10000);
+        fd = -1;
+        continue;
+      }
+      buffer.clear();
+    }
+    while (static_cast<int>(in_flight.size()) < options.pipeline &&
+           now < worker->end_ns) {
+      const Request& request = requests[next];
+      next = (next + 1) % requests.size();
+      if (WrappedWrite(fd, reinterpret_cast<const unsigned char*>(
+                           request.text.data()),
+                       request.text.size()) !=
+          static_cast<int>(request.text.size())) {
+        break;
+      }
+      // With a connection per request, connecting is part of the wait.
+      in_flight.push_back(InFlight{&request,
+                                   options.close ? connect_ns : now});
+    }
+    if (in_flight.empty()) {
+      break;
+    }
+
+    // Collect the oldest response.
+    InFlight oldest = in_flight.front();
+    in_flight.erase(in_flight.begin());
+    int status;
+    uint64_t bytes;
+    bool ok = ReadResponse(fd, &buffer, &status, &bytes);
+    now = MonotonicNanos();
+    LoadKind kind = oldest.request->kind;
+    if (now >= worker->measure_start_ns && now < worker->end_ns) {
+      if (!ok || status != (kind == kMissing ? 404 : 200)) {
+        m->errors[kind]++;
+      } else {
+        m->latencies_ns[kind].push_back(now - oldest.sent_ns);
+        m->bytes[kind] += bytes;
+      }
+    }
+
+    // Start over on a fresh connection if this one is done with.
+    if (!ok || options.close) {
+      close(fd);
+      fd = -1;
+      if (!ok) {
+        for (const InFlight& lost : in_flight) {
+          m->errors[lost.request->kind]++;
+        }
+      }
+      in_flight.clear();
+    }
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  return nullptr;
+}
+
+// static
+bool LoadGenerator::ReadResponse(int fd, string* const buffer,
+                                 int* const status, uint64_t* const bytes) {
+  size_t header_end = 0;
+  size_t body_length = 0;
+  bool have_header = false;
+  while (true) {
+    if (!have_header) {
+      header_end = buffer->find("\r\n\r\n");
+      if (header_end != string::npos) {
+        header_end += 4;
+        // "HTTP/1.1 200 OK", then the headers.
+        size_t space = buffer->find(' ');
+        if (space == string::npos || space > header_end) {
+          return false;
+        }
+        *status = atoi(buffer->c_str() + space + 1);
+        string header = buffer->substr(0, header_end);
+        std::transform(header.begin(), header.end(), header.begin(),
+                       ::tolower);
+        size_t length = header.find("\r\ncontent-length:");
+        if (length == string::npos) {
+          return false;
+        }
+        body_length = strtoull(header.c_str() + length + 17, nullptr, 10);
+        have_header = true;
+      }
+    }
+    if (have_header && buffer->size() >= header_end + body_length) {
+      *bytes = header_end + body_length;
+      buffer->erase(0, header_end + body_length);
+      return true;
+    }
+
+    unsigned char chunk[64 * 1024];
+    int res = WrappedRead(fd, chunk, sizeof(chunk));
+    if (res <= 0) {
+      return false;
+    }
+    buffer->append(reinterpret_cast<char*>(chunk), res);
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,144 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_LOADGENERATOR_H_
+#define HW4_LOADGENERATOR_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace hw4 {
+
+// The kinds of request a LoadGenerator sends:
+//
+//   small, medium, large  a static file of at most 4 KiB, at most 64 KiB,
+//                         or more, picked from the files under the
+//                         document root
+//   missing               a static file that doesn't exist (a 404)
+//   query                 a search results page, /query?terms=...
+//   api                   the same search's results as JSON, /api/query
+enum LoadKind { kSmall, kMedium, kLarge, kMissing, kQuery, kApi,
+                kNumLoadKinds };
+
+// Returns the name of "kind", e.g. "small".
+const char* LoadKindName(int kind);
+
+struct LoadOptions {
+  std::string host = "localhost";
+  uint16_t port = 0;
+  double seconds = 5;  // how long to measure for
+  double warmup = 1;   // after sending for this long unmeasured
+  int connections = 8;
+  int pipeline = 1;    // requests in flight on each connection
+  bool close = false;  // a new connection for every request
+  std::string docroot;
+  std::vector<std::string> index_files;
+  bool uniform_terms = false;  // else weighted by document frequency
+  size_t max_terms = 3;
+
+  // How often to send each kind of request, relative to the others.
+  std::string mix = "query:1";
+  double weights[kNumLoadKinds] = {};
+
+  // If true, kinds that can't be generated (e.g. "large", when there are
+  // no large files) are dropped from the mix rather than an error.
+  bool drop_unavailable_kinds = false;
+};
+
+// Fills in options->weights from options->mix, a comma-separated list of
+// "kind:weight" (or just "kind", for a weight of 1).  Returns false if it
+// is malformed.
+bool ParseLoadMix(LoadOptions* const options);
+
+// What was measured for one kind of request, or for all of them (kind
+// "all").
+struct LoadResult {
+  std::string kind;
+  uint64_t requests;  // answered as expected within the measured window
+  uint64_t errors;    // answered wrongly, or lost with their connection
+  double requests_per_second;
+  double mib_per_second;
+  double p50_us, p99_us, p999_us;
+};
+
+// Appends "results" to "out" as a JSON array, one result per line, with
+// keys in a fixed order so that two runs can be diffed.
+void AppendLoadResultsJson(const std::vector<LoadResult>& results,
+                           std::string* const out);
+
+// Reads back the results AppendLoadResultsJson() wrote, from anywhere in
+// "json" (e.g. within a larger report).  Returns false if there are none.
+bool ReadLoadResultsJson(const std::string& json,
+                         std::vector<LoadResult>* const results);
+
+// Summarizes the "latencies_ns" of the requests of one kind, which it
+// sorts, and the "bytes" and "errors" they came to, over "seconds".
+LoadResult SummarizeLoad(const std::string& kind,
+                         std::vector<uint64_t>* const latencies_ns,
+                         uint64_t bytes, uint64_t errors, double seconds);
+
+// A LoadGenerator drives a running http333d with a mix of requests from a
+// number of connections at once, and measures how many it answers per
+// second and how long they take, for each kind of request.
+//
+// Each connection is a thread that sends a request, waits for the
+// response, and sends the next, keeping up to options.pipeline requests
+// in flight.  With options.close, every request gets a connection of its
+// own, and its latency includes connecting.  Prepare() generates the
+// requests up front, from a fixed seed, so runs against two servers, or
+// two builds, send the same ones; the words of a query are drawn from
+// the vocabulary of the index files.
+class LoadGenerator {
+ public:
+  // The constructor just memorizes its argument.
+  explicit LoadGenerator(const LoadOptions& options);
+  virtual ~LoadGenerator();
+
+  // Generates the requests.  Returns false, and explains why in "error",
+  // if some kind in the mix can't be generated.
+  bool Prepare(std::string* const error);
+
+  // Runs the load against options.port and returns a result for each
+  // kind in the mix, then one for "all".  Returns false if the server
+  // can't be reached at all.
+  bool Run(std::vector<LoadResult>* const results);
+
+  // Points the load at another server, with the same requests.
+  void set_port(uint16_t port) { options_.port = port; }
+
+  // The options, with any kinds Prepare() dropped taken out of the mix.
+  const LoadOptions& options() const { return options_; }
+
+  // Reads one response from "fd" into "buffer", which may already hold
+  // some of it, and removes it from there.  Returns its status code and
+  // its size through "status" and "bytes".  Returns false if the
+  // connection fails or the response is malformed.
+  static bool ReadResponse(int fd, std::string* const buffer,
+                           int* const status, uint64_t* const bytes);
+
+ private:
+  struct Request {
+    LoadKind kind;
+    std::string text;  // the whole request, headers and all
+  };
+  struct Worker;
+
+  // The body of a connection thread; "arg" is its Worker.
+  static void* RunWorker(void* arg);
+
+  LoadOptions options_;
+  std::vector<Request> requests_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_LOADGENERATOR_H_
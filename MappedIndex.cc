@@ -0,0 +1,417 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>   // for ntohl(), ntohs()
+#include <errno.h>       // for errno
+#include <fcntl.h>       // for open()
+#include <string.h>      // for memcpy(), memcmp(), strerror()
+#include <sys/mman.h>    // for mmap(), madvise(), mlock()
+#include <sys/stat.h>    // for fstat()
+#include <unistd.h>      // for close(), sysconf()
+#include <algorithm>     // for std::sort()
+#include <iostream>      // for std::cerr
+
+#include "./MappedIndex.h"
+
+extern "C" {
+  #include "libhw1/HashTable.h"  // for FNVHash64()
+}
+
+using std::cerr;
+using std::endl;
+using std::function;
+using std::sort;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+///////////////////////////////////////////////////////////////////////////////
+// On-disk layout
+///////////////////////////////////////////////////////////////////////////////
+// An index file is an IndexFileHeader, followed by the doctable, followed
+// by the word hash table:
+//
+//   [magic_number][checksum][doctable_bytes][index_bytes]  (4 bytes each)
+//   [doctable: a hash table of DoctableElements, keyed by doc_id]
+//   [index: a hash table of WordPostings, keyed by FNVHash64(word)]
+//
+// Each hash table is a BucketListHeader (num_buckets), an array of
+// BucketRecords (chain_num_elements, position), and then the buckets.
+// A bucket is an array of ElementPositionRecords (position) pointing at
+// the bucket's elements.  Every position is an absolute file offset,
+// every integer is in network byte order, and nothing is padded.
+//
+// A WordPostings element is a WordPostingsHeader (word_bytes,
+// postings_bytes), the word, and then the word's posting table: another
+// hash table, keyed by doc_id, of DocIDElements (doc_id, num_positions,
+// then num_positions word positions).
+static const uint32_t kMagicNumber = 0xCAFEF00D;
+static const off_t kIndexFileHeaderLen = 16;
+static const off_t kBucketListHeaderLen = 4;
+static const off_t kBucketRecordLen = 8;
+static const off_t kElementPositionRecordLen = 4;
+static const off_t kDoctableElementHeaderLen = 10;
+static const off_t kWordPostingsHeaderLen = 6;
+
+static uint64_t NetworkToHost64(uint64_t x) {
+  return (static_cast<uint64_t>(ntohl(static_cast<uint32_t>(x))) << 32) |
+         ntohl(static_cast<uint32_t>(x >> 32));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MappedIndex
+///////////////////////////////////////////////////////////////////////////////
+MappedIndex::MappedIndex(const string& file_name)
+  : file_name_(file_name), base_(nullptr), length_(0),
+    doctable_offset_(0), index_offset_(0), device_(0), inode_(0),
+    mtime_{0, 0} { }
+
+MappedIndex::~MappedIndex() {
+  Unmap();
+}
+
+void MappedIndex::Unmap() {
+  if (base_ != nullptr) {
+    munmap(const_cast<unsigned char*>(base_), length_);
+  }
+  base_ = nullptr;
+}
+
+bool MappedIndex::Map(bool preload) {
+  int fd = open(file_name_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    cerr << "Couldn't open index " << file_name_ << ": "
+         << strerror(errno) << endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < kIndexFileHeaderLen) {
+    cerr << file_name_ << " is too short to be an index" << endl;
+    close(fd);
+    return false;
+  }
+
+  device_ = st.st_dev;
+  inode_ = st.st_ino;
+  mtime_ = st.st_mtim;
+
+  int flags = MAP_SHARED;
+  if (preload) {
+    flags |= MAP_POPULATE;
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if (addr == MAP_FAILED) {
+    cerr << "Couldn't map index " << file_name_ << ": "
+         << strerror(errno) << endl;
+    return false;
+  }
+  base_ = static_cast<const unsigned char*>(addr);
+  length_ = st.st_size;
+
+  // Check the header the same way hw3's FileIndexReader does.
+  int32_t magic, doctable_bytes, index_bytes;
+  if (!ReadInt32(0, &magic) ||
+      static_cast<uint32_t>(magic) != kMagicNumber ||
+      !ReadInt32(8, &doctable_bytes) || !ReadInt32(12, &index_bytes) ||
+      doctable_bytes < 0 || index_bytes < 0 ||
+      static_cast<off_t>(length_) !=
+        kIndexFileHeaderLen + doctable_bytes + index_bytes) {
+    cerr << file_name_ << " is not a valid index file" << endl;
+    return false;
+  }
+  doctable_offset_ = kIndexFileHeaderLen;
+  index_offset_ = kIndexFileHeaderLen + doctable_bytes;
+
+  // Tell the kernel how we're going to use each part of the file.  madvise
+  // needs a page-aligned start, so round down; the regions may share a
+  // page, which is harmless.
+  uintptr_t page_mask = ~(static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1);
+  uintptr_t doctable_start =
+    reinterpret_cast<uintptr_t>(base_ + doctable_offset_) & page_mask;
+  uintptr_t index_start =
+    reinterpret_cast<uintptr_t>(base_ + index_offset_) & page_mask;
+  madvise(reinterpret_cast<void*>(doctable_start),
+          reinterpret_cast<uintptr_t>(base_ + index_offset_) - doctable_start,
+          MADV_RANDOM);
+  madvise(reinterpret_cast<void*>(index_start),
+          reinterpret_cast<uintptr_t>(base_ + length_) - index_start,
+          MADV_WILLNEED);
+
+  if (preload && mlock(base_, length_) == -1) {
+    cerr << "  warning: couldn't lock " << file_name_ << " in memory: "
+         << strerror(errno) << endl;
+  }
+  return true;
+}
+
+bool MappedIndex::Changed() const {
+  struct stat st;
+  if (stat(file_name_.c_str(), &st) == -1) {
+    // It's gone (perhaps mid-replacement); keep using what we have.
+    return false;
+  }
+  return st.st_dev != device_ || st.st_ino != inode_ ||
+         static_cast<size_t>(st.st_size) != length_ ||
+         st.st_mtim.tv_sec != mtime_.tv_sec ||
+         st.st_mtim.tv_nsec != mtime_.tv_nsec;
+}
+
+bool MappedIndex::LookupWord(const string& word,
+                             vector<Posting>* const postings) const {
+  if (base_ == nullptr) {
+    return false;
+  }
+  HTKey_t key =
+    FNVHash64(reinterpret_cast<unsigned char*>(const_cast<char*>(word.data())),
+              word.length());
+  int32_t num_elements;
+  off_t position;
+  if (!LookupBucket(index_offset_, key, &num_elements, &position)) {
+    return false;
+  }
+
+  // Walk the chain, looking for an element whose word matches ours.
+  for (int32_t i = 0; i < num_elements; i++) {
+    int32_t element;
+    int16_t word_bytes;
+    if (!ReadInt32(position + i * kElementPositionRecordLen, &element) ||
+        !ReadInt16(element, &word_bytes)) {
+      return false;
+    }
+    off_t word_offset = element + kWordPostingsHeaderLen;
+    if (static_cast<size_t>(word_bytes) != word.length() ||
+        word_offset + word_bytes > static_cast<off_t>(length_) ||
+        memcmp(base_ + word_offset, word.data(), word_bytes) != 0) {
+      continue;
+    }
+
+    // Found it; the posting table follows the word.
+    if (!ReadPostings(word_offset + word_bytes, postings)) {
+      return false;
+    }
+    sort(postings->begin(), postings->end(),
+         [](const Posting& a, const Posting& b) {
+           return a.doc_id < b.doc_id;
+         });
+    return true;
+  }
+  return false;
+}
+
+bool MappedIndex::ForEachDocument(
+    const function<void(uint64_t, const string&)>& fn) const {
+  if (base_ == nullptr) {
+    return false;
+  }
+  string name;
+  return ForEachElement(doctable_offset_, [this, &fn, &name](off_t e) {
+      uint64_t doc_id;
+      int16_t name_bytes;
+      if (!ReadUInt64(e, &doc_id) || !ReadInt16(e + 8, &name_bytes) ||
+          name_bytes < 0 ||
+          e + kDoctableElementHeaderLen + name_bytes >
+            static_cast<off_t>(length_)) {
+        return false;
+      }
+      name.assign(
+          reinterpret_cast<const char*>(base_ + e + kDoctableElementHeaderLen),
+          name_bytes);
+      fn(doc_id, name);
+      return true;
+    });
+}
+
+bool MappedIndex::ForEachWord(
+    const function<void(const string&, const vector<Posting>&)>& fn) const {
+  if (base_ == nullptr) {
+    return false;
+  }
+  string word;
+  vector<Posting> postings;
+  return ForEachElement(index_offset_,
+                        [this, &fn, &word, &postings](off_t e) {
+      int16_t word_bytes;
+      off_t word_offset = e + kWordPostingsHeaderLen;
+      if (!ReadInt16(e, &word_bytes) || word_bytes < 0 ||
+          word_offset + word_bytes > static_cast<off_t>(length_)) {
+        return false;
+      }
+      word.assign(reinterpret_cast<const char*>(base_ + word_offset),
+                  word_bytes);
+      if (!ReadPostings(word_offset + word_bytes, &postings)) {
+        return false;
+      }
+      fn(word, postings);
+      return true;
+    });
+}
+
+bool MappedIndex::ForEachDictionaryWord(
+    const function<void(const string&, uint32_t)>& fn) const {
+  if (base_ == nullptr) {
+    return false;
+  }
+  string word;
+  return ForEachElement(index_offset_, [this, &fn, &word](off_t e) {
+      int16_t word_bytes;
+      off_t word_offset = e + kWordPostingsHeaderLen;
+      uint32_t num_docs;
+      if (!ReadInt16(e, &word_bytes) || word_bytes < 0 ||
+          word_offset + word_bytes > static_cast<off_t>(length_) ||
+          !CountElements(word_offset + word_bytes, &num_docs)) {
+        return false;
+      }
+      word.assign(reinterpret_cast<const char*>(base_ + word_offset),
+                  word_bytes);
+      fn(word, num_docs);
+      return true;
+    });
+}
+
+bool MappedIndex::LookupDocID(uint64_t doc_id, string* const doc_name) const {
+  if (base_ == nullptr) {
+    return false;
+  }
+  int32_t num_elements;
+  off_t position;
+  if (!LookupBucket(doctable_offset_, doc_id, &num_elements, &position)) {
+    return false;
+  }
+
+  for (int32_t i = 0; i < num_elements; i++) {
+    int32_t element;
+    uint64_t id;
+    int16_t name_bytes;
+    if (!ReadInt32(position + i * kElementPositionRecordLen, &element) ||
+        !ReadUInt64(element, &id) || !ReadInt16(element + 8, &name_bytes)) {
+      return false;
+    }
+    if (id != doc_id) {
+      continue;
+    }
+    off_t name_offset = element + kDoctableElementHeaderLen;
+    if (name_bytes < 0 ||
+        name_offset + name_bytes > static_cast<off_t>(length_)) {
+      return false;
+    }
+    doc_name->assign(reinterpret_cast<const char*>(base_ + name_offset),
+                     name_bytes);
+    return true;
+  }
+  return false;
+}
+
+bool MappedIndex::LookupBucket(off_t table_offset, uint64_t key,
+                               int32_t* const num_elements,
+                               off_t* const first_position) const {
+  int32_t num_buckets, position;
+  if (!ReadInt32(table_offset, &num_buckets) || num_buckets <= 0) {
+    return false;
+  }
+  off_t bucket = table_offset + kBucketListHeaderLen +
+                 (key % num_buckets) * kBucketRecordLen;
+  if (!ReadInt32(bucket, num_elements) || !ReadInt32(bucket + 4, &position)) {
+    return false;
+  }
+  *first_position = position;
+  return true;
+}
+
+bool MappedIndex::ReadPostings(off_t table_offset,
+                               vector<Posting>* const postings) const {
+  postings->clear();
+  return ForEachElement(table_offset, [this, postings](off_t e) {
+      Posting p;
+      if (!ReadUInt64(e, &p.doc_id) || !ReadInt32(e + 8, &p.num_positions)) {
+        return false;
+      }
+      postings->push_back(p);
+      return true;
+    });
+}
+
+bool MappedIndex::CountElements(off_t table_offset,
+                                uint32_t* const num_elements) const {
+  int32_t num_buckets;
+  if (!ReadInt32(table_offset, &num_buckets) || num_buckets < 0) {
+    return false;
+  }
+  *num_elements = 0;
+  for (int32_t b = 0; b < num_buckets; b++) {
+    int32_t chain_length;
+    if (!ReadInt32(table_offset + kBucketListHeaderLen + b * kBucketRecordLen,
+                   &chain_length) || chain_length < 0) {
+      return false;
+    }
+    *num_elements += chain_length;
+  }
+  return true;
+}
+
+template <typename Fn>
+bool MappedIndex::ForEachElement(off_t table_offset, Fn fn) const {
+  int32_t num_buckets;
+  if (!ReadInt32(table_offset, &num_buckets) || num_buckets < 0) {
+    return false;
+  }
+  for (int32_t b = 0; b < num_buckets; b++) {
+    off_t bucket = table_offset + kBucketListHeaderLen + b * kBucketRecordLen;
+    int32_t num_elements, position;
+    if (!ReadInt32(bucket, &num_elements) ||
+        !ReadInt32(bucket + 4, &position)) {
+      return false;
+    }
+    for (int32_t i = 0; i < num_elements; i++) {
+      int32_t element;
+      if (!ReadInt32(position + i * kElementPositionRecordLen, &element) ||
+          !fn(static_cast<off_t>(element))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool MappedIndex::ReadInt16(off_t offset, int16_t* const value) const {
+  uint16_t raw;
+  if (offset < 0 || offset + 2 > static_cast<off_t>(length_)) {
+    return false;
+  }
+  memcpy(&raw, base_ + offset, sizeof(raw));
+  *value = static_cast<int16_t>(ntohs(raw));
+  return true;
+}
+
+bool MappedIndex::ReadInt32(off_t offset, int32_t* const value) const {
+  uint32_t raw;
+  if (offset < 0 || offset + 4 > static_cast<off_t>(length_)) {
+    return false;
+  }
+  memcpy(&raw, base_ + offset, sizeof(raw));
+  *value = static_cast<int32_t>(ntohl(raw));
+  return true;
+}
+
+bool MappedIndex::ReadUInt64(off_t offset, uint64_t* const value) const {
+  uint64_t raw;
+  if (offset < 0 || offset + 8 > static_cast<off_t>(length_)) {
+    return false;
+  }
+  memcpy(&raw, base_ + offset, sizeof(raw));
+  *value = NetworkToHost64(raw);
+  return true;
+}
+
+}  // namespace hw4
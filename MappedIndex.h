@@ -0,0 +1,156 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_MAPPEDINDEX_H_
+#define HW4_MAPPEDINDEX_H_
+
+#include <stdint.h>     // for uint64_t, etc.
+#include <sys/types.h>  // for off_t, dev_t, ino_t
+#include <time.h>       // for struct timespec
+#include <functional>   // for std::function
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+
+namespace hw4 {
+
+// A MappedIndex gives read-only access to one on-disk index file (the
+// ".idx" files that hw3's buildfileindex writes) by mapping the whole
+// file into memory with mmap().  Lookups walk the on-disk hash tables in
+// place, so they never issue a read() system call, and every worker
+// thread can share the same MappedIndex -- and the same copy of the file
+// in the page cache -- without any locking.
+class MappedIndex {
+ public:
+  // One entry in a word's posting list: a document the word appears in,
+  // and the number of times it appears there.
+  struct Posting {
+    uint64_t doc_id;
+    int32_t num_positions;
+  };
+
+  // The constructor just memorizes the name of the index file; call
+  // Map() to actually open it.
+  explicit MappedIndex(const std::string& file_name);
+
+  // The destructor unmaps the file if it is mapped.
+  virtual ~MappedIndex();
+
+  // Opens the index file, checks its header, and maps it read-only.  The
+  // word hash table is advised MADV_WILLNEED, since every query probes
+  // it, and the doctable MADV_RANDOM, since we only ever touch a handful
+  // of its entries per query.
+  //
+  // If "preload" is true, the mapping is pre-faulted (MAP_POPULATE) and
+  // we try to mlock() it so that queries never take a page fault on the
+  // index.  Failing to lock the pages (e.g., because of RLIMIT_MEMLOCK)
+  // is reported but isn't fatal.
+  //
+  // Returns false if the file could not be opened, mapped, or does not
+  // look like an index file.
+  bool Map(bool preload);
+
+  // Unmaps the file.  The MappedIndex can't be searched afterwards, but
+  // Changed() still works; MemoryIndex uses this to drop the mapping once
+  // it has copied everything out of it.
+  void Unmap();
+
+  // Looks up "word" in the index.  If it is present, returns true and
+  // fills "postings" with the documents that contain it, sorted by
+  // document ID.  Returns false if the word isn't in the index.
+  bool LookupWord(const std::string& word,
+                  std::vector<Posting>* const postings) const;
+
+  // Looks up the name of the document with ID "doc_id".  Returns true and
+  // sets "doc_name" on success, false if there is no such document.
+  bool LookupDocID(uint64_t doc_id, std::string* const doc_name) const;
+
+  // Calls "fn(doc_id, doc_name)" for every document in the doctable, in
+  // no particular order.  Returns false if the doctable is malformed.
+  bool ForEachDocument(
+      const std::function<void(uint64_t, const std::string&)>& fn) const;
+
+  // Calls "fn(word, postings)" for every word in the index, in no
+  // particular order; the postings are unsorted.  Returns false if the
+  // index is malformed.
+  bool ForEachWord(
+      const std::function<void(const std::string&,
+                               const std::vector<Posting>&)>& fn) const;
+
+  // Calls "fn(word, num_docs)" for every word in the index, in no
+  // particular order, where "num_docs" is the number of documents that
+  // contain the word.  This is much cheaper than ForEachWord(), since it
+  // doesn't read the posting lists themselves.  Returns false if the
+  // index is malformed.
+  bool ForEachDictionaryWord(
+      const std::function<void(const std::string&, uint32_t)>& fn) const;
+
+  // Returns true if the file on disk is no longer the one we mapped: it
+  // was replaced, or its size or modification time changed.
+  bool Changed() const;
+
+  const std::string& file_name() const { return file_name_; }
+
+  // The size of the index file, which is also the size of the mapping.
+  size_t length() const { return length_; }
+
+ private:
+  // Finds the bucket that "key" hashes to in the hash table starting at
+  // "table_offset".  Returns (via output parameters) the number of
+  // elements chained in the bucket and the offset of its first element
+  // position record.  Returns false if the table is malformed.
+  bool LookupBucket(off_t table_offset, uint64_t key,
+                    int32_t* const num_elements,
+                    off_t* const first_position) const;
+
+  // Reads the posting table that starts at "table_offset" into
+  // "postings", in table order.  Returns false if it is malformed.
+  bool ReadPostings(off_t table_offset,
+                    std::vector<Posting>* const postings) const;
+
+  // Sets "num_elements" to the number of elements in the hash table that
+  // starts at "table_offset", without visiting them.  Returns false if
+  // the table is malformed.
+  bool CountElements(off_t table_offset, uint32_t* const num_elements) const;
+
+  // Calls "fn(element_offset)" for every element of the hash table that
+  // starts at "table_offset".  Returns false if the table is malformed.
+  template <typename Fn>
+  bool ForEachElement(off_t table_offset, Fn fn) const;
+
+  // Accessors that decode a big-endian integer at "offset", after
+  // checking that it lies entirely within the mapping.
+  bool ReadInt16(off_t offset, int16_t* const value) const;
+  bool ReadInt32(off_t offset, int32_t* const value) const;
+  bool ReadUInt64(off_t offset, uint64_t* const value) const;
+
+  std::string file_name_;
+
+  // The mapping of the whole file, and its length.
+  const unsigned char* base_;
+  size_t length_;
+
+  // Where the doctable and the word hash table start in the file.
+  off_t doctable_offset_;
+  off_t index_offset_;
+
+  // The identity of the file we mapped, from fstat().
+  dev_t device_;
+  ino_t inode_;
+  struct timespec mtime_;
+
+  // MappedIndex objects own their mapping, so they can't be copied.
+  MappedIndex(const MappedIndex&) = delete;
+  MappedIndex& operator=(const MappedIndex&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_MAPPEDINDEX_H_
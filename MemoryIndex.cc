@@ -0,0 +1,472 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "./MemoryIndex.h"
+#include "./PostingIntersect.h"
+
+using std::function;
+using std::lower_bound;
+using std::max;
+using std::min;
+using std::pair;
+using std::pop_heap;
+using std::push_heap;
+using std::sort;
+using std::sort_heap;
+using std::upper_bound;
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace hw4 {
+
+// static
+const uint32_t MemoryIndex::kBlockSize;
+
+// Appends "value" to "out" as a varint: seven bits per byte, least
+// significant first, with the high bit set on every byte but the last.
+static void AppendVarint(uint32_t value, vector<uint8_t>* const out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+// Decodes the varint at "*p" and advances "*p" past it.
+static inline uint32_t ReadVarint(const uint8_t** const p) {
+  uint32_t value = 0;
+  int shift = 0;
+  uint8_t byte;
+  do {
+    byte = *(*p)++;
+    value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+bool MemoryIndex::Build(const MappedIndex& mapped) {
+  // Number the documents in ID order.
+  vector<pair<uint64_t, string>> docs;
+  if (!mapped.ForEachDocument([&docs](uint64_t doc_id, const string& name) {
+        docs.emplace_back(doc_id, name);
+      })) {
+    return false;
+  }
+  sort(docs.begin(), docs.end());
+
+  vector<uint64_t> doc_ids;
+  doc_ids.reserve(docs.size());
+  name_offsets_.reserve(docs.size() + 1);
+  for (const pair<uint64_t, string>& doc : docs) {
+    doc_ids.push_back(doc.first);
+    name_offsets_.push_back(names_.size());
+    names_ += doc.second;
+  }
+  name_offsets_.push_back(names_.size());
+  if (names_.size() > UINT32_MAX) {
+    return false;
+  }
+  docs.clear();
+  docs.shrink_to_fit();
+
+  // Encode every posting list, in whatever order the file gives us the
+  // words...
+  vector<Term> unsorted;
+  string unsorted_words;
+  vector<Block> unsorted_blocks;
+  vector<uint8_t> encoded;
+  vector<Posting> renumbered;
+  bool ok = mapped.ForEachWord(
+      [&](const string& word, const vector<MappedIndex::Posting>& postings) {
+        renumbered.clear();
+        for (const MappedIndex::Posting& p : postings) {
+          auto it = lower_bound(doc_ids.begin(), doc_ids.end(), p.doc_id);
+          if (it != doc_ids.end() && *it == p.doc_id) {
+            renumbered.push_back(
+                Posting{static_cast<uint32_t>(it - doc_ids.begin()),
+                        p.num_positions});
+          }
+        }
+        sort(renumbered.begin(), renumbered.end(),
+             [](const Posting& a, const Posting& b) {
+               return a.doc_id < b.doc_id;
+             });
+
+        Term term;
+        term.word_offset = unsorted_words.size();
+        term.word_length = word.size();
+        term.num_postings = renumbered.size();
+        term.first_block = unsorted_blocks.size();
+        term.max_positions = 0;
+        uint32_t previous = 0;
+        for (size_t i = 0; i < renumbered.size(); i += kBlockSize) {
+          size_t end = min<size_t>(i + kBlockSize, renumbered.size());
+          Block block;
+          block.offset = encoded.size();
+          block.last_doc = renumbered[end - 1].doc_id;
+          block.max_positions = 0;
+          for (size_t j = i; j < end; j++) {
+            AppendVarint(renumbered[j].doc_id - previous, &encoded);
+            previous = renumbered[j].doc_id;
+          }
+          for (size_t j = i; j < end; j++) {
+            AppendVarint(renumbered[j].num_positions, &encoded);
+            block.max_positions = max(block.max_positions,
+                                      renumbered[j].num_positions);
+          }
+          term.max_positions = max(term.max_positions, block.max_positions);
+          unsorted_blocks.push_back(block);
+        }
+        unsorted.push_back(term);
+        unsorted_words += word;
+      });
+  if (!ok || unsorted_words.size() > UINT32_MAX ||
+      unsorted_blocks.size() > UINT32_MAX) {
+    return false;
+  }
+
+  // ...then lay the dictionary and the posting lists out in word order,
+  // so that neighboring words' data is adjacent in memory.  A list's
+  // data runs from its first block's offset to the next list's.
+  sort(unsorted.begin(), unsorted.end(),
+       [&unsorted_words](const Term& a, const Term& b) {
+         return string_view(unsorted_words.data() + a.word_offset,
+                            a.word_length) <
+                string_view(unsorted_words.data() + b.word_offset,
+                            b.word_length);
+       });
+  terms_.reserve(unsorted.size());
+  words_.reserve(unsorted_words.size());
+  blocks_.reserve(unsorted_blocks.size());
+  postings_.reserve(encoded.size());
+  for (const Term& old_term : unsorted) {
+    Term term = old_term;
+    term.word_offset = words_.size();
+    words_.append(unsorted_words, old_term.word_offset, old_term.word_length);
+    term.first_block = blocks_.size();
+    terms_.push_back(term);
+
+    uint32_t num_blocks = (term.num_postings + kBlockSize - 1) / kBlockSize;
+    if (num_blocks == 0) {
+      continue;
+    }
+    uint32_t end_block = old_term.first_block + num_blocks;
+    uint64_t start = unsorted_blocks[old_term.first_block].offset;
+    uint64_t end = end_block < unsorted_blocks.size() ?
+        unsorted_blocks[end_block].offset : encoded.size();
+    for (uint32_t b = old_term.first_block; b < end_block; b++) {
+      Block block = unsorted_blocks[b];
+      block.offset = block.offset - start + postings_.size();
+      blocks_.push_back(block);
+    }
+    postings_.insert(postings_.end(), encoded.begin() + start,
+                     encoded.begin() + end);
+  }
+  return true;
+}
+
+const MemoryIndex::Term* MemoryIndex::FindTerm(const string& word) const {
+  auto it = lower_bound(terms_.begin(), terms_.end(), string_view(word),
+                        [this](const Term& term, string_view w) {
+                          return TermWord(term) < w;
+                        });
+  if (it == terms_.end() || TermWord(*it) != word) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+const uint8_t* MemoryIndex::DecodeDocIDs(const Term& term, uint32_t b,
+                                         uint32_t* const doc_ids) const {
+  // Each block's gaps pick up from the last document of the one before.
+  uint32_t doc_id = b == 0 ? 0 : blocks_[term.first_block + b - 1].last_doc;
+  const uint8_t* p = postings_.data() + blocks_[term.first_block + b].offset;
+  uint32_t n = BlockLength(term, b);
+  for (uint32_t i = 0; i < n; i++) {
+    doc_id += ReadVarint(&p);
+    doc_ids[i] = doc_id;
+  }
+  return p;
+}
+
+// static
+void MemoryIndex::DecodeCounts(const uint8_t* p, uint32_t n,
+                               int32_t* const counts) {
+  for (uint32_t i = 0; i < n; i++) {
+    counts[i] = ReadVarint(&p);
+  }
+}
+
+bool MemoryIndex::LookupWord(const string& word,
+                             vector<Posting>* const postings) const {
+  const Term* term = FindTerm(word);
+  if (term == nullptr) {
+    return false;
+  }
+
+  postings->resize(term->num_postings);
+  uint32_t doc_ids[kBlockSize];
+  int32_t counts[kBlockSize];
+  for (uint32_t b = 0; b * kBlockSize < term->num_postings; b++) {
+    uint32_t n = BlockLength(*term, b);
+    DecodeCounts(DecodeDocIDs(*term, b, doc_ids), n, counts);
+    Posting* out = postings->data() + b * kBlockSize;
+    for (uint32_t i = 0; i < n; i++) {
+      out[i].doc_id = doc_ids[i];
+      out[i].num_positions = counts[i];
+    }
+  }
+  return true;
+}
+
+void MemoryIndex::TopMatches(const vector<string>& query, size_t max_results,
+                             vector<Posting>* const top,
+                             size_t* const num_matches,
+                             size_t* const num_scored) const {
+  top->clear();
+  *num_matches = 0;
+  if (query.empty()) {
+    return;
+  }
+  vector<const Term*> terms;
+  for (const string& word : query) {
+    const Term* term = FindTerm(word);
+    if (term == nullptr) {
+      return;
+    }
+    terms.push_back(term);
+  }
+
+  // The rarest word leads: we walk its list a block at a time, and look
+  // for each block's documents in the other lists, rarest first, so the
+  // set of candidates shrinks as fast as it can.
+  sort(terms.begin(), terms.end(), [](const Term* a, const Term* b) {
+    return a->num_postings < b->num_postings;
+  });
+  const Term& lead = *terms[0];
+  uint32_t lead_blocks = (lead.num_postings + kBlockSize - 1) / kBlockSize;
+
+  // The best documents so far, as a heap with the worst of them on top.
+  // Documents arrive in increasing order, so a later document has to
+  // rank strictly higher than the worst one to displace it.
+  auto better = [](const Posting& a, const Posting& b) {
+    if (a.num_positions != b.num_positions) {
+      return a.num_positions > b.num_positions;
+    }
+    return a.doc_id < b.doc_id;
+  };
+  top->reserve(min<size_t>(max_results, lead.num_postings));
+  // With max_results 0 nothing can make the cut, but the matches are
+  // still counted.
+  auto cannot_beat = [top, max_results](int64_t bound) {
+    return top->size() == max_results &&
+           (top->empty() || bound <= top->front().num_positions);
+  };
+
+  // The most any document can get from the words other than the lead.
+  int64_t others_max = 0;
+  for (size_t t = 1; t < terms.size(); t++) {
+    others_max += terms[t]->max_positions;
+  }
+
+  // For each of the other words, the blocks of its list that hold the
+  // current candidates, decoded.  Their counts are only decoded if one
+  // of the candidates might make the top results.
+  struct Window {
+    uint32_t next_block;            // blocks before this are behind us
+    vector<uint32_t> blocks;        // which blocks are decoded...
+    vector<uint32_t> starts;        // ...and where each starts in doc_ids
+    vector<const uint8_t*> counts_data;
+    vector<bool> have_counts;
+    vector<uint32_t> doc_ids;
+    vector<int32_t> counts;
+  };
+  vector<Window> windows(terms.size());
+  for (Window& w : windows) {
+    w.next_block = 0;
+  }
+
+  // The current candidates, and for each word, where each candidate is
+  // in that word's window (or, for the lead, in its block).
+  uint32_t ids[kBlockSize];
+  int32_t lead_counts[kBlockSize];
+  vector<vector<uint32_t>> where(terms.size(), vector<uint32_t>(kBlockSize));
+  uint32_t in_ids[kBlockSize], in_window[kBlockSize];
+
+  for (uint32_t b0 = 0; b0 < lead_blocks; b0++) {
+    const Block& lead_block = blocks_[lead.first_block + b0];
+    uint32_t n = BlockLength(lead, b0);
+    bool block_can_score = !cannot_beat(lead_block.max_positions + others_max);
+
+    // With a single word every posting matches, so a block that can't
+    // make the cut needn't even be decoded.
+    if (terms.size() == 1 && !block_can_score) {
+      *num_matches += n;
+      continue;
+    }
+    const uint8_t* lead_counts_data = DecodeDocIDs(lead, b0, ids);
+    bool have_lead_counts = false;
+    size_t live = n;
+    for (uint32_t j = 0; j < n; j++) {
+      where[0][j] = j;
+    }
+
+    bool exhausted = false;
+    for (size_t t = 1; t < terms.size() && live > 0; t++) {
+      const Term& term = *terms[t];
+      Window& w = windows[t];
+      uint32_t num_blocks = (term.num_postings + kBlockSize - 1) / kBlockSize;
+
+      // Decode just the blocks that could hold a candidate, skipping the
+      // rest by their last document.
+      w.blocks.clear();
+      w.starts.clear();
+      w.counts_data.clear();
+      w.doc_ids.clear();
+      uint32_t k = w.next_block;
+      for (size_t j = 0; j < live; ) {
+        while (k < num_blocks &&
+               blocks_[term.first_block + k].last_doc < ids[j]) {
+          k++;
+        }
+        if (k == num_blocks) {
+          break;
+        }
+        size_t start = w.doc_ids.size();
+        w.blocks.push_back(k);
+        w.starts.push_back(start);
+        w.doc_ids.resize(start + BlockLength(term, k));
+        w.counts_data.push_back(DecodeDocIDs(term, k, &w.doc_ids[start]));
+        uint32_t last_doc = blocks_[term.first_block + k].last_doc;
+        while (j < live && ids[j] <= last_doc) {
+          j++;
+        }
+        k++;
+      }
+      if (w.blocks.empty()) {
+        // This word's list has nothing at or past our first candidate,
+        // so nothing from here on can match.
+        exhausted = true;
+        live = 0;
+        break;
+      }
+      // The last block we decoded may hold the next block's candidates.
+      w.next_block = w.blocks.back();
+      w.starts.push_back(w.doc_ids.size());
+      w.have_counts.assign(w.blocks.size(), false);
+      w.counts.resize(w.doc_ids.size());
+
+      size_t common = IntersectPostings(ids, live,
+                                        w.doc_ids.data(), w.doc_ids.size(),
+                                        in_ids, in_window);
+      for (size_t j = 0; j < common; j++) {
+        ids[j] = ids[in_ids[j]];
+        for (size_t s = 0; s < t; s++) {
+          where[s][j] = where[s][in_ids[j]];
+        }
+        where[t][j] = in_window[j];
+      }
+      live = common;
+    }
+    *num_matches += live;
+    if (exhausted) {
+      break;
+    }
+    if (live == 0 || !block_can_score) {
+      continue;
+    }
+
+    // Score the candidates, skipping any whose blocks' best counts can't
+    // add up to a place in the top results.
+    for (size_t j = 0; j < live; j++) {
+      int64_t bound = lead_block.max_positions;
+      for (size_t t = 1; t < terms.size(); t++) {
+        const Window& w = windows[t];
+        size_t wb = upper_bound(w.starts.begin(), w.starts.end(),
+                                     where[t][j]) - w.starts.begin() - 1;
+        bound += blocks_[terms[t]->first_block + w.blocks[wb]].max_positions;
+      }
+      if (cannot_beat(bound)) {
+        continue;
+      }
+
+      if (!have_lead_counts) {
+        DecodeCounts(lead_counts_data, n, lead_counts);
+        have_lead_counts = true;
+        if (num_scored != nullptr) {
+          *num_scored += n;
+        }
+      }
+      int64_t score = lead_counts[where[0][j]];
+      for (size_t t = 1; t < terms.size(); t++) {
+        Window& w = windows[t];
+        size_t wb = upper_bound(w.starts.begin(), w.starts.end(),
+                                     where[t][j]) - w.starts.begin() - 1;
+        if (!w.have_counts[wb]) {
+          uint32_t len = w.starts[wb + 1] - w.starts[wb];
+          DecodeCounts(w.counts_data[wb], len, &w.counts[w.starts[wb]]);
+          w.have_counts[wb] = true;
+          if (num_scored != nullptr) {
+            *num_scored += len;
+          }
+        }
+        score += w.counts[where[t][j]];
+      }
+
+      Posting candidate{ids[j], static_cast<int32_t>(score)};
+      if (top->size() < max_results) {
+        top->push_back(candidate);
+        push_heap(top->begin(), top->end(), better);
+      } else if (better(candidate, top->front())) {
+        pop_heap(top->begin(), top->end(), better);
+        top->back() = candidate;
+        push_heap(top->begin(), top->end(), better);
+      }
+    }
+  }
+  sort_heap(top->begin(), top->end(), better);
+}
+
+bool MemoryIndex::LookupDocID(uint32_t doc_id,
+                              string* const doc_name) const {
+  if (static_cast<size_t>(doc_id) + 1 >= name_offsets_.size()) {
+    return false;
+  }
+  doc_name->assign(names_, name_offsets_[doc_id],
+                   name_offsets_[doc_id + 1] - name_offsets_[doc_id]);
+  return true;
+}
+
+void MemoryIndex::ForEachWord(
+    const function<void(string_view, uint32_t)>& fn) const {
+  for (const Term& term : terms_) {
+    fn(TermWord(term), term.num_postings);
+  }
+}
+
+size_t MemoryIndex::MemoryBytes() const {
+  return sizeof(*this) + names_.capacity() +
+         name_offsets_.capacity() * sizeof(uint32_t) +
+         terms_.capacity() * sizeof(Term) + words_.capacity() +
+         blocks_.capacity() * sizeof(Block) + postings_.capacity();
+}
+
+}  // namespace hw4
@@ -0,0 +1,157 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_MEMORYINDEX_H_
+#define HW4_MEMORYINDEX_H_
+
+#include <stdint.h>     // for uint32_t, etc.
+#include <algorithm>    // for std::min
+#include <functional>   // for std::function
+#include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <vector>       // for std::vector
+
+#include "./MappedIndex.h"
+
+namespace hw4 {
+
+// A MemoryIndex is a compact, read-only, in-memory copy of an index file,
+// laid out for searching rather than for storage.  Where the file chains
+// hash table entries together through file offsets, a MemoryIndex keeps:
+//
+//  - the documents, renumbered 0..n-1 in document ID order, with their
+//    names packed into one string;
+//  - a dictionary of every word, sorted so it can be binary searched,
+//    with the words themselves packed into one string; and
+//  - each word's posting list, cut into blocks of kBlockSize postings.
+//    A block is a run of varint document number gaps followed by a run
+//    of varint position counts; the gaps are small, so most postings
+//    take two or three bytes.  Alongside each block we keep its last
+//    document number and its largest position count.
+//
+// The per-block metadata is what makes TopMatches() fast: the last
+// document number lets it skip over blocks that can't hold a match
+// without decoding them, and the largest count bounds the rank of any
+// document in the block, so it can skip decoding the counts of blocks
+// whose documents can't make the top results.
+//
+// Like a MappedIndex, it can be shared by any number of threads.
+class MemoryIndex {
+ public:
+  // One entry in a word's posting list.  "doc_id" is the document's
+  // number within this MemoryIndex, not its ID in the file; numbers are
+  // assigned in ID order, so sorting by either gives the same order.
+  struct Posting {
+    uint32_t doc_id;
+    int32_t num_positions;
+  };
+
+  MemoryIndex() { }
+  virtual ~MemoryIndex() { }
+
+  // Copies everything out of "mapped" into this MemoryIndex.  Returns
+  // false if "mapped" is malformed.
+  bool Build(const MappedIndex& mapped);
+
+  // Looks up "word".  If it is present, returns true and fills
+  // "postings" with the documents that contain it, sorted by document
+  // number.  Returns false if the word isn't in the index.
+  bool LookupWord(const std::string& word,
+                  std::vector<Posting>* const postings) const;
+
+  // Finds the documents that contain every word of "query", and returns
+  // the "max_results" of them with the highest total number of positions
+  // (ties go to the lower document number), best first, through "top",
+  // and the total number of such documents through "num_matches".  This
+  // gives the same answer as intersecting the LookupWord() lists and
+  // sorting them, but only decodes the position counts of documents that
+  // might make the cut; if "num_scored" isn't null, the number of counts
+  // it decoded is added to it.
+  void TopMatches(const std::vector<std::string>& query, size_t max_results,
+                  std::vector<Posting>* const top,
+                  size_t* const num_matches,
+                  size_t* const num_scored = nullptr) const;
+
+  // Looks up the name of document number "doc_id".  Returns true and sets
+  // "doc_name" on success, false if there is no such document.
+  bool LookupDocID(uint32_t doc_id, std::string* const doc_name) const;
+
+  // Calls "fn(word, num_postings)" for every word, in sorted order.
+  void ForEachWord(
+      const std::function<void(std::string_view, uint32_t)>& fn) const;
+
+  // The number of bytes of memory the index holds onto.
+  size_t MemoryBytes() const;
+
+ private:
+  // How many postings go in each block of a posting list.
+  static const uint32_t kBlockSize = 128;
+
+  // A dictionary entry: where the word and its posting list live.  The
+  // list's blocks are blocks_[first_block], blocks_[first_block + 1], ...
+  struct Term {
+    uint32_t word_offset;
+    uint32_t word_length;
+    uint32_t num_postings;
+    uint32_t first_block;
+    int32_t max_positions;  // the largest count in the whole list
+  };
+
+  // One block of a posting list.
+  struct Block {
+    uint64_t offset;        // where its data starts in postings_
+    uint32_t last_doc;      // its last (largest) document number
+    int32_t max_positions;  // its largest position count
+  };
+
+  // Returns the term for "word", or null if it isn't in the index.
+  const Term* FindTerm(const std::string& word) const;
+
+  // Returns the number of postings in block "b" (counting from 0) of
+  // "term"'s list.
+  static uint32_t BlockLength(const Term& term, uint32_t b) {
+    return std::min(kBlockSize, term.num_postings - b * kBlockSize);
+  }
+
+  // Decodes the document numbers of block "b" of "term"'s list into
+  // "doc_ids", and returns where the block's position counts start.
+  const uint8_t* DecodeDocIDs(const Term& term, uint32_t b,
+                              uint32_t* const doc_ids) const;
+
+  // Decodes "n" position counts starting at "p" into "counts".
+  static void DecodeCounts(const uint8_t* p, uint32_t n,
+                           int32_t* const counts);
+
+  std::string_view TermWord(const Term& term) const {
+    return std::string_view(words_.data() + term.word_offset,
+                            term.word_length);
+  }
+
+  // Document number -> document name, as offsets into names_; document
+  // number i's name runs from name_offsets_[i] to name_offsets_[i + 1].
+  std::string names_;
+  std::vector<uint32_t> name_offsets_;
+
+  // The dictionary, sorted by word.
+  std::vector<Term> terms_;
+  std::string words_;
+
+  // Every posting list's blocks, and their data, one after another.
+  std::vector<Block> blocks_;
+  std::vector<uint8_t> postings_;
+
+  MemoryIndex(const MemoryIndex&) = delete;
+  MemoryIndex& operator=(const MemoryIndex&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_MEMORYINDEX_H_
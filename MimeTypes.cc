@@ -0,0 +1,199 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "./MimeTypes.h"
+
+using std::string;
+using std::string_view;
+
+namespace hw4 {
+
+namespace {
+
+struct MimeType {
+  string_view extension;
+  string_view type;
+};
+
+// The built-in types.
+constexpr MimeType kBuiltinTypes[] = {
+  {"html", "text/html"},
+  {"htm", "text/html"},
+  {"jpeg", "image/jpeg"},
+  {"jpg", "image/jpeg"},
+  {"png", "image/png"},
+  {"gif", "image/gif"},
+  {"txt", "text/plain"},
+  {"js", "text/javascript"},
+  {"css", "text/css"},
+  {"xml", "text/xml"},
+  {"json", "application/json"},
+  {"svg", "image/svg+xml"},
+  {"ico", "image/x-icon"},
+  {"webp", "image/webp"},
+  {"pdf", "application/pdf"},
+  {"wasm", "application/wasm"},
+};
+constexpr int kNumBuiltinTypes = sizeof(kBuiltinTypes) / sizeof(MimeType);
+
+// The hash table has a slot for each possible hash value, holding the
+// index of the type whose extension hashes there, or -1.
+constexpr uint32_t kTableSize = 64;
+typedef std::array<int8_t, kTableSize> Table;
+
+// An FNV-1a hash of "extension", perturbed by "seed", reduced to a slot.
+constexpr uint32_t HashExtension(string_view extension, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (char c : extension) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  hash ^= hash >> 15;
+  return hash % kTableSize;
+}
+
+// Lays the built-in types out in a table using "seed".  Sets "ok" to
+// false if two of them collide.
+constexpr Table BuildTable(uint32_t seed, bool* ok) {
+  Table table{};
+  for (uint32_t i = 0; i < kTableSize; i++) {
+    table[i] = -1;
+  }
+  *ok = true;
+  for (int i = 0; i < kNumBuiltinTypes; i++) {
+    uint32_t slot = HashExtension(kBuiltinTypes[i].extension, seed);
+    if (table[slot] != -1) {
+      *ok = false;
+    }
+    table[slot] = i;
+  }
+  return table;
+}
+
+// Finds the first seed for which no two built-in types collide; that
+// makes the hash perfect.
+constexpr uint32_t FindSeed() {
+  for (uint32_t seed = 0; ; seed++) {
+    bool ok = false;
+    BuildTable(seed, &ok);
+    if (ok) {
+      return seed;
+    }
+  }
+}
+
+constexpr uint32_t kSeed = FindSeed();
+
+constexpr Table MakeTable() {
+  bool ok = false;
+  return BuildTable(kSeed, &ok);
+}
+
+constexpr Table kTable = MakeTable();
+
+// Every built-in extension is at most this long.
+constexpr size_t kMaxBuiltinExtension = 8;
+
+// Checks, at compile time, that every built-in type has its own slot.
+constexpr bool EveryTypeHasASlot() {
+  for (int i = 0; i < kNumBuiltinTypes; i++) {
+    if (kBuiltinTypes[i].extension.size() > kMaxBuiltinExtension ||
+        kTable[HashExtension(kBuiltinTypes[i].extension, kSeed)] != i) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(EveryTypeHasASlot(), "the built-in MIME type hash collides");
+
+}  // namespace
+
+// static
+string_view MimeTypes::LookupBuiltin(string_view extension) {
+  if (extension.size() > kMaxBuiltinExtension) {
+    return string_view();
+  }
+  int i = kTable[HashExtension(extension, kSeed)];
+  if (i == -1 || kBuiltinTypes[i].extension != extension) {
+    return string_view();
+  }
+  return kBuiltinTypes[i].type;
+}
+
+bool MimeTypes::Load(const string& file_name) {
+  std::ifstream file(file_name);
+  if (!file) {
+    return false;
+  }
+
+  // Each line is a type followed by its extensions; '#' starts a comment.
+  string line;
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    string type, extension;
+    if (!(words >> type)) {
+      continue;
+    }
+    while (words >> extension) {
+      for (char& c : extension) {
+        c = tolower(static_cast<unsigned char>(c));
+      }
+      loaded_[extension] = type;
+    }
+  }
+  return !file.bad();
+}
+
+string_view MimeTypes::Lookup(string_view file_name) const {
+  // The extension follows the last '.' of the last path component.
+  size_t dot = file_name.rfind('.');
+  if (dot == string_view::npos ||
+      file_name.find('/', dot) != string_view::npos) {
+    return string_view();
+  }
+  string_view extension = file_name.substr(dot + 1);
+
+  // Lower-case it; built-in extensions are short, so that usually fits in
+  // a small buffer.
+  char buffer[kMaxBuiltinExtension];
+  string lower;
+  string_view key;
+  if (extension.size() <= sizeof(buffer)) {
+    for (size_t i = 0; i < extension.size(); i++) {
+      buffer[i] = tolower(static_cast<unsigned char>(extension[i]));
+    }
+    key = string_view(buffer, extension.size());
+  } else {
+    lower = string(extension);
+    for (char& c : lower) {
+      c = tolower(static_cast<unsigned char>(c));
+    }
+    key = lower;
+  }
+
+  if (!loaded_.empty()) {
+    auto it = loaded_.find(string(key));
+    if (it != loaded_.end()) {
+      return it->second;
+    }
+  }
+  return LookupBuiltin(key);
+}
+
+}  // namespace hw4
@@ -0,0 +1,61 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_MIMETYPES_H_
+#define HW4_MIMETYPES_H_
+
+#include <string>         // for std::string
+#include <string_view>    // for std::string_view
+#include <unordered_map>  // for std::unordered_map
+
+namespace hw4 {
+
+// MimeTypes picks the Content-type of a static file from its suffix.
+//
+// The common types (".html", ".png", ".css", and so on) are built in, in
+// a table laid out at compile time with a perfect hash, so looking one up
+// is a hash and a single comparison.  More can be added, or the built-in
+// ones overridden, from a file in the format of /etc/mime.types:
+//
+//   # comment
+//   text/markdown    md markdown
+//   application/pdf  pdf
+//
+// Suffixes are matched without regard to case.  A MimeTypes is read-only
+// once loaded, so any number of threads can share it.
+class MimeTypes {
+ public:
+  MimeTypes() { }
+  virtual ~MimeTypes() { }
+
+  // Adds the types listed in the mime.types-style file "file_name".
+  // Returns false if the file can't be read.
+  bool Load(const std::string& file_name);
+
+  // Returns the Content-type for "file_name", or an empty string if its
+  // suffix isn't known.  The result stays valid as long as the MimeTypes.
+  std::string_view Lookup(std::string_view file_name) const;
+
+  // Returns the built-in Content-type for "extension" (lower-case, without
+  // the '.'), or an empty string if there isn't one.
+  static std::string_view LookupBuiltin(std::string_view extension);
+
+  // The number of types added by Load().
+  size_t size() const { return loaded_.size(); }
+
+ private:
+  // Types added by Load(), keyed by lower-case extension.
+  std::unordered_map<std::string, std::string> loaded_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_MIMETYPES_H_
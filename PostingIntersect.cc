@@ -0,0 +1,362 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <immintrin.h>  // for the SSE and AVX2 intrinsics
+#include <stdint.h>
+
+#include "./PostingIntersect.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+namespace hw4 {
+
+// Gallop through the longer list once it is this many times longer than
+// the shorter one; below that, walking both in blocks is faster.
+static const size_t kGallopRatio = 32;
+
+// Galloping binary searches down to a window this wide, then scans it.
+static const size_t kScanWidth = 16;
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar building blocks, shared by every method
+///////////////////////////////////////////////////////////////////////////////
+
+// Merges a[i..] with b[j..], appending matches to a_matches/b_matches
+// starting at index "count".  Returns the new count.
+template <typename T>
+static size_t MergeScalar(const T* a, size_t a_len, const T* b, size_t b_len,
+                          size_t i, size_t j, uint32_t* a_matches,
+                          uint32_t* b_matches, size_t count) {
+  while (i < a_len && j < b_len) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      a_matches[count] = i++;
+      b_matches[count] = j++;
+      count++;
+    }
+  }
+  return count;
+}
+
+// Returns how many of p[0..n) are less than "x".
+template <typename T>
+static size_t ScanScalar(const T* p, size_t n, T x) {
+  size_t k = 0;
+  while (k < n && p[k] < x) {
+    k++;
+  }
+  return k;
+}
+
+// Intersects the short list "small" with the long list "large" by
+// galloping: for each ID of "small", find it in "large" with an
+// exponential probe, a binary search, and finally Scan().  If "swapped",
+// "small" is really the caller's "b", so the outputs trade places.
+template <typename T, size_t (*Scan)(const T*, size_t, T)>
+static size_t Gallop(const T* small, size_t small_len,
+                     const T* large, size_t large_len, bool swapped,
+                     uint32_t* a_matches, uint32_t* b_matches) {
+  uint32_t* small_matches = swapped ? b_matches : a_matches;
+  uint32_t* large_matches = swapped ? a_matches : b_matches;
+  size_t count = 0;
+  size_t lo = 0;
+  for (size_t s = 0; s < small_len && lo < large_len; s++) {
+    T x = small[s];
+    if (large[lo] < x) {
+      // Probe ahead in doubling steps until we overshoot x; afterwards
+      // large[lo] < x <= large[hi] (or hi is past the end).
+      size_t step = 1;
+      size_t hi = lo + 1;
+      while (hi < large_len && large[hi] < x) {
+        lo = hi;
+        step *= 2;
+        hi = lo + step;
+      }
+      if (hi > large_len) {
+        hi = large_len;
+      }
+
+      // Narrow (lo, hi] down, then scan what's left.
+      lo++;
+      while (hi - lo > kScanWidth) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (large[mid] < x) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      lo += Scan(large + lo, hi - lo, x);
+    }
+    if (lo < large_len && large[lo] == x) {
+      small_matches[count] = s;
+      large_matches[count] = lo;
+      count++;
+      lo++;
+    }
+  }
+  return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SSE4.2: four IDs at a time
+///////////////////////////////////////////////////////////////////////////////
+
+// SSE and AVX2 only compare signed integers, so IDs are compared with
+// their top bit flipped, which maps unsigned order onto signed order.
+#define HW4_SIGN_BIT 0x80000000u
+
+__attribute__((target("sse4.2,popcnt")))
+static size_t ScanSse42(const uint32_t* p, size_t n, uint32_t x) {
+  const __m128i sign = _mm_set1_epi32(HW4_SIGN_BIT);
+  const __m128i vx = _mm_xor_si128(_mm_set1_epi32(x), sign);
+  size_t below = 0, k = 0;
+  for (; k + 4 <= n; k += 4) {
+    __m128i v = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k)), sign);
+    int lt = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(vx, v)));
+    below += __builtin_popcount(lt);
+    if (lt != 0xf) {
+      return below;  // sorted, so nothing further is below x
+    }
+  }
+  return below + ScanScalar(p + k, n - k, x);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static size_t BlockSse42(const uint32_t* a, size_t a_len,
+                         const uint32_t* b, size_t b_len,
+                         uint32_t* a_matches, uint32_t* b_matches) {
+  size_t i = 0, j = 0, count = 0;
+  while (i + 4 <= a_len && j + 4 <= b_len) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+    // r_k compares a[l] with b[(l + k) % 4].  OR-ing them tells us which
+    // IDs of a's block are in b's; rotating each back by k first tells us
+    // which of b's are in a's.
+    __m128i r0 = _mm_cmpeq_epi32(va, vb);
+    __m128i r1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39));
+    __m128i r2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4e));
+    __m128i r3 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93));
+    __m128i in_b = _mm_or_si128(_mm_or_si128(r0, r1), _mm_or_si128(r2, r3));
+    __m128i in_a = _mm_or_si128(
+        _mm_or_si128(r0, _mm_shuffle_epi32(r1, 0x93)),
+        _mm_or_si128(_mm_shuffle_epi32(r2, 0x4e), _mm_shuffle_epi32(r3, 0x39)));
+    int mask_a = _mm_movemask_ps(_mm_castsi128_ps(in_b));
+    int mask_b = _mm_movemask_ps(_mm_castsi128_ps(in_a));
+
+    // IDs are unique and sorted, so the k-th match in a's block pairs up
+    // with the k-th match in b's block.
+    while (mask_a != 0) {
+      a_matches[count] = i + __builtin_ctz(mask_a);
+      b_matches[count] = j + __builtin_ctz(mask_b);
+      count++;
+      mask_a &= mask_a - 1;
+      mask_b &= mask_b - 1;
+    }
+
+    // Advance whichever block ends first (or both); nothing in it can
+    // match anything further along the other list.
+    uint32_t a_last = a[i + 3], b_last = b[j + 3];
+    if (a_last <= b_last) {
+      i += 4;
+    }
+    if (b_last <= a_last) {
+      j += 4;
+    }
+  }
+  return MergeScalar(a, a_len, b, b_len, i, j, a_matches, b_matches, count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// AVX2: eight IDs at a time
+///////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("avx2,popcnt")))
+static size_t ScanAvx2(const uint32_t* p, size_t n, uint32_t x) {
+  const __m256i sign = _mm256_set1_epi32(HW4_SIGN_BIT);
+  const __m256i vx = _mm256_xor_si256(_mm256_set1_epi32(x), sign);
+  size_t below = 0, k = 0;
+  for (; k + 8 <= n; k += 8) {
+    __m256i v = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k)), sign);
+    int lt = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vx, v)));
+    below += __builtin_popcount(lt);
+    if (lt != 0xff) {
+      return below;
+    }
+  }
+  return below + ScanScalar(p + k, n - k, x);
+}
+
+// Returns a mask of the lanes of "x" that equal some lane of "y": "x" is
+// compared against the four rotations of each 128-bit half of "y", and of
+// "y" with its halves swapped, which covers all 64 pairs.
+__attribute__((target("avx2")))
+static inline __m256i MatchesAvx2(__m256i x, __m256i y) {
+  __m256i swapped = _mm256_permute2x128_si256(y, y, 1);
+  __m256i m0 = _mm256_or_si256(
+      _mm256_cmpeq_epi32(x, y),
+      _mm256_cmpeq_epi32(x, _mm256_shuffle_epi32(y, 0x39)));
+  __m256i m1 = _mm256_or_si256(
+      _mm256_cmpeq_epi32(x, _mm256_shuffle_epi32(y, 0x4e)),
+      _mm256_cmpeq_epi32(x, _mm256_shuffle_epi32(y, 0x93)));
+  __m256i m2 = _mm256_or_si256(
+      _mm256_cmpeq_epi32(x, swapped),
+      _mm256_cmpeq_epi32(x, _mm256_shuffle_epi32(swapped, 0x39)));
+  __m256i m3 = _mm256_or_si256(
+      _mm256_cmpeq_epi32(x, _mm256_shuffle_epi32(swapped, 0x4e)),
+      _mm256_cmpeq_epi32(x, _mm256_shuffle_epi32(swapped, 0x93)));
+  return _mm256_or_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m2, m3));
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t BlockAvx2(const uint32_t* a, size_t a_len,
+                        const uint32_t* b, size_t b_len,
+                        uint32_t* a_matches, uint32_t* b_matches) {
+  size_t i = 0, j = 0, count = 0;
+  while (i + 8 <= a_len && j + 8 <= b_len) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+
+    // The same all-pairs comparison as BlockSse42(), eight lanes wide;
+    // here it's cheaper to compare each way than to rotate masks back.
+    __m256i in_b = MatchesAvx2(va, vb);
+    __m256i in_a = MatchesAvx2(vb, va);
+    int mask_a = _mm256_movemask_ps(_mm256_castsi256_ps(in_b));
+    int mask_b = _mm256_movemask_ps(_mm256_castsi256_ps(in_a));
+
+    while (mask_a != 0) {
+      a_matches[count] = i + __builtin_ctz(mask_a);
+      b_matches[count] = j + __builtin_ctz(mask_b);
+      count++;
+      mask_a &= mask_a - 1;
+      mask_b &= mask_b - 1;
+    }
+
+    uint32_t a_last = a[i + 7], b_last = b[j + 7];
+    if (a_last <= b_last) {
+      i += 8;
+    }
+    if (b_last <= a_last) {
+      j += 8;
+    }
+  }
+  return MergeScalar(a, a_len, b, b_len, i, j, a_matches, b_matches, count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Dispatch
+///////////////////////////////////////////////////////////////////////////////
+
+static IntersectMethod DetectBestIntersectMethod() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    return IntersectMethod::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+    return IntersectMethod::kSse42;
+  }
+  return IntersectMethod::kScalar;
+}
+
+IntersectMethod BestIntersectMethod() {
+  static const IntersectMethod best = DetectBestIntersectMethod();
+  return best;
+}
+
+const char* IntersectMethodName(IntersectMethod method) {
+  switch (method) {
+    case IntersectMethod::kAvx2:
+      return "avx2";
+    case IntersectMethod::kSse42:
+      return "sse4.2";
+    default:
+      return "scalar";
+  }
+}
+
+bool IntersectMethodSupported(IntersectMethod method) {
+  return method <= BestIntersectMethod();
+}
+
+size_t IntersectPostings(const uint32_t* a, size_t a_len,
+                         const uint32_t* b, size_t b_len,
+                         uint32_t* a_matches, uint32_t* b_matches) {
+  return IntersectPostingsWith(BestIntersectMethod(), a, a_len, b, b_len,
+                               a_matches, b_matches);
+}
+
+size_t IntersectPostingsWith(IntersectMethod method,
+                             const uint32_t* a, size_t a_len,
+                             const uint32_t* b, size_t b_len,
+                             uint32_t* a_matches, uint32_t* b_matches) {
+  Verify333(IntersectMethodSupported(method));
+  if (a_len == 0 || b_len == 0) {
+    return 0;
+  }
+
+  // Skewed lists: gallop through the long one.
+  if (a_len > kGallopRatio * b_len || b_len > kGallopRatio * a_len) {
+    bool swapped = a_len > b_len;
+    const uint32_t* small = swapped ? b : a;
+    const uint32_t* large = swapped ? a : b;
+    size_t small_len = swapped ? b_len : a_len;
+    size_t large_len = swapped ? a_len : b_len;
+    switch (method) {
+      case IntersectMethod::kAvx2:
+        return Gallop<uint32_t, ScanAvx2>(small, small_len, large, large_len,
+                                          swapped, a_matches, b_matches);
+      case IntersectMethod::kSse42:
+        return Gallop<uint32_t, ScanSse42>(small, small_len, large,
+                                           large_len, swapped, a_matches,
+                                           b_matches);
+      default:
+        return Gallop<uint32_t, ScanScalar<uint32_t>>(
+            small, small_len, large, large_len, swapped, a_matches,
+            b_matches);
+    }
+  }
+
+  // Lists of similar length: walk both in blocks.
+  switch (method) {
+    case IntersectMethod::kAvx2:
+      return BlockAvx2(a, a_len, b, b_len, a_matches, b_matches);
+    case IntersectMethod::kSse42:
+      return BlockSse42(a, a_len, b, b_len, a_matches, b_matches);
+    default:
+      return MergeScalar(a, a_len, b, b_len, 0, 0, a_matches, b_matches, 0);
+  }
+}
+
+size_t IntersectPostings(const uint64_t* a, size_t a_len,
+                         const uint64_t* b, size_t b_len,
+                         uint32_t* a_matches, uint32_t* b_matches) {
+  if (a_len == 0 || b_len == 0) {
+    return 0;
+  }
+  if (a_len > kGallopRatio * b_len || b_len > kGallopRatio * a_len) {
+    bool swapped = a_len > b_len;
+    return Gallop<uint64_t, ScanScalar<uint64_t>>(
+        swapped ? b : a, swapped ? b_len : a_len,
+        swapped ? a : b, swapped ? a_len : b_len,
+        swapped, a_matches, b_matches);
+  }
+  return MergeScalar(a, a_len, b, b_len, 0, 0, a_matches, b_matches, 0);
+}
+
+}  // namespace hw4
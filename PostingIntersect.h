@@ -0,0 +1,76 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_POSTINGINTERSECT_H_
+#define HW4_POSTINGINTERSECT_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint32_t, uint64_t
+
+namespace hw4 {
+
+// Posting-list intersection: given two sorted arrays of document IDs
+// without duplicates, find the IDs they have in common.  For each common
+// ID, the intersection reports where it sits in each array -- its index
+// in "a" goes to "a_matches" and its index in "b" to "b_matches", in
+// increasing order -- so the caller can combine whatever else it keeps
+// alongside the IDs (e.g., their position counts).  Both output arrays
+// must have room for min(a_len, b_len) entries.  Returns the number of
+// common IDs.
+//
+// When the lists are of similar length, the intersection walks both in
+// blocks, comparing every ID in a block of "a" against every ID in a
+// block of "b" at once with SIMD instructions.  When one list is much
+// shorter, it instead gallops through the longer one: for each ID of the
+// shorter list, it probes ahead exponentially to bracket the ID, binary
+// searches the bracket down to a few cache lines, and finishes with a
+// SIMD scan.
+//
+// Which instructions are used is decided once, at run time, from what
+// the CPU supports: AVX2 (8 IDs at a time), else SSE4.2 (4 at a time),
+// else plain scalar code.
+enum class IntersectMethod {
+  kScalar,
+  kSse42,
+  kAvx2,
+};
+
+// Returns the fastest method this CPU supports.
+IntersectMethod BestIntersectMethod();
+
+// Returns a printable name for "method".
+const char* IntersectMethodName(IntersectMethod method);
+
+// Returns true if this CPU can run "method".
+bool IntersectMethodSupported(IntersectMethod method);
+
+// Intersects "a" and "b" using the best method the CPU supports.
+size_t IntersectPostings(const uint32_t* a, size_t a_len,
+                         const uint32_t* b, size_t b_len,
+                         uint32_t* a_matches, uint32_t* b_matches);
+
+// Intersects "a" and "b" using "method", which the CPU must support.
+// This is meant for benchmarks and for checking the methods against
+// each other.
+size_t IntersectPostingsWith(IntersectMethod method,
+                             const uint32_t* a, size_t a_len,
+                             const uint32_t* b, size_t b_len,
+                             uint32_t* a_matches, uint32_t* b_matches);
+
+// Intersects lists of 64-bit IDs (e.g., the IDs in an index file).  No
+// SIMD here, but it still gallops through skewed lists.
+size_t IntersectPostings(const uint64_t* a, size_t a_len,
+                         const uint64_t* b, size_t b_len,
+                         uint32_t* a_matches, uint32_t* b_matches);
+
+}  // namespace hw4
+
+#endif  // HW4_POSTINGINTERSECT_H_
@@ -0,0 +1,461 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <cxxabi.h>     // for abi::__cxa_demangle()
+#include <dlfcn.h>      // for dladdr()
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>       // for ElfW()
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./Profiler.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::map;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace hw4 {
+
+// One stack, innermost frame first.
+struct Profiler::Sample {
+  size_t depth;
+  uintptr_t pcs[kMaxDepth];
+};
+
+// A run of samples, all taken on one thread.  Only that thread writes it,
+// so "used" is only atomic to hand the samples to Profile() when done.
+struct Profiler::Chunk {
+  Sample samples[kChunkSamples];
+  std::atomic<size_t> used{0};
+};
+
+// The state of a running profile: the pool of chunks, and what it cost.
+struct Profiler::Session {
+  uint64_t id;
+  std::unique_ptr<Chunk[]> chunks;
+  size_t num_chunks;
+  std::atomic<size_t> next_chunk{0};  // may run past num_chunks
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> handler_ns{0};
+};
+
+// The session SIGPROF records into, if any, and how many handlers are
+// looking at it; Profile() waits for that to drop to 0 before reading it.
+static std::atomic<void*> active_session(nullptr);
+static std::atomic<int> handlers_running(0);
+
+// Set while a profile runs, so that only one does.
+static std::atomic<bool> profiling(false);
+
+// Each session's id; 0 is never used, so it can mean "none".
+static std::atomic<uint64_t> next_session_id(1);
+
+// The chunk the calling thread is filling, in the session it last
+// recorded to.  Being in the executable, these need no allocation on
+// first use, so the signal handler may touch them.
+static thread_local uint64_t thread_session_id = 0;
+static thread_local void* thread_chunk = nullptr;
+
+// Whether Unwind() knows how to read this machine's signal context.
+#if defined(__x86_64__) || defined(__aarch64__)
+static const bool kCanUnwind = true;
+#else
+static const bool kCanUnwind = false;
+#endif
+
+// Installs the SIGPROF handler, once.  It's never taken away again: a
+// SIGPROF still in flight when a profile ends would otherwise kill the
+// process.
+static pthread_once_t install_once = PTHREAD_ONCE_INIT;
+static bool installed = false;
+
+// A function in the executable, from its ELF symbol table.
+struct FunctionSymbol {
+  uintptr_t start, end;
+  string name;
+};
+
+// The executable's functions, in order of address; read once.
+static pthread_once_t symbols_once = PTHREAD_ONCE_INIT;
+static vector<FunctionSymbol> exe_symbols;
+
+static uint64_t ClockNanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Returns whether the page holding "addr" can be read, without touching
+// it: rt_sigprocmask() copies in the signal set it's given before it
+// rejects the bad "how", so it fails with EFAULT just if the set can't be
+// read.  "*known" caches the last page found readable.
+static bool IsReadable(uintptr_t addr, uintptr_t* const known) {
+  static const uintptr_t kPageMask = ~static_cast<uintptr_t>(4095);
+  uintptr_t page = addr & kPageMask;
+  if (page == *known) {
+    return true;
+  }
+  if (page == 0 ||
+      (syscall(SYS_rt_sigprocmask, ~0, page, nullptr, 8) == -1 &&
+       errno == EFAULT)) {
+    return false;
+  }
+  *known = page;
+  return true;
+}
+
+// static
+const uint32_t Profiler::kMaxHz;
+const uint32_t Profiler::kMaxSeconds;
+
+Profiler::Profiler() {
+  stats_ = Stats{0, 0, 0, 0, 0};
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+Profiler::~Profiler() {
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool Profiler::Profile(uint32_t seconds, uint32_t hz, Result* const result,
+                       string* const error) {
+  hz = std::min(std::max(hz, 1U), kMaxHz);
+  seconds = std::min(std::max(seconds, 1U), kMaxSeconds);
+  if (profiling.exchange(true)) {
+    *error = "a profile is already running";
+    return false;
+  }
+  pthread_once(&install_once, [] {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &HandleSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    installed = sigaction(SIGPROF, &action, nullptr) == 0;
+  });
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = SIGPROF;
+  timer_t timer;
+  if (!installed || !kCanUnwind ||
+      timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer) != 0) {
+    profiling = false;
+    *error = "profiling isn't supported here";
+    return false;
+  }
+
+  // Enough chunks for every CPU to be busy the whole time, with some to
+  // spare for threads that leave theirs part full; but no more than
+  // kMaxPoolBytes' worth.
+  Session session;
+  session.id = next_session_id++;
+  long cpus = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);  // NOLINT
+  uint64_t expected = static_cast<uint64_t>(seconds) * hz * cpus * 5 / 4;
+  session.num_chunks = std::min<uint64_t>(
+      expected / kChunkSamples + 128, kMaxPoolBytes / sizeof(Chunk));
+  session.chunks.reset(new Chunk[session.num_chunks]);
+
+  uint64_t period_ns = 1000000000 / hz;
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = period_ns / 1000000000;
+  spec.it_interval.tv_nsec = period_ns % 1000000000;
+  spec.it_value = spec.it_interval;
+  uint64_t cpu_start = ClockNanos(CLOCK_PROCESS_CPUTIME_ID);
+  active_session.store(&session);
+  Verify333(timer_settime(timer, 0, &spec, nullptr) == 0);
+
+  struct timespec remaining = {static_cast<time_t>(seconds), 0};
+  while (nanosleep(&remaining, &remaining) == -1 && errno == EINTR) { }
+
+  // Stop the timer, then wait out any handler still recording.
+  Verify333(timer_delete(timer) == 0);
+  active_session.store(nullptr);
+  while (handlers_running.load() != 0) {
+    sched_yield();
+  }
+  uint64_t cpu_ns = ClockNanos(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+
+  result->samples = 0;
+  size_t used_chunks = std::min(session.next_chunk.load(),
+                                session.num_chunks);
+  for (size_t i = 0; i < used_chunks; i++) {
+    result->samples += session.chunks[i].used.load();
+  }
+  result->dropped = session.dropped.load();
+  result->cpu_ns = cpu_ns;
+  result->handler_ns = session.handler_ns.load();
+  result->folded.clear();
+  Fold(session, &result->folded);
+  profiling = false;
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  stats_.profiles++;
+  stats_.samples += result->samples;
+  stats_.dropped += result->dropped;
+  stats_.cpu_ns += result->cpu_ns;
+  stats_.handler_ns += result->handler_ns;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return true;
+}
+
+Profiler::Stats Profiler::GetStats() const {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  Stats stats = stats_;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return stats;
+}
+
+// static
+void Profiler::HandleSignal(int signal, siginfo_t* info, void* context) {
+  // Count ourselves in before looking for the session, so that Profile()
+  // can't see no handlers running while this one is about to record.
+  int saved_errno = errno;
+  handlers_running.fetch_add(1);
+  Session* session = static_cast<Session*>(active_session.load());
+  if (session != nullptr) {
+    RecordSample(session, context);
+  }
+  handlers_running.fetch_sub(1);
+  errno = saved_errno;
+}
+
+// static
+void Profiler::RecordSample(Session* session, void* context) {
+  uint64_t start = ClockNanos(CLOCK_MONOTONIC);
+  Chunk* chunk = static_cast<Chunk*>(thread_chunk);
+  if (thread_session_id != session->id ||
+      chunk->used.load(std::memory_order_relaxed) == kChunkSamples) {
+    size_t next = session->next_chunk.fetch_add(1);
+    if (next >= session->num_chunks) {
+      session->dropped.fetch_add(1);
+      session->handler_ns.fetch_add(ClockNanos(CLOCK_MONOTONIC) - start);
+      return;
+    }
+    chunk = &session->chunks[next];
+    thread_chunk = chunk;
+    thread_session_id = session->id;
+  }
+
+  size_t used = chunk->used.load(std::memory_order_relaxed);
+  Sample* sample = &chunk->samples[used];
+  sample->depth = Unwind(context, sample->pcs, kMaxDepth);
+  chunk->used.store(used + 1, std::memory_order_release);
+  session->handler_ns.fetch_add(ClockNanos(CLOCK_MONOTONIC) - start);
+}
+
+// static
+size_t Profiler::Unwind(void* context, uintptr_t* pcs, size_t max_depth) {
+  // Where the thread was interrupted: its program counter, stack pointer
+  // and frame pointer.
+  uintptr_t pc, sp, fp;
+#if defined(__x86_64__)
+  const mcontext_t& mc = static_cast<ucontext_t*>(context)->uc_mcontext;
+  pc = mc.gregs[REG_RIP];
+  sp = mc.gregs[REG_RSP];
+  fp = mc.gregs[REG_RBP];
+#elif defined(__aarch64__)
+  const mcontext_t& mc = static_cast<ucontext_t*>(context)->uc_mcontext;
+  pc = mc.pc;
+  sp = mc.sp;
+  fp = mc.regs[29];
+#else
+  return 0;
+#endif
+
+  // Each frame starts with the caller's frame pointer, then the return
+  // address.  Frames only go up the stack, and not too far at a time; a
+  // frame pointer that breaks those rules, or points at memory that isn't
+  // there, was probably in use as an ordinary register, so stop.
+  static const uintptr_t kMaxFrameBytes = 1 << 20;
+  uintptr_t known_page = 0;
+  size_t depth = 0;
+  pcs[depth++] = pc;
+  while (depth < max_depth) {
+    if (fp < sp || fp - sp > kMaxFrameBytes ||
+        (fp & (sizeof(uintptr_t) - 1)) != 0 ||
+        !IsReadable(fp, &known_page) ||
+        !IsReadable(fp + 2 * sizeof(uintptr_t) - 1, &known_page)) {
+      break;
+    }
+    const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+    uintptr_t return_address = frame[1];
+    if (return_address == 0) {
+      break;
+    }
+    // Name the call, not the instruction after it, which may be in the
+    // next function.
+    pcs[depth++] = return_address - 1;
+    sp = fp + 2 * sizeof(uintptr_t);
+    fp = frame[0];
+  }
+  return depth;
+}
+
+// Returns "name" demangled, if it's a C++ name.
+static string Demangle(const char* name) {
+  int status;
+  char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  if (status != 0) {
+    return name;
+  }
+  string result = demangled;
+  free(demangled);
+  return result;
+}
+
+// Reads the functions in the symbol table of the running executable,
+// which is loaded at "base", into exe_symbols.  dladdr() only sees the
+// symbols an executable exports, which leaves out static functions.
+static void ReadExecutableSymbols(uintptr_t base) {
+  int fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return;
+  }
+  ElfW(Ehdr) header;
+  vector<ElfW(Shdr)> sections;
+  if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      memcmp(header.e_ident, ELFMAG, SELFMAG) == 0 &&
+      header.e_shentsize == sizeof(ElfW(Shdr))) {
+    sections.resize(header.e_shnum);
+    ssize_t bytes = sections.size() * sizeof(ElfW(Shdr));
+    if (pread(fd, sections.data(), bytes, header.e_shoff) != bytes) {
+      sections.clear();
+    }
+  }
+  if (header.e_type == ET_EXEC) {
+    base = 0;  // the addresses are absolute
+  }
+
+  for (const ElfW(Shdr)& section : sections) {
+    if (section.sh_type != SHT_SYMTAB || section.sh_link >= sections.size()) {
+      continue;
+    }
+    const ElfW(Shdr)& strings = sections[section.sh_link];
+    vector<ElfW(Sym)> symbols(section.sh_size / sizeof(ElfW(Sym)));
+    string names(strings.sh_size, '\0');
+    ssize_t bytes = symbols.size() * sizeof(ElfW(Sym));
+    if (pread(fd, symbols.data(), bytes, section.sh_offset) != bytes ||
+        pread(fd, &names[0], names.size(), strings.sh_offset) !=
+        static_cast<ssize_t>(names.size())) {
+      continue;
+    }
+    for (const ElfW(Sym)& symbol : symbols) {
+      if (ELF64_ST_TYPE(symbol.st_info) == STT_FUNC && symbol.st_value != 0 &&
+          symbol.st_size != 0 && symbol.st_name < names.size()) {
+        exe_symbols.push_back(FunctionSymbol{
+            base + symbol.st_value, base + symbol.st_value + symbol.st_size,
+            Demangle(names.c_str() + symbol.st_name)});
+      }
+    }
+  }
+  close(fd);
+  std::sort(exe_symbols.begin(), exe_symbols.end(),
+            [](const FunctionSymbol& a, const FunctionSymbol& b) {
+              return a.start < b.start;
+            });
+}
+
+// Returns the name of the function holding "pc": from the executable's
+// symbol table, else from dladdr(), else the file and offset it's at.
+static string FunctionName(uintptr_t pc) {
+  auto it = std::upper_bound(exe_symbols.begin(), exe_symbols.end(), pc,
+                             [](uintptr_t addr, const FunctionSymbol& symbol) {
+                               return addr < symbol.start;
+                             });
+  if (it != exe_symbols.begin() && pc < (it - 1)->end) {
+    return (it - 1)->name;
+  }
+
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(pc), &info) == 0 ||
+      info.dli_fname == nullptr) {
+    std::stringstream ss;
+    ss << "0x" << std::hex << pc;
+    return ss.str();
+  }
+  if (info.dli_sname != nullptr) {
+    return Demangle(info.dli_sname);
+  }
+  const char* file = strrchr(info.dli_fname, '/');
+  std::stringstream ss;
+  ss << (file == nullptr ? info.dli_fname : file + 1) << "+0x" << std::hex
+     << pc - reinterpret_cast<uintptr_t>(info.dli_fbase);
+  return ss.str();
+}
+
+// static
+void Profiler::Fold(const Session& session, string* const out) {
+  pthread_once(&symbols_once, [] {
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(&HandleSignal), &info) != 0) {
+      ReadExecutableSymbols(reinterpret_cast<uintptr_t>(info.dli_fbase));
+    }
+  });
+
+  // Count each distinct stack, naming each address once.
+  unordered_map<uintptr_t, string> names;
+  map<string, uint64_t> stacks;
+  size_t used_chunks = std::min(session.next_chunk.load(),
+                                session.num_chunks);
+  for (size_t i = 0; i < used_chunks; i++) {
+    const Chunk& chunk = session.chunks[i];
+    size_t used = chunk.used.load(std::memory_order_acquire);
+    for (size_t s = 0; s < used; s++) {
+      const Sample& sample = chunk.samples[s];
+      string stack;
+      for (size_t d = sample.depth; d > 0; d--) {
+        uintptr_t pc = sample.pcs[d - 1];
+        auto name = names.find(pc);
+        if (name == names.end()) {
+          // ';' separates frames.
+          string function = FunctionName(pc);
+          std::replace(function.begin(), function.end(), ';', ':');
+          name = names.emplace(pc, function).first;
+        }
+        if (!stack.empty()) {
+          stack += ';';
+        }
+        stack += name->second;
+      }
+      stacks[stack]++;
+    }
+  }
+
+  for (const auto& [stack, count] : stacks) {
+    *out += stack;
+    *out += ' ';
+    *out += std::to_string(count);
+    *out += '\n';
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,117 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_PROFILER_H_
+#define HW4_PROFILER_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <signal.h>
+#include <stdint.h>
+#include <string>
+
+namespace hw4 {
+
+// A Profiler samples where the whole process spends its CPU time, without
+// perf or any privileges, for /debug/profile.  While Profile() runs, a
+// timer on the process's CPU clock sends SIGPROF every 1 / "hz" CPU
+// seconds, to whichever thread is using the CPU at the time.  The signal
+// handler walks that thread's stack by its frame pointers (the Makefile
+// builds everything with -fno-omit-frame-pointer) and copies the return
+// addresses into a buffer of the thread's own: a chunk of samples it
+// claims from a pool allocated up front, with one atomic add.  The
+// handler takes no locks and allocates nothing.  Once the time is up,
+// Profile() turns the addresses into function names and returns the
+// stacks in the "folded" format that flame graph tools read, one line per
+// distinct stack with the root first and the number of samples last:
+//
+//   start_thread;ThreadLoop;HttpServer_ThrFn;ProcessQueryRequest 12
+//
+// A sample taken in a function built without frame pointers (e.g. in
+// libc) may lose its callers, or show the function alone.  The kernel
+// checks CPU timers once a tick, so it won't sample faster than its tick
+// rate (often 250 Hz) per CPU, whatever "hz" asks for.
+//
+// The cost is bounded: sampling stops at kMaxHz, stacks at kMaxDepth
+// frames, and the pool at kMaxPoolBytes, past which samples are dropped
+// (and counted).  Each profile reports how much CPU time the handler took.
+//
+// Only one profile runs at a time, in the whole process.
+class Profiler {
+ public:
+  // The most samples per CPU second, and the longest profile.
+  static const uint32_t kMaxHz = 1000;
+  static const uint32_t kMaxSeconds = 60;
+
+  Profiler();
+  virtual ~Profiler();
+
+  // What a profile found, and what it cost.
+  struct Result {
+    uint64_t samples;     // stacks recorded
+    uint64_t dropped;     // samples lost, for a full pool
+    uint64_t cpu_ns;      // the process's CPU time while profiling
+    uint64_t handler_ns;  // of which the signal handler took this much
+    std::string folded;   // the stacks, folded
+  };
+
+  // Samples the process "hz" times per CPU second for "seconds" (wall
+  // clock) seconds, blocking until done, and fills in "result".  Returns
+  // false, and explains why in "error", if another profile is running or
+  // the timer can't be made.
+  bool Profile(uint32_t seconds, uint32_t hz, Result* const result,
+               std::string* const error);
+
+  // A snapshot of the profiler's counters.
+  struct Stats {
+    uint64_t profiles;    // completed
+    uint64_t samples;     // in all of them
+    uint64_t dropped;
+    uint64_t cpu_ns;
+    uint64_t handler_ns;
+  };
+  Stats GetStats() const;
+
+ private:
+  // The deepest stack recorded, and how many samples a thread claims from
+  // the pool at once.
+  static const size_t kMaxDepth = 64;
+  static const size_t kChunkSamples = 32;
+  static const size_t kMaxPoolBytes = 32 << 20;
+
+  struct Sample;
+  struct Chunk;
+  struct Session;
+
+  // The SIGPROF handler, and what it does while a session is running.
+  static void HandleSignal(int signal, siginfo_t* info, void* context);
+  static void RecordSample(Session* session, void* context);
+
+  // Copies the return addresses on the stack interrupted in "context",
+  // innermost first, into "pcs", and returns how many there are.
+  static size_t Unwind(void* context, uintptr_t* pcs, size_t max_depth);
+
+  // Folds the samples in "session" into "out", naming their functions.
+  static void Fold(const Session& session, std::string* const out);
+
+  // stats_ is guarded by lock_.
+  mutable pthread_mutex_t lock_;
+  Stats stats_;
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_PROFILER_H_
@@ -0,0 +1,171 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./QueryCache.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::hash;
+using std::list;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// A rough per-entry overhead: the list node, the hash map node, and the
+// QueryAnswer itself.
+static const size_t kEntryOverhead = 128;
+
+// Estimates how much memory an entry holds onto.
+static size_t EntryBytes(const string& key, const QueryAnswer& answer) {
+  size_t bytes = kEntryOverhead + key.capacity() +
+    answer.results.capacity() * sizeof(IndexSet::QueryResult);
+  for (const IndexSet::QueryResult& result : answer.results) {
+    bytes += result.document_name.capacity();
+  }
+  return bytes;
+}
+
+QueryCache::QueryCache(size_t max_entries, size_t max_bytes) {
+  // Round the per-shard bounds up, so that a small cache can still hold
+  // something in each shard.
+  max_entries_per_shard_ = (max_entries + kNumShards - 1) / kNumShards;
+  max_bytes_per_shard_ = (max_bytes + kNumShards - 1) / kNumShards;
+  for (Shard& shard : shards_) {
+    Verify333(pthread_mutex_init(&shard.lock, nullptr) == 0);
+    shard.bytes = 0;
+    shard.hits = shard.misses = shard.evictions = shard.saved_ns = 0;
+  }
+}
+
+QueryCache::~QueryCache() {
+  for (Shard& shard : shards_) {
+    Verify333(pthread_mutex_destroy(&shard.lock) == 0);
+  }
+}
+
+bool QueryCache::Lookup(const vector<string>& query, size_t max_results,
+                        shared_ptr<const QueryAnswer>* const answer) {
+  string key = MakeKey(query);
+  Shard* shard = ShardFor(key);
+
+  Verify333(pthread_mutex_lock(&shard->lock) == 0);
+  auto it = shard->map.find(key);
+  // A cached answer is good enough if it was computed for at least as
+  // many results as we want, or if it already holds every match.
+  bool hit = it != shard->map.end() &&
+    (it->second->answer->max_results >= max_results ||
+     it->second->answer->results.size() >= it->second->answer->num_matches);
+  if (hit) {
+    // Move the entry to the front of the LRU list.
+    shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+    *answer = it->second->answer;
+    shard->hits++;
+    shard->saved_ns += (*answer)->compute_ns;
+  } else {
+    shard->misses++;
+  }
+  Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+  return hit;
+}
+
+void QueryCache::Insert(const vector<string>& query,
+                        const shared_ptr<const QueryAnswer>& answer) {
+  if (max_entries_per_shard_ == 0 || max_bytes_per_shard_ == 0) {
+    return;
+  }
+  string key = MakeKey(query);
+  size_t bytes = EntryBytes(key, *answer);
+  if (bytes > max_bytes_per_shard_) {
+    return;  // It would push everything else out.
+  }
+  Shard* shard = ShardFor(key);
+
+  Verify333(pthread_mutex_lock(&shard->lock) == 0);
+  auto it = shard->map.find(key);
+  if (it != shard->map.end()) {
+    shard->bytes -= it->second->bytes;
+    shard->lru.erase(it->second);
+    shard->map.erase(it);
+  }
+  while (!shard->lru.empty() &&
+         (shard->lru.size() >= max_entries_per_shard_ ||
+          shard->bytes + bytes > max_bytes_per_shard_)) {
+    EvictOne(shard);
+  }
+  shard->lru.push_front(Entry{key, answer, bytes});
+  shard->map[key] = shard->lru.begin();
+  shard->bytes += bytes;
+  Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+}
+
+void QueryCache::Clear() {
+  for (Shard& shard : shards_) {
+    Verify333(pthread_mutex_lock(&shard.lock) == 0);
+    shard.map.clear();
+    shard.lru.clear();
+    shard.bytes = 0;
+    Verify333(pthread_mutex_unlock(&shard.lock) == 0);
+  }
+}
+
+QueryCache::Stats QueryCache::GetStats() const {
+  Stats stats = {0, 0, 0, 0, 0, 0};
+  for (Shard& shard : shards_) {
+    Verify333(pthread_mutex_lock(&shard.lock) == 0);
+    stats.hits += shard.hits;
+    stats.misses += shard.misses;
+    stats.evictions += shard.evictions;
+    stats.saved_ns += shard.saved_ns;
+    stats.entries += shard.lru.size();
+    stats.bytes += shard.bytes;
+    Verify333(pthread_mutex_unlock(&shard.lock) == 0);
+  }
+  return stats;
+}
+
+string QueryCache::MakeKey(const vector<string>& query) {
+  // Query words never contain spaces, so joining on one is unambiguous.
+  string key;
+  for (const string& word : query) {
+    if (!key.empty()) {
+      key += ' ';
+    }
+    key += word;
+  }
+  return key;
+}
+
+QueryCache::Shard* QueryCache::ShardFor(const string& key) {
+  // The low bits of the hash pick the bucket inside the shard's map, so
+  // use the high bits to pick the shard.
+  size_t h = hash<string>()(key);
+  return &shards_[(h >> 56) % kNumShards];
+}
+
+void QueryCache::EvictOne(Shard* const shard) {
+  Entry& victim = shard->lru.back();
+  shard->bytes -= victim.bytes;
+  shard->map.erase(victim.key);
+  shard->lru.pop_back();
+  shard->evictions++;
+}
+
+}  // namespace hw4
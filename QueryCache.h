@@ -0,0 +1,121 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_QUERYCACHE_H_
+#define HW4_QUERYCACHE_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread mutex functions
+}
+
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./IndexSet.h"
+
+namespace hw4 {
+
+// The answer to one query: its best "max_results" matches, and the total
+// number of documents that matched.
+struct QueryAnswer {
+  std::vector<IndexSet::QueryResult> results;
+  size_t num_matches;
+  size_t max_results;
+
+  // How long the answer took to compute, in nanoseconds.
+  uint64_t compute_ns;
+};
+
+// A QueryCache remembers recent QueryAnswers so that popular searches
+// don't have to be re-run against the indices.  It is keyed by a
+// normalized query: the lower-cased, de-duplicated, sorted vector of
+// query words, so "Foo bar" and "bar foo foo" share an entry.
+//
+// The cache is split into shards, each with its own lock and its own
+// least-recently-used list, so that worker threads rarely contend.  It is
+// bounded both by the number of entries and by an estimate of the bytes
+// they use; adding an entry evicts least-recently-used entries from its
+// shard until both bounds hold again.
+class QueryCache {
+ public:
+  // Creates an empty cache that holds at most "max_entries" answers and
+  // about "max_bytes" bytes.  A cache with either bound set to zero
+  // never stores anything.
+  QueryCache(size_t max_entries, size_t max_bytes);
+  virtual ~QueryCache();
+
+  // Looks up "query" (already normalized).  On a hit that covers at least
+  // "max_results" results, returns true and the answer through "answer".
+  // Otherwise returns false.
+  bool Lookup(const std::vector<std::string>& query, size_t max_results,
+              std::shared_ptr<const QueryAnswer>* const answer);
+
+  // Adds (or replaces) the answer for "query".
+  void Insert(const std::vector<std::string>& query,
+              const std::shared_ptr<const QueryAnswer>& answer);
+
+  // Drops every entry, e.g., because the indices changed underneath us.
+  void Clear();
+
+  // A snapshot of the cache's counters.
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t saved_ns;   // total compute time of the answers we served
+    uint64_t entries;
+    uint64_t bytes;
+  };
+  Stats GetStats() const;
+
+  // Turns a normalized query into the string the cache is keyed by.
+  static std::string MakeKey(const std::vector<std::string>& query);
+
+ private:
+  static const int kNumShards = 16;
+
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const QueryAnswer> answer;
+    size_t bytes;
+  };
+
+  struct Shard {
+    pthread_mutex_t lock;
+    std::list<Entry> lru;  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> map;
+    size_t bytes;
+    uint64_t hits, misses, evictions, saved_ns;
+  };
+
+  // Picks the shard that holds "key".
+  Shard* ShardFor(const std::string& key);
+
+  // Removes the least recently used entry of "shard".  The caller holds
+  // the shard's lock.
+  void EvictOne(Shard* const shard);
+
+  size_t max_entries_per_shard_;
+  size_t max_bytes_per_shard_;
+  mutable Shard shards_[kNumShards];
+
+  QueryCache(const QueryCache&) = delete;
+  QueryCache& operator=(const QueryCache&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_QUERYCACHE_H_
@@ -0,0 +1,348 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./QueryEngine.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using boost::to_lower;
+using std::cout;
+using std::endl;
+using std::list;
+using std::max;
+using std::min;
+using std::promise;
+using std::shared_future;
+using std::shared_ptr;
+using std::sort;
+using std::string;
+using std::unique;
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+// static
+const int QueryEngine::kWatchIntervalSeconds = 1;
+
+// static
+const uint32_t QueryEngine::kMaxBatchThreads = 16;
+
+// The state of one batch of queries, shared by the thread that issued it
+// and the BatchTasks helping it.  Each of them takes the next unanswered
+// query until there are none left; "helpers" counts the BatchTasks still
+// running, so the issuing thread can wait for them.
+struct BatchState {
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  size_t next;
+  int helpers;
+  const vector<vector<string>>* queries;
+  size_t max_results;
+  vector<shared_ptr<const QueryAnswer>>* answers;
+};
+
+class QueryEngine::BatchTask : public ThreadPool::Task {
+ public:
+  explicit BatchTask(ThreadPool::thread_task_fn f) : ThreadPool::Task(f) { }
+
+  QueryEngine* engine;
+  BatchState* batch;
+};
+
+// Answers queries from "batch" until there are none left.
+static void AnswerBatch(QueryEngine* engine, BatchState* batch) {
+  while (true) {
+    Verify333(pthread_mutex_lock(&batch->lock) == 0);
+    size_t i = batch->next++;
+    Verify333(pthread_mutex_unlock(&batch->lock) == 0);
+    if (i >= batch->queries->size()) {
+      return;
+    }
+    (*batch->answers)[i] = engine->ProcessQuery((*batch->queries)[i],
+                                                batch->max_results);
+  }
+}
+
+// Returns the current time on the monotonic clock, in nanoseconds.
+static uint64_t NowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+QueryEngine::QueryEngine(const list<string>& index_files,
+                         bool preload,
+                         bool in_memory,
+                         size_t cache_entries,
+                         size_t cache_bytes)
+  : index_files_(index_files), preload_(preload), in_memory_(in_memory),
+    cache_(cache_entries, cache_bytes), evaluations_(0), coalesced_(0),
+    index_searches_(0), index_searches_skipped_(0),
+    stop_(false), watching_(false), batch_threads_(0) {
+  Verify333(pthread_mutex_init(&flight_lock_, nullptr) == 0);
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+  Verify333(pthread_cond_init(&stop_cond_, nullptr) == 0);
+}
+
+QueryEngine::~QueryEngine() {
+  batch_pool_.reset();
+  if (watching_) {
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    stop_ = true;
+    Verify333(pthread_cond_signal(&stop_cond_) == 0);
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+    Verify333(pthread_join(watcher_, nullptr) == 0);
+  }
+  Verify333(pthread_cond_destroy(&stop_cond_) == 0);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+  Verify333(pthread_mutex_destroy(&flight_lock_) == 0);
+}
+
+bool QueryEngine::Start() {
+  shared_ptr<IndexSet> index_set(new IndexSet());
+  if (!index_set->Load(index_files_, preload_, in_memory_)) {
+    return false;
+  }
+  index_set_ = index_set;
+  batch_threads_ = min(kMaxBatchThreads,
+                       max(2u, std::thread::hardware_concurrency()));
+  batch_pool_.reset(new ThreadPool(batch_threads_));
+
+  Verify333(pthread_create(&watcher_, nullptr, &WatchLoop,
+                           static_cast<void*>(this)) == 0);
+  watching_ = true;
+  return true;
+}
+
+void QueryEngine::NormalizeQuery(vector<string>* const query) {
+  for (string& word : *query) {
+    to_lower(word);
+  }
+  query->erase(std::remove(query->begin(), query->end(), string()),
+               query->end());
+  sort(query->begin(), query->end());
+  query->erase(unique(query->begin(), query->end()), query->end());
+}
+
+shared_ptr<const QueryAnswer> QueryEngine::ProcessQuery(
+    const vector<string>& query, size_t max_results) {
+  shared_ptr<const QueryAnswer> answer;
+  if (cache_.Lookup(query, max_results, &answer)) {
+    return answer;
+  }
+
+  // Take a reference to the current IndexSet, so a reload can't unmap it
+  // while we're searching.
+  shared_ptr<const IndexSet> index_set = CurrentIndexSet();
+
+  // If the same query is already being answered, from the same indices,
+  // and will produce enough results for us, wait for that answer rather
+  // than searching again.  A flight that started before a reload would
+  // hand us an answer from the old indices.
+  string key = QueryCache::MakeKey(query);
+  Verify333(pthread_mutex_lock(&flight_lock_) == 0);
+  auto it = flights_.find(key);
+  if (it != flights_.end() && it->second->max_results >= max_results &&
+      it->second->index_set == index_set) {
+    shared_future<shared_ptr<const QueryAnswer>> pending =
+      it->second->answer;
+    coalesced_++;
+    Verify333(pthread_mutex_unlock(&flight_lock_) == 0);
+    return pending.get();
+  }
+
+  // Otherwise we answer it, and identical queries that arrive while we're
+  // at it wait on us.  (If a smaller flight for this query is already
+  // running, ours takes over its slot for later arrivals.)
+  promise<shared_ptr<const QueryAnswer>> result;
+  shared_ptr<Flight> flight(new Flight{max_results, index_set,
+                                      result.get_future()});
+  flights_[key] = flight;
+  evaluations_++;
+  Verify333(pthread_mutex_unlock(&flight_lock_) == 0);
+
+  answer = Evaluate(index_set, query, max_results);
+  result.set_value(answer);
+
+  // The answer is in the cache now (if it fits), so later arrivals can
+  // find it there.
+  Verify333(pthread_mutex_lock(&flight_lock_) == 0);
+  it = flights_.find(key);
+  if (it != flights_.end() && it->second == flight) {
+    flights_.erase(it);
+  }
+  Verify333(pthread_mutex_unlock(&flight_lock_) == 0);
+  return answer;
+}
+
+vector<shared_ptr<const QueryAnswer>> QueryEngine::ProcessQueries(
+    const vector<vector<string>>& queries, size_t max_results) {
+  vector<shared_ptr<const QueryAnswer>> answers(queries.size());
+  if (queries.empty()) {
+    return answers;
+  }
+
+  // We answer queries too, so we need at most one helper per query after
+  // the first.
+  BatchState batch;
+  Verify333(pthread_mutex_init(&batch.lock, nullptr) == 0);
+  Verify333(pthread_cond_init(&batch.done, nullptr) == 0);
+  batch.next = 0;
+  batch.helpers = min<size_t>(queries.size() - 1, batch_threads_);
+  batch.queries = &queries;
+  batch.max_results = max_results;
+  batch.answers = &answers;
+
+  for (int i = 0; i < batch.helpers; i++) {
+    BatchTask* task = new BatchTask(BatchTask_ThrFn);
+    task->engine = this;
+    task->batch = &batch;
+    batch_pool_->Dispatch(task);
+  }
+  AnswerBatch(this, &batch);
+
+  Verify333(pthread_mutex_lock(&batch.lock) == 0);
+  while (batch.helpers > 0) {
+    Verify333(pthread_cond_wait(&batch.done, &batch.lock) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&batch.lock) == 0);
+  Verify333(pthread_cond_destroy(&batch.done) == 0);
+  Verify333(pthread_mutex_destroy(&batch.lock) == 0);
+  return answers;
+}
+
+void QueryEngine::BatchTask_ThrFn(ThreadPool::Task* t) {
+  unique_ptr<BatchTask> task(static_cast<BatchTask*>(t));
+  AnswerBatch(task->engine, task->batch);
+
+  // The batch lives on the issuing thread's stack, and that thread may
+  // return as soon as helpers hits zero; don't touch it after unlocking.
+  BatchState* batch = task->batch;
+  Verify333(pthread_mutex_lock(&batch->lock) == 0);
+  if (--batch->helpers == 0) {
+    Verify333(pthread_cond_signal(&batch->done) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&batch->lock) == 0);
+}
+
+void QueryEngine::Suggest(const string& prefix, size_t max_results,
+                          vector<SuggestTrie::Suggestion>* const suggestions) {
+  CurrentIndexSet()->Suggest(prefix, max_results, suggestions);
+}
+
+QueryEngine::Stats QueryEngine::GetStats() const {
+  Stats stats;
+  stats.cache = cache_.GetStats();
+  Verify333(pthread_mutex_lock(&flight_lock_) == 0);
+  stats.evaluations = evaluations_;
+  stats.coalesced = coalesced_;
+  stats.index_searches = index_searches_;
+  stats.index_searches_skipped = index_searches_skipped_;
+  Verify333(pthread_mutex_unlock(&flight_lock_) == 0);
+  return stats;
+}
+
+shared_ptr<const QueryAnswer> QueryEngine::Evaluate(
+    const shared_ptr<const IndexSet>& index_set,
+    const vector<string>& query, size_t max_results) {
+  uint64_t start = NowNanos();
+  shared_ptr<QueryAnswer> computed(new QueryAnswer());
+  size_t num_searched;
+  computed->results = index_set->ProcessQuery(query, max_results,
+                                              &computed->num_matches,
+                                              &num_searched);
+  computed->max_results = max_results;
+  computed->compute_ns = NowNanos() - start;
+
+  Verify333(pthread_mutex_lock(&flight_lock_) == 0);
+  index_searches_ += num_searched;
+  index_searches_skipped_ += index_set->size() - num_searched;
+  Verify333(pthread_mutex_unlock(&flight_lock_) == 0);
+
+  // Don't cache an answer from an IndexSet that has since been replaced;
+  // the reload has just cleared the cache, and the answer may be stale.
+  // A reload swaps index_set_ and clears the cache holding lock_, so
+  // checking and inserting under it too keeps a stale answer from
+  // slipping in between the two.
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (index_set == index_set_) {
+    cache_.Insert(query, computed);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return computed;
+}
+
+shared_ptr<const IndexSet> QueryEngine::CurrentIndexSet() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  shared_ptr<const IndexSet> index_set = index_set_;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return index_set;
+}
+
+void* QueryEngine::WatchLoop(void* engine) {
+  static_cast<QueryEngine*>(engine)->WatchIndices();
+  return nullptr;
+}
+
+void QueryEngine::WatchIndices() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  while (!stop_) {
+    // Sleep for a while, unless we're told to stop.
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += kWatchIntervalSeconds;
+    int res = pthread_cond_timedwait(&stop_cond_, &lock_, &deadline);
+    Verify333(res == 0 || res == ETIMEDOUT);
+    if (stop_) {
+      break;
+    }
+
+    shared_ptr<const IndexSet> current = index_set_;
+    Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+    // Loading can take a while, so do it without holding the lock.  If
+    // the new files don't load (say, one is still being written), keep
+    // serving the old ones and try again next time.
+    shared_ptr<IndexSet> fresh;
+    if (current->Changed()) {
+      fresh.reset(new IndexSet());
+      if (fresh->Load(index_files_, preload_, in_memory_)) {
+        cout << "  index files changed; reloaded them." << endl;
+      } else {
+        fresh.reset();
+      }
+    }
+
+    Verify333(pthread_mutex_lock(&lock_) == 0);
+    if (fresh != nullptr) {
+      index_set_ = fresh;
+      cache_.Clear();
+    }
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+}  // namespace hw4
@@ -0,0 +1,175 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_QUERYENGINE_H_
+#define HW4_QUERYENGINE_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <stdint.h>
+#include <future>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./IndexSet.h"
+#include "./QueryCache.h"
+#include "./ThreadPool.h"
+
+namespace hw4 {
+
+// The QueryEngine is everything between a parsed query and its results.
+// It owns the server's IndexSet and a QueryCache in front of it, and it
+// watches the index files: when one of them changes on disk, the engine
+// loads a fresh IndexSet, swaps it in, and clears the cache.  Queries that
+// are already running finish against the IndexSet they started with.
+//
+// Identical queries that miss the cache at the same time are coalesced:
+// the first one searches the indices, and the rest wait for its answer
+// instead of repeating the search.
+//
+// A batch of queries is answered in parallel by a pool of threads the
+// engine keeps for the purpose; each query in it goes through the cache
+// and the coalescing just like a query on its own.
+//
+// Index files should be replaced atomically (write a new file, then
+// rename() it over the old one); a file that is rewritten in place can be
+// read half-written.
+class QueryEngine {
+ public:
+  // The constructor just memorizes its arguments; call Start() to load
+  // the indices.  See IndexSet::Load() for the meaning of "preload" and
+  // "in_memory", and QueryCache for "cache_entries" and "cache_bytes".
+  QueryEngine(const std::list<std::string>& index_files,
+              bool preload,
+              bool in_memory,
+              size_t cache_entries,
+              size_t cache_bytes);
+
+  // The destructor stops the index watcher thread.
+  virtual ~QueryEngine();
+
+  // Loads the indices and starts watching them for changes.  Returns
+  // false if the indices couldn't be loaded.
+  bool Start();
+
+  // Turns the words of a query into the form the engine expects (and that
+  // the cache is keyed by): lower-cased, with duplicates and empty words
+  // removed, and sorted.
+  static void NormalizeQuery(std::vector<std::string>* const query);
+
+  // Answers a normalized query, computing at least its "max_results" best
+  // matches; see IndexSet::ProcessQuery().  The answer may come from the
+  // cache, or from an identical query that is being answered right now.
+  std::shared_ptr<const QueryAnswer> ProcessQuery(
+      const std::vector<std::string>& query, size_t max_results);
+
+  // Answers a batch of normalized queries, as ProcessQuery() would answer
+  // each of them, and returns the answers in the same order.  The queries
+  // are spread across the batch threads and the calling thread.
+  std::vector<std::shared_ptr<const QueryAnswer>> ProcessQueries(
+      const std::vector<std::vector<std::string>>& queries,
+      size_t max_results);
+
+  // Fills "suggestions" with up to "max_results" words that start with
+  // "prefix", most widely used first; see IndexSet::Suggest().
+  void Suggest(const std::string& prefix, size_t max_results,
+               std::vector<SuggestTrie::Suggestion>* const suggestions);
+
+  // A snapshot of the engine's counters.
+  struct Stats {
+    QueryCache::Stats cache;
+    uint64_t evaluations;  // queries actually run against the indices
+    uint64_t coalesced;    // queries that waited on an identical one
+
+    // Across all evaluations, how many index searches were run, and how
+    // many were skipped because an index's filter ruled the query out.
+    uint64_t index_searches;
+    uint64_t index_searches_skipped;
+  };
+  Stats GetStats() const;
+
+ private:
+  // A query that is being answered right now, from "index_set".
+  // Identical queries that want at most "max_results" results, from the
+  // same IndexSet, wait on "answer".
+  struct Flight {
+    size_t max_results;
+    std::shared_ptr<const IndexSet> index_set;
+    std::shared_future<std::shared_ptr<const QueryAnswer>> answer;
+  };
+
+  // Searches "index_set" for "query", times it, and caches the answer,
+  // unless "index_set" has been replaced in the meantime.
+  std::shared_ptr<const QueryAnswer> Evaluate(
+      const std::shared_ptr<const IndexSet>& index_set,
+      const std::vector<std::string>& query, size_t max_results);
+
+  // The ThreadPool task that helps answer a batch of queries.
+  class BatchTask;
+  static void BatchTask_ThrFn(ThreadPool::Task* t);
+
+  // Returns the IndexSet that new queries should use.
+  std::shared_ptr<const IndexSet> CurrentIndexSet();
+
+  // The index watcher thread, and its loop.
+  static void* WatchLoop(void* engine);
+  void WatchIndices();
+
+  // How often the watcher checks whether the index files changed.
+  static const int kWatchIntervalSeconds;
+
+  // The upper bound on the number of batch threads.
+  static const uint32_t kMaxBatchThreads;
+
+  std::list<std::string> index_files_;
+  bool preload_;
+  bool in_memory_;
+  QueryCache cache_;
+
+  // The queries being answered right now, keyed like the cache, and the
+  // counters in Stats; all guarded by flight_lock_.
+  mutable pthread_mutex_t flight_lock_;
+  std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+  uint64_t evaluations_;
+  uint64_t coalesced_;
+  uint64_t index_searches_;
+  uint64_t index_searches_skipped_;
+
+  // The current IndexSet, guarded by lock_.  Queries hold a reference to
+  // the IndexSet they're using, so replacing it here doesn't pull it out
+  // from under them.
+  pthread_mutex_t lock_;
+  std::shared_ptr<const IndexSet> index_set_;
+
+  // Tells the watcher thread to exit; guarded by lock_ and signaled
+  // through stop_cond_.
+  pthread_cond_t stop_cond_;
+  bool stop_;
+  bool watching_;
+  pthread_t watcher_;
+
+  // Helps answer batches of queries with its "batch_threads_" threads;
+  // created by Start().
+  uint32_t batch_threads_;
+  std::unique_ptr<ThreadPool> batch_pool_;
+
+  QueryEngine(const QueryEngine&) = delete;
+  QueryEngine& operator=(const QueryEngine&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_QUERYENGINE_H_
@@ -0,0 +1,258 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "./HttpUtils.h"
+#include "./RequestTracer.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::min;
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace hw4 {
+
+// static
+const size_t RequestTracer::kKeptRequests;
+// static
+const size_t RequestTracer::kMaxSpans;
+// static
+const size_t RequestTracer::kMaxUri;
+
+struct RequestTracer::TracedRequest {
+  struct Phase {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+  };
+
+  uint64_t start_ns;
+  uint64_t end_ns;
+  uint16_t status;
+  uint16_t uri_length;
+  bool uri_truncated;
+  uint8_t num_phases;
+  Phase phases[kMaxSpans];
+  char uri[kMaxUri];
+};
+
+struct RequestTracer::ThreadBuffer {
+  ThreadBuffer() : num_kept(0) {
+    Verify333(pthread_mutex_init(&lock, nullptr) == 0);
+  }
+  ~ThreadBuffer() {
+    Verify333(pthread_mutex_destroy(&lock) == 0);
+  }
+
+  uint32_t tid;  // the thread's track in the trace: 1, 2, ...
+  uint64_t random;  // xorshift64 state, for choosing requests to sample
+
+  // The request being traced; only the owning thread touches it.
+  TracedRequest current;
+
+  // The requests kept so far; the next goes in kept[num_kept %
+  // kKeptRequests].  Guarded by lock, which AppendChromeTrace() takes to
+  // read them.
+  pthread_mutex_t lock;
+  TracedRequest kept[kKeptRequests];
+  uint64_t num_kept;
+};
+
+// The phase a connection spends waiting for the client to send a request
+// isn't part of the request itself.
+static const char kWaitPhase[] = "wait";
+
+// The calling thread's buffer while it is tracing a request (else null).
+static thread_local void* tracing = nullptr;
+
+static uint64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Appends a nanosecond time or duration to "out" in microseconds, the
+// unit of the trace format.
+static void AppendMicros(uint64_t nanos, string* const out) {
+  char buffer[32];
+  int length = snprintf(buffer, sizeof(buffer), "%.3f", nanos / 1000.0);
+  out->append(buffer, length);
+}
+
+RequestTracer::RequestTracer(uint32_t sample_every)
+  : sample_every_(sample_every), start_ns_(MonotonicNanos()) { }
+
+RequestTracer::~RequestTracer() { }
+
+void RequestTracer::set_sample_every(uint32_t sample_every) {
+  sample_every_.store(sample_every, std::memory_order_relaxed);
+}
+
+uint32_t RequestTracer::sample_every() const {
+  return sample_every_.load(std::memory_order_relaxed);
+}
+
+void RequestTracer::BeginRequest() {
+  uint32_t sample_every = sample_every_.load(std::memory_order_relaxed);
+  if (sample_every == 0) {
+    return;
+  }
+  ThreadBuffer* buffer = GetThreadBuffer();
+  uint64_t x = buffer->random;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  buffer->random = x;
+  if (x % sample_every != 0) {
+    return;
+  }
+  buffer->current.num_phases = 0;
+  tracing = buffer;
+}
+
+void RequestTracer::EndRequest(string_view uri, uint16_t status) {
+  if (tracing == nullptr) {
+    return;
+  }
+  ThreadBuffer* buffer = static_cast<ThreadBuffer*>(tracing);
+  tracing = nullptr;
+
+  // The request starts when its first bytes arrive, when any wait for
+  // them ends.
+  TracedRequest* request = &buffer->current;
+  request->end_ns = MonotonicNanos();
+  request->start_ns = request->end_ns;
+  for (uint8_t i = 0; i < request->num_phases; i++) {
+    const TracedRequest::Phase& phase = request->phases[i];
+    if (phase.name != kWaitPhase) {
+      request->start_ns = min(request->start_ns, phase.start_ns);
+    }
+  }
+  request->status = status;
+  request->uri_length = min(uri.size(), kMaxUri);
+  memcpy(request->uri, uri.data(), request->uri_length);
+  request->uri_truncated = uri.size() > kMaxUri;
+
+  Verify333(pthread_mutex_lock(&buffer->lock) == 0);
+  buffer->kept[buffer->num_kept % kKeptRequests] = *request;
+  buffer->num_kept++;
+  Verify333(pthread_mutex_unlock(&buffer->lock) == 0);
+}
+
+void RequestTracer::AbortRequest() {
+  tracing = nullptr;
+}
+
+// static
+uint64_t RequestTracer::Now() {
+  return tracing == nullptr ? 0 : MonotonicNanos();
+}
+
+// static
+void RequestTracer::Span(const char* name, uint64_t start_ns) {
+  if (tracing == nullptr || start_ns == 0) {
+    return;
+  }
+  TracedRequest* request = &static_cast<ThreadBuffer*>(tracing)->current;
+  if (request->num_phases == kMaxSpans) {
+    return;
+  }
+  // "wait" is matched by address, so normalize it to ours.
+  if (strcmp(name, kWaitPhase) == 0) {
+    name = kWaitPhase;
+  }
+  request->phases[request->num_phases++] =
+    TracedRequest::Phase{name, start_ns, MonotonicNanos()};
+}
+
+void RequestTracer::AppendChromeTrace(string* const out) const {
+  vector<ThreadBuffer*> buffers = buffers_.Shards();
+
+  string pid = std::to_string(getpid());
+  out->append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  bool first = true;
+  vector<TracedRequest> requests;
+  for (ThreadBuffer* buffer : buffers) {
+    // Copy them out, so the thread isn't held up while we format them.
+    requests.clear();
+    Verify333(pthread_mutex_lock(&buffer->lock) == 0);
+    uint64_t num_kept = buffer->num_kept;
+    for (uint64_t i = num_kept - min<uint64_t>(num_kept, kKeptRequests);
+         i < num_kept; i++) {
+      requests.push_back(buffer->kept[i % kKeptRequests]);
+    }
+    Verify333(pthread_mutex_unlock(&buffer->lock) == 0);
+    if (requests.empty()) {
+      continue;
+    }
+
+    string tid = std::to_string(buffer->tid);
+    string ids = ",\"pid\":" + pid + ",\"tid\":" + tid;
+    if (!first) {
+      out->push_back(',');
+    }
+    first = false;
+    out->append("{\"name\":\"thread_name\",\"ph\":\"M\"" + ids +
+                ",\"args\":{\"name\":\"worker " + tid + "\"}}");
+
+    for (const TracedRequest& request : requests) {
+      string uri(request.uri, request.uri_length);
+      if (request.uri_truncated) {
+        uri += "...";
+      }
+      out->append(",{\"name\":\"");
+      AppendEscapedJson(uri, out);
+      out->append("\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":");
+      AppendMicros(request.start_ns - start_ns_, out);
+      out->append(",\"dur\":");
+      AppendMicros(request.end_ns - request.start_ns, out);
+      out->append(ids + ",\"args\":{\"status\":" +
+                  std::to_string(request.status) + "}}");
+
+      for (uint8_t i = 0; i < request.num_phases; i++) {
+        const TracedRequest::Phase& phase = request.phases[i];
+        out->append(",{\"name\":\"");
+        out->append(phase.name);
+        out->append("\",\"cat\":\"phase\",\"ph\":\"X\",\"ts\":");
+        AppendMicros(phase.start_ns - start_ns_, out);
+        out->append(",\"dur\":");
+        AppendMicros(phase.end_ns - phase.start_ns, out);
+        out->append(ids + "}");
+      }
+    }
+  }
+  out->append("]}\n");
+}
+
+RequestTracer::ThreadBuffer* RequestTracer::GetThreadBuffer() {
+  // The tracer owns the buffer, so its requests outlive the thread.
+  return buffers_.Get(&InitThreadBuffer);
+}
+
+// static
+void RequestTracer::InitThreadBuffer(ThreadBuffer* buffer, size_t number) {
+  buffer->tid = number;
+  buffer->random = (MonotonicNanos() ^ (buffer->tid * 0x9e3779b97f4a7c15)) | 1;
+}
+
+}  // namespace hw4
@@ -0,0 +1,101 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_REQUESTTRACER_H_
+#define HW4_REQUESTTRACER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <string_view>
+
+#include "./ThreadShards.h"
+
+namespace hw4 {
+
+// A RequestTracer records where the time goes in a sample of requests:
+// waiting for the client, reading the request, parsing it, answering it,
+// and writing the response.  AppendChromeTrace() dumps the most recent
+// ones in the Chrome trace_event format, for chrome://tracing or
+// https://ui.perfetto.dev.
+//
+// Each request is traced with probability 1 / "sample_every", or none if
+// that is 0; every thread draws from a random number generator of its
+// own.  The code being traced marks its phases with Now() and Span():
+//
+//   uint64_t start = RequestTracer::Now();
+//   ... parse the request ...
+//   RequestTracer::Span("parse", start);
+//
+// Outside a sampled request, both just check a thread_local and return,
+// so the calls can stay in production builds.  Within one, spans go into
+// a buffer belonging to the thread, which keeps its kKeptRequests most
+// recent traced requests.
+class RequestTracer {
+ public:
+  // The constructor just memorizes its argument.
+  explicit RequestTracer(uint32_t sample_every);
+  virtual ~RequestTracer();
+
+  // Changes how often requests are sampled; 0 turns tracing off.
+  void set_sample_every(uint32_t sample_every);
+  uint32_t sample_every() const;
+
+  // Called by a worker before it reads each request: starts tracing it if
+  // it is one to sample.  Then EndRequest() once its response has been
+  // written, or AbortRequest() if no request came.
+  void BeginRequest();
+  void EndRequest(std::string_view uri, uint16_t status);
+  void AbortRequest();
+
+  // Returns the time on the tracing clock (CLOCK_MONOTONIC, in
+  // nanoseconds) if the calling thread is tracing a request, and 0 if not.
+  static uint64_t Now();
+
+  // Records that the phase "name", which must be a string literal, ran
+  // from "start_ns" (from Now()) until now, if the calling thread is
+  // tracing a request.
+  static void Span(const char* name, uint64_t start_ns);
+
+  // Appends every kept request to "out" as a Chrome trace: a JSON object
+  // whose "traceEvents" are a complete ("X") event for each request and
+  // each of its phases, one track per worker thread.
+  void AppendChromeTrace(std::string* const out) const;
+
+ private:
+  // Each thread keeps this many traced requests, each with up to
+  // kMaxSpans phases, and up to kMaxUri bytes of its URI.
+  static const size_t kKeptRequests = 64;
+  static const size_t kMaxSpans = 16;
+  static const size_t kMaxUri = 200;
+
+  struct TracedRequest;
+  struct ThreadBuffer;
+
+  // Returns the calling thread's buffer, creating it on first use.
+  ThreadBuffer* GetThreadBuffer();
+
+  // Gives "buffer", the "number"th created, its track and its seed.
+  static void InitThreadBuffer(ThreadBuffer* buffer, size_t number);
+
+  std::atomic<uint32_t> sample_every_;
+  uint64_t start_ns_;
+
+  // Each buffer has a lock of its own.
+  ThreadShards<ThreadBuffer> buffers_;
+
+  RequestTracer(const RequestTracer&) = delete;
+  RequestTracer& operator=(const RequestTracer&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_REQUESTTRACER_H_
@@ -0,0 +1,244 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "./ServerMetrics.h"
+
+using std::min;
+using std::vector;
+
+namespace hw4 {
+
+// Each power of two is split into 1 << kSubBucketBits buckets; values of
+// 1 << kMaxValueBits nanoseconds or more land in the last one.
+static const int kSubBucketBits = 4;
+static const int kSubBuckets = 1 << kSubBucketBits;
+static const int kMaxValueBits = 36;
+static const int kNumBuckets =
+  (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets;
+
+static uint64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Adds "n" to a counter that only the calling thread writes.  A plain
+// load and store is enough, and unlike fetch_add() takes no bus lock.
+static void Bump(std::atomic<uint64_t>* const counter, uint64_t n = 1) {
+  counter->store(counter->load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+}
+
+// Returns the bucket "value" falls into.  Values below kSubBuckets get a
+// bucket each; above that, the bucket is the value's power of two and
+// the kSubBucketBits bits below its leading one.
+static int BucketOf(uint64_t value) {
+  if (value < static_cast<uint64_t>(kSubBuckets)) {
+    return value;
+  }
+  value = min(value, (uint64_t{1} << kMaxValueBits) - 1);
+  int top = 63 - __builtin_clzll(value);
+  int sub = (value >> (top - kSubBucketBits)) & (kSubBuckets - 1);
+  return (top - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+// Returns the middle of the values that fall into "bucket".
+static uint64_t BucketMidpoint(int bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  int top = bucket / kSubBuckets + kSubBucketBits - 1;
+  uint64_t sub = bucket % kSubBuckets;
+  uint64_t width = uint64_t{1} << (top - kSubBucketBits);
+  return (kSubBuckets + sub) * width + width / 2;
+}
+
+const char* RouteName(Route route) {
+  switch (route) {
+    case Route::kStatic:
+      return "static";
+    case Route::kQuery:
+      return "query";
+    case Route::kSuggest:
+      return "suggest";
+    case Route::kApiQuery:
+      return "api_query";
+    case Route::kBatch:
+      return "batch";
+    case Route::kStats:
+      return "stats";
+    case Route::kDebug:
+      return "debug";
+    case Route::kNotFound:
+      return "not_found";
+    case Route::kRefused:
+      return "refused";
+  }
+  return "unknown";
+}
+
+struct ServerMetrics::Histogram {
+  void Record(uint64_t value) {
+    Bump(&buckets[BucketOf(value)]);
+    Bump(&count);
+    Bump(&sum, value);
+    if (value > max.load(std::memory_order_relaxed)) {
+      max.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint64_t> buckets[kNumBuckets] = {};
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> sum{0};
+  std::atomic<uint64_t> max{0};
+};
+
+// One thread's metrics.  Aligned so that no two threads' shards share a
+// cache line.
+struct alignas(64) ServerMetrics::Shard {
+  std::atomic<uint64_t> accepts{0};
+  std::atomic<uint64_t> connections_opened{0};
+  std::atomic<uint64_t> connections_closed{0};
+  std::atomic<uint64_t> requests_started{0};
+  std::atomic<uint64_t> requests_finished{0};
+  std::atomic<uint64_t> bytes_in{0};
+  std::atomic<uint64_t> bytes_out{0};
+  Histogram routes[kNumRoutes];
+  Histogram queue_wait;
+};
+
+ServerMetrics::ServerMetrics() : start_ns_(MonotonicNanos()) { }
+
+ServerMetrics::~ServerMetrics() { }
+
+void ServerMetrics::RecordAccept() {
+  Bump(&ThreadShard()->accepts);
+}
+
+void ServerMetrics::RecordConnectionOpened(uint64_t queue_wait_ns) {
+  Shard* shard = ThreadShard();
+  Bump(&shard->connections_opened);
+  shard->queue_wait.Record(queue_wait_ns);
+}
+
+void ServerMetrics::RecordConnectionClosed() {
+  Bump(&ThreadShard()->connections_closed);
+}
+
+void ServerMetrics::RecordRequestStarted() {
+  Bump(&ThreadShard()->requests_started);
+}
+
+void ServerMetrics::RecordRequestFinished(Route route, uint64_t latency_ns,
+                                          uint64_t bytes_in,
+                                          uint64_t bytes_out) {
+  Shard* shard = ThreadShard();
+  shard->routes[static_cast<int>(route)].Record(latency_ns);
+  Bump(&shard->bytes_in, bytes_in);
+  Bump(&shard->bytes_out, bytes_out);
+  Bump(&shard->requests_finished);
+}
+
+ServerMetrics::Snapshot ServerMetrics::GetSnapshot() const {
+  Snapshot snapshot = {};
+  snapshot.uptime_ns = MonotonicNanos() - start_ns_;
+
+  uint64_t closed = 0, finished = 0;
+  vector<const Histogram*> routes[kNumRoutes];
+  vector<const Histogram*> queue_wait;
+  for (Shard* shard : shards_.Shards()) {
+    snapshot.accepts += shard->accepts.load(std::memory_order_relaxed);
+    snapshot.connections +=
+      shard->connections_opened.load(std::memory_order_relaxed);
+    closed += shard->connections_closed.load(std::memory_order_relaxed);
+    snapshot.active_connections +=
+      shard->requests_started.load(std::memory_order_relaxed);
+    finished += shard->requests_finished.load(std::memory_order_relaxed);
+    snapshot.bytes_in += shard->bytes_in.load(std::memory_order_relaxed);
+    snapshot.bytes_out += shard->bytes_out.load(std::memory_order_relaxed);
+    for (int i = 0; i < kNumRoutes; i++) {
+      routes[i].push_back(&shard->routes[i]);
+    }
+    queue_wait.push_back(&shard->queue_wait);
+  }
+
+  // The shards are read while their threads go on writing them, so the
+  // totals can be a request or two out of step with each other; don't let
+  // that make a gauge go negative.
+  snapshot.open_connections =
+    snapshot.connections - min(closed, snapshot.connections);
+  snapshot.active_connections -= min(finished, snapshot.active_connections);
+  snapshot.active_connections =
+    min(snapshot.active_connections, snapshot.open_connections);
+
+  for (int i = 0; i < kNumRoutes; i++) {
+    snapshot.routes[i] = Summarize(routes[i]);
+  }
+  snapshot.queue_wait = Summarize(queue_wait);
+  return snapshot;
+}
+
+ServerMetrics::Shard* ServerMetrics::ThreadShard() {
+  // The metrics own the shard, so its counts outlive the thread.
+  return shards_.Get();
+}
+
+// static
+LatencySummary ServerMetrics::Summarize(
+    const vector<const Histogram*>& histograms) {
+  LatencySummary summary = {};
+  vector<uint64_t> buckets(kNumBuckets, 0);
+  for (const Histogram* histogram : histograms) {
+    for (int i = 0; i < kNumBuckets; i++) {
+      buckets[i] += histogram->buckets[i].load(std::memory_order_relaxed);
+    }
+    summary.sum_ns += histogram->sum.load(std::memory_order_relaxed);
+    summary.max_ns = std::max(summary.max_ns,
+                              histogram->max.load(std::memory_order_relaxed));
+  }
+  // Count from the buckets themselves, so the quantiles are consistent.
+  for (uint64_t n : buckets) {
+    summary.count += n;
+  }
+  if (summary.count == 0) {
+    return summary;
+  }
+
+  // Walk the buckets once, picking off each quantile as its rank goes by.
+  struct {
+    double quantile;
+    uint64_t* value;
+  } wanted[] = {
+    {0.5, &summary.p50_ns},
+    {0.9, &summary.p90_ns},
+    {0.99, &summary.p99_ns},
+    {0.999, &summary.p999_ns},
+  };
+  size_t next = 0;
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets && next < 4; i++) {
+    seen += buckets[i];
+    while (next < 4 &&
+           seen >= static_cast<uint64_t>(wanted[next].quantile *
+                                         (summary.count - 1)) + 1) {
+      *wanted[next].value = min(BucketMidpoint(i), summary.max_ns);
+      next++;
+    }
+  }
+  return summary;
+}
+
+}  // namespace hw4
@@ -0,0 +1,115 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_SERVERMETRICS_H_
+#define HW4_SERVERMETRICS_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "./ThreadShards.h"
+
+namespace hw4 {
+
+// The kinds of request the server answers, as far as its metrics are
+// concerned.  Any request answered with a 404 counts as kNotFound, and
+// any whose body the server refused to read (411, 413, 501, or a 400
+// for a bad Content-Length) as kRefused.
+enum class Route {
+  kStatic,
+  kQuery,
+  kSuggest,
+  kApiQuery,
+  kBatch,
+  kStats,
+  kDebug,
+  kNotFound,
+  kRefused,
+};
+const int kNumRoutes = 9;
+
+// Returns a printable name for "route", e.g. "static".
+const char* RouteName(Route route);
+
+// A summary of a set of latencies.  Quantiles are accurate to within
+// about 3%.
+struct LatencySummary {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t p50_ns, p90_ns, p99_ns, p999_ns;
+};
+
+// ServerMetrics counts what the server does: connections, requests and
+// their latencies, and bytes.
+//
+// Each thread that records something gets a shard of counters and
+// latency histograms of its own, which only it writes, so recording
+// takes no lock and no atomic read-modify-write, and threads never
+// contend for a cache line.  GetSnapshot() adds the shards up.
+//
+// The histograms are log-linear, in the manner of HdrHistogram: each
+// power of two of nanoseconds, up to about a minute, is split into 16
+// buckets.
+class ServerMetrics {
+ public:
+  ServerMetrics();
+  virtual ~ServerMetrics();
+
+  // The server accepted a connection.
+  void RecordAccept();
+
+  // A worker thread picked up a connection, "queue_wait_ns" after it was
+  // accepted, and later closed it.
+  void RecordConnectionOpened(uint64_t queue_wait_ns);
+  void RecordConnectionClosed();
+
+  // A worker started answering a request; then it finished, taking
+  // "latency_ns", having read "bytes_in" bytes of the request and written
+  // "bytes_out" bytes of response.
+  void RecordRequestStarted();
+  void RecordRequestFinished(Route route, uint64_t latency_ns,
+                             uint64_t bytes_in, uint64_t bytes_out);
+
+  struct Snapshot {
+    uint64_t uptime_ns;
+    uint64_t accepts;
+    uint64_t connections;         // ever picked up by a worker
+    uint64_t open_connections;    // picked up and not yet closed
+    uint64_t active_connections;  // of those, in the middle of a request
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    LatencySummary routes[kNumRoutes];  // indexed by Route
+    LatencySummary queue_wait;
+  };
+  Snapshot GetSnapshot() const;
+
+ private:
+  struct Histogram;
+  struct Shard;
+
+  // Returns the calling thread's shard, creating it on first use.
+  Shard* ThreadShard();
+
+  // Summarizes the sum of "histograms".
+  static LatencySummary Summarize(const std::vector<const Histogram*>&
+                                  histograms);
+
+  uint64_t start_ns_;
+  ThreadShards<Shard> shards_;
+
+  ServerMetrics(const ServerMetrics&) = delete;
+  ServerMetrics& operator=(const ServerMetrics&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_SERVERMETRICS_H_
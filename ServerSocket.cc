@@ -105,6 +105,11 @@ bool ServerSocket::BindAndListen(int ai_family, int* const listen_fd) {
   return true;
 }
 
+void ServerSocket::Shutdown() const {
+  if (listen_sock_fd_ != -1)
+    shutdown(listen_sock_fd_, SHUT_RDWR);
+}
+
 bool ServerSocket::Accept(int* const accepted_fd,
                           std::string* const client_addr,
                           uint16_t* const client_port,
@@ -124,7 +129,9 @@ bool ServerSocket::Accept(int* const accepted_fd,
   *accepted_fd = accept(listen_sock_fd_,
     reinterpret_cast<struct sockaddr*>(&c_addr_info), &c_addr_len);
   if (*accepted_fd == -1) {
-    cerr << "Failed to accept: " << strerror(errno) << endl;
+    // EINVAL just means that Shutdown() was called.
+    if (errno != EINVAL)
+      cerr << "Failed to accept: " << strerror(errno) << endl;
     return false;
   }
 
@@ -85,6 +85,11 @@ class ServerSocket {
               std::string* const server_addr,
               std::string* const server_dns_name) const;
 
+  // Shuts the listening socket down, if it is open, so that a thread
+  // blocked in Accept() (or that calls it later) fails at once.  Safe to
+  // call from another thread, once BindAndListen() has returned.
+  void Shutdown() const;
+
  private:
   uint16_t port_;
   int listen_sock_fd_;
@@ -0,0 +1,248 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./SuggestTrie.h"
+
+using std::max;
+using std::min;
+using std::pair;
+using std::priority_queue;
+using std::sort;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+void SuggestTrie::Build(const vector<pair<string, uint32_t>>& words) {
+  nodes_.clear();
+  labels_.clear();
+  num_words_ = words.size();
+
+  Node root;
+  root.label_offset = 0;
+  root.label_length = 0;
+  root.first_child = 0;
+  root.num_children = 0;
+  root.weight = 0;
+  root.first_word = 0;
+  nodes_.push_back(root);
+  nodes_[0].max_weight = BuildChildren(words, 0, 0, words.size(), 0);
+
+  nodes_.shrink_to_fit();
+  labels_.shrink_to_fit();
+}
+
+uint32_t SuggestTrie::BuildChildren(
+    const vector<pair<string, uint32_t>>& words,
+    uint32_t node, size_t begin, size_t end, size_t depth) {
+  if (begin == end) {
+    return 0;
+  }
+
+  // The words are sorted, so each child's words -- the ones with the same
+  // next character -- are a contiguous run.  Lay the children out next
+  // to each other, then fill each one in.
+  vector<size_t> runs;  // where each child's run of words begins
+  for (size_t i = begin; i < end; i++) {
+    if (i == begin || words[i].first[depth] != words[i - 1].first[depth]) {
+      runs.push_back(i);
+    }
+  }
+  runs.push_back(end);
+  uint32_t first_child = nodes_.size();
+  uint16_t num_children = runs.size() - 1;
+  nodes_.resize(first_child + num_children);
+  nodes_[node].first_child = first_child;
+  nodes_[node].num_children = num_children;
+
+  uint32_t max_weight = 0;
+  for (uint16_t k = 0; k < num_children; k++) {
+    size_t run_begin = runs[k], run_end = runs[k + 1];
+    const string& first = words[run_begin].first;
+    const string& last = words[run_end - 1].first;
+
+    // The child's label runs as far as all of its words agree, which (since
+    // they're sorted) is as far as the first and last of them agree.
+    size_t common = depth + 1;
+    size_t limit = min(first.size(), last.size());
+    while (common < limit && first[common] == last[common]) {
+      common++;
+    }
+
+    uint32_t child = first_child + k;
+    Node& n = nodes_[child];
+    n.label_offset = labels_.size();
+    n.label_length = common - depth;
+    n.first_child = 0;
+    n.num_children = 0;
+    n.weight = 0;
+    n.first_word = run_begin;
+    labels_.append(first, depth, common - depth);
+
+    // If the first word ends here, it's this node's word.
+    size_t rest = run_begin;
+    if (first.size() == common) {
+      n.weight = max<uint32_t>(words[run_begin].second, 1);
+      rest++;
+    }
+    uint32_t child_max = n.weight;
+    child_max = max(child_max,
+                    BuildChildren(words, child, rest, run_end, common));
+    nodes_[child].max_weight = child_max;  // "n" may have moved
+    max_weight = max(max_weight, child_max);
+  }
+
+  // Now that their weights are known, put the heaviest child first.
+  // Nothing points at a child but its parent's range, so the children
+  // can be moved around within it.
+  sort(nodes_.begin() + first_child,
+       nodes_.begin() + first_child + num_children, Heavier);
+  return max_weight;
+}
+
+uint32_t SuggestTrie::FindPrefix(const string& prefix,
+                                 string* const spelled) const {
+  uint32_t node = 0;
+  spelled->clear();
+  while (spelled->size() < prefix.size()) {
+    // Look for the child whose label starts with the next character.
+    // There are at most a few dozen children, in order of weight.
+    const Node& parent = nodes_[node];
+    char c = prefix[spelled->size()];
+    uint32_t child = parent.first_child;
+    uint32_t end = parent.first_child + parent.num_children;
+    while (child < end && labels_[nodes_[child].label_offset] != c) {
+      child++;
+    }
+    if (child == end) {
+      return nodes_.size();
+    }
+
+    // The prefix may end partway through the label.
+    const Node& n = nodes_[child];
+    size_t length = min<size_t>(n.label_length,
+                                prefix.size() - spelled->size());
+    if (memcmp(labels_.data() + n.label_offset,
+               prefix.data() + spelled->size(), length) != 0) {
+      return nodes_.size();
+    }
+    spelled->append(labels_, n.label_offset, n.label_length);
+    node = child;
+  }
+  return node;
+}
+
+void SuggestTrie::Complete(const string& prefix, size_t max_results,
+                           vector<Suggestion>* const suggestions) const {
+  suggestions->clear();
+  if (nodes_.empty() || max_results == 0) {
+    return;
+  }
+  string spelled;
+  uint32_t start = FindPrefix(prefix, &spelled);
+  if (start == nodes_.size()) {
+    return;
+  }
+
+  // A best-first search.  An entry is either a whole subtree, which is
+  // worth at most its max_weight, or a single word, worth its weight; the
+  // heap yields them from most to least valuable, breaking ties toward
+  // the alphabetically first word.  A subtree is worth at least as much
+  // as anything in it, so words come off the heap in exactly the order
+  // we want, and we can stop after the first "max_results" of them.
+  //
+  // Children are sorted by weight, so a node's next child never needs to
+  // be on the heap before the one ahead of it comes off.
+  //
+  // Nodes don't know their parents, so "steps" records how the search
+  // reached each node it pushed, to spell out the words it finds.
+  struct Step {
+    uint32_t node;
+    uint32_t previous;  // the step that reached its parent
+  };
+  struct Entry {
+    uint32_t weight;
+    uint32_t first_word;
+    uint32_t step;
+    bool is_word;
+  };
+  auto lower = [](const Entry& a, const Entry& b) {
+    if (a.weight != b.weight) {
+      return a.weight < b.weight;
+    }
+    return a.first_word > b.first_word;
+  };
+  priority_queue<Entry, vector<Entry>, decltype(lower)> heap(lower);
+  vector<Step> steps;
+  steps.push_back(Step{start, 0});
+  heap.push(Entry{nodes_[start].max_weight, nodes_[start].first_word, 0,
+                  false});
+
+  while (!heap.empty() && suggestions->size() < max_results) {
+    Entry top = heap.top();
+    heap.pop();
+    Step step = steps[top.step];
+    const Node& node = nodes_[step.node];
+
+    if (top.is_word) {
+      // Spell the word out by walking back up to the start.
+      vector<uint32_t> path;
+      for (uint32_t s = top.step; s != 0; s = steps[s].previous) {
+        path.push_back(steps[s].node);
+      }
+      string word = spelled;
+      for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        word.append(labels_, nodes_[*it].label_offset,
+                    nodes_[*it].label_length);
+      }
+      suggestions->push_back(Suggestion{word, node.weight});
+      continue;
+    }
+
+    // The node's own word, if it has one...
+    if (node.weight != 0) {
+      heap.push(Entry{node.weight, node.first_word, top.step, true});
+    }
+    // ...its heaviest child...
+    if (node.num_children > 0) {
+      uint32_t child = node.first_child;
+      steps.push_back(Step{child, top.step});
+      heap.push(Entry{nodes_[child].max_weight, nodes_[child].first_word,
+                      static_cast<uint32_t>(steps.size() - 1), false});
+    }
+    // ...and, now that it's off the heap, its next sibling.
+    if (top.step != 0) {
+      const Node& parent = nodes_[steps[step.previous].node];
+      uint32_t sibling = step.node + 1;
+      if (sibling < parent.first_child + parent.num_children) {
+        steps.push_back(Step{sibling, step.previous});
+        heap.push(Entry{nodes_[sibling].max_weight,
+                        nodes_[sibling].first_word,
+                        static_cast<uint32_t>(steps.size() - 1), false});
+      }
+    }
+  }
+}
+
+size_t SuggestTrie::MemoryBytes() const {
+  return sizeof(*this) + nodes_.capacity() * sizeof(Node) +
+         labels_.capacity();
+}
+
+}  // namespace hw4
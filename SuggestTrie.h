@@ -0,0 +1,110 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_SUGGESTTRIE_H_
+#define HW4_SUGGESTTRIE_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint32_t, etc.
+#include <string>    // for std::string
+#include <utility>   // for std::pair
+#include <vector>    // for std::vector
+
+namespace hw4 {
+
+// A SuggestTrie completes word prefixes for the search box: given a
+// prefix, it returns the words that start with it, most common first.
+//
+// It is a compressed (radix) trie: a chain of nodes with one child each
+// is collapsed into a single node whose label is the whole chain, so the
+// trie has fewer nodes than there are words, and the labels are packed
+// into one string.  Every node also records the largest weight of any
+// word beneath it, and keeps its children in order of that weight.  That
+// lets Complete() go straight to the heaviest completions: it expands
+// the most promising node first, only looks at a node's next child once
+// it has taken the one before, and stops as soon as it has found enough
+// words, without visiting the rest of the prefix's subtree.
+//
+// A SuggestTrie is read-only once built, so any number of threads can
+// share it.
+class SuggestTrie {
+ public:
+  // One completion: a word, and its weight (e.g., the number of
+  // documents it appears in).
+  struct Suggestion {
+    std::string word;
+    uint32_t weight;
+  };
+
+  SuggestTrie() : num_words_(0) { }
+  virtual ~SuggestTrie() { }
+
+  // Builds the trie from "words", a list of (word, weight) pairs sorted
+  // by word, with no duplicates or empty words, replacing whatever the
+  // trie held before.  Weights should be positive; a weight of zero is
+  // treated as one.
+  void Build(const std::vector<std::pair<std::string, uint32_t>>& words);
+
+  // Fills "suggestions" with up to "max_results" words that start with
+  // "prefix", from highest to lowest weight; words of equal weight come
+  // in alphabetical order.
+  void Complete(const std::string& prefix, size_t max_results,
+                std::vector<Suggestion>* const suggestions) const;
+
+  // The number of words in the trie.
+  size_t size() const { return num_words_; }
+
+  // The number of bytes of memory the trie holds onto.
+  size_t MemoryBytes() const;
+
+ private:
+  struct Node {
+    uint32_t label_offset;  // the label is labels_[label_offset, +length)
+    uint32_t first_child;   // children are nodes_[first_child, +num)
+    uint32_t weight;        // the word ending here's weight, or 0
+    uint32_t max_weight;    // the largest weight in this subtree
+    uint32_t first_word;    // alphabetical rank of the subtree's 1st word
+    uint16_t label_length;
+    uint16_t num_children;
+  };
+
+  // Returns true if nodes_[a]'s subtree should be searched before
+  // nodes_[b]'s: it has a heavier word, or the same weight but an
+  // alphabetically earlier first word.
+  static bool Heavier(const Node& a, const Node& b) {
+    if (a.max_weight != b.max_weight) {
+      return a.max_weight > b.max_weight;
+    }
+    return a.first_word < b.first_word;
+  }
+
+  // Fills in the children of nodes_[node], which stands for
+  // words[begin, end) up to their first "depth" characters, and returns
+  // the largest weight among them.
+  uint32_t BuildChildren(
+      const std::vector<std::pair<std::string, uint32_t>>& words,
+      uint32_t node, size_t begin, size_t end, size_t depth);
+
+  // Returns the node whose subtree holds exactly the words that start
+  // with "prefix", and sets "spelled" to the string it stands for (which
+  // may run past the prefix).  Returns nodes_.size() if no word does.
+  uint32_t FindPrefix(const std::string& prefix,
+                      std::string* const spelled) const;
+
+  // nodes_[0] is the root, with an empty label.
+  std::vector<Node> nodes_;
+  std::string labels_;
+  size_t num_words_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_SUGGESTTRIE_H_
@@ -100,6 +100,20 @@ void ThreadPool::Dispatch(Task* t) {
   Verify333(pthread_mutex_unlock(&q_lock_) == 0);
 }
 
+size_t ThreadPool::QueueLength() {
+  Verify333(pthread_mutex_lock(&q_lock_) == 0);
+  size_t length = work_queue_.size();
+  Verify333(pthread_mutex_unlock(&q_lock_) == 0);
+  return length;
+}
+
+uint32_t ThreadPool::NumThreads() {
+  Verify333(pthread_mutex_lock(&q_lock_) == 0);
+  uint32_t num_threads = num_threads_running_;
+  Verify333(pthread_mutex_unlock(&q_lock_) == 0);
+  return num_threads;
+}
+
 // This is the main loop that all worker threads are born into.  They
 // wait for a signal on the work queue condition variable, then they
 // grab work off the queue.  Threads return (i.e., terminate)
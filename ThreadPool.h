@@ -60,6 +60,11 @@ class ThreadPool {
   // worker thread.
   void Dispatch(Task* t);
 
+  // Returns the number of Tasks waiting for a worker thread, and the
+  // number of worker threads.
+  size_t QueueLength();
+  uint32_t NumThreads();
+
   // A lock and condition variable that worker threads and the
   // Dispatch function use to guard the Task queue.
   pthread_mutex_t q_lock_;
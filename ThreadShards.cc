@@ -0,0 +1,41 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <atomic>
+
+#include "./ThreadShards.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+namespace hw4 {
+
+// Every ThreadShards' id, whatever its type.
+static std::atomic<uint64_t> next_shards_id(1);
+
+ThreadShardsBase::ThreadShardsBase() : id_(next_shards_id++) {
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+ThreadShardsBase::~ThreadShardsBase() {
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+void ThreadShardsBase::Lock() const {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+}
+
+void ThreadShardsBase::Unlock() const {
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+}  // namespace hw4
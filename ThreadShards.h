@@ -0,0 +1,115 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_THREADSHARDS_H_
+#define HW4_THREADSHARDS_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread threading/mutex functions
+}
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+namespace hw4 {
+
+// What every ThreadShards has, whatever its shards hold.
+class ThreadShardsBase {
+ protected:
+  ThreadShardsBase();
+  ~ThreadShardsBase();
+
+  void Lock() const;
+  void Unlock() const;
+
+  // Distinguishes this set of shards from any other of the same type the
+  // calling thread has used, so Get() can cache its shard in a
+  // thread_local.  0 is never used.
+  const uint64_t id_;
+
+ private:
+  mutable pthread_mutex_t lock_;
+
+  ThreadShardsBase(const ThreadShardsBase&) = delete;
+  ThreadShardsBase& operator=(const ThreadShardsBase&) = delete;
+};
+
+// A ThreadShards gives each thread that asks a "Shard" of its own, which
+// only that thread writes: a ring of log records, a set of counters, and
+// so on.  Get() finds the calling thread's shard through a thread_local
+// cache, so after a thread's first call it takes no lock.  Each Shard
+// type has its own cache, so a thread that uses, say, a log and a set of
+// metrics finds both without a miss; only one ThreadShards of a type is
+// cached per thread at a time.
+//
+// The ThreadShards owns the shards, so a shard outlives its thread, and
+// Shards() can visit every one of them while their threads go on
+// writing them.
+template <typename Shard>
+class ThreadShards : public ThreadShardsBase {
+ public:
+  ThreadShards() { }
+
+  // Returns the calling thread's shard, creating it on first use.
+  Shard* Get() { return Get([](Shard*, size_t) { }); }
+
+  // Like Get(), but calls "on_create(shard, number)" on a shard it
+  // creates, where "number" counts shards from 1 in order of creation.
+  // It's called before Shards() can return the shard, so whatever it
+  // sets needn't be atomic for the threads that call Shards() to read.
+  template <typename Fn>
+  Shard* Get(Fn on_create) {
+    Cache& cache = ThreadCache();
+    if (cache.id == id_) {
+      return cache.shard;
+    }
+
+    Shard* shard = new Shard();
+    Lock();
+    shards_.emplace_back(shard);
+    on_create(shard, shards_.size());
+    Unlock();
+    cache.id = id_;
+    cache.shard = shard;
+    return shard;
+  }
+
+  // Returns every shard so far, in order of creation.
+  std::vector<Shard*> Shards() const {
+    std::vector<Shard*> shards;
+    Lock();
+    shards.reserve(shards_.size());
+    for (const std::unique_ptr<Shard>& shard : shards_) {
+      shards.push_back(shard.get());
+    }
+    Unlock();
+    return shards;
+  }
+
+ private:
+  // The calling thread's last shard of this type, and whose it is.
+  struct Cache {
+    uint64_t id = 0;
+    Shard* shard = nullptr;
+  };
+  static Cache& ThreadCache() {
+    static thread_local Cache cache;
+    return cache;
+  }
+
+  // Guarded by the lock; a shard's contents are not.
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_THREADSHARDS_H_
@@ -0,0 +1,255 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>  // for htonl(), ntohl()
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "./TrafficRecorder.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace hw4 {
+
+// A single-producer, single-consumer ring of bytes, holding records
+// just as they go in the file: only the thread that owns it advances
+// head, and only the writer thread advances tail.  Both count bytes
+// ever, so head - tail is the number waiting.
+struct TrafficRecorder::Ring {
+  char bytes[kRingBytes];
+
+  // Written by the owning thread.
+  alignas(64) std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> records{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> oversize{0};
+
+  // Written by the writer thread.
+  alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+static const char kMagic[8] = {'H', 'T', 'T', 'P', '3', '3', '3', 'R'};
+static const uint32_t kVersion = 1;
+static const size_t kHeaderBytes = sizeof(kMagic) + 4 + 4 + 8;
+static const size_t kRecordHeaderBytes = 8 + 4;
+
+// Formatted records are written out whenever they grow past this.
+static const size_t kFlushBytes = 256 * 1024;
+
+// The calling thread's random number generator (xorshift64; 0 until it
+// is seeded).
+static thread_local uint64_t thread_random = 0;
+
+static uint64_t ClockNanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Adds "value" to "out" in network byte order.
+static void AppendUint32(uint32_t value, string* const out) {
+  uint32_t raw = htonl(value);
+  out->append(reinterpret_cast<const char*>(&raw), sizeof(raw));
+}
+
+static void AppendUint64(uint64_t value, string* const out) {
+  AppendUint32(value >> 32, out);
+  AppendUint32(static_cast<uint32_t>(value), out);
+}
+
+// Reads an integer in network byte order from "from".
+static uint32_t ReadUint32(const char* from) {
+  uint32_t raw;
+  memcpy(&raw, from, sizeof(raw));
+  return ntohl(raw);
+}
+
+static uint64_t ReadUint64(const char* from) {
+  return (static_cast<uint64_t>(ReadUint32(from)) << 32) |
+         ReadUint32(from + 4);
+}
+
+// Copies "length" bytes from "from" into the ring "ring" of "ring_size"
+// bytes, starting at "pos" (which counts bytes ever), wrapping around.
+static void CopyIntoRing(const char* from, size_t length, char* ring,
+                         size_t ring_size, uint64_t pos) {
+  size_t start = pos & (ring_size - 1);
+  size_t first = std::min(length, ring_size - start);
+  memcpy(ring + start, from, first);
+  memcpy(ring, from + first, length - first);
+}
+
+TrafficRecorder::TrafficRecorder(const string& file_name,
+                                 uint32_t sample_every)
+  : file_name_(file_name), sample_every_(sample_every), start_ns_(0),
+    writer_(kFlushMillis) { }
+
+TrafficRecorder::~TrafficRecorder() {
+  Stop();
+}
+
+bool TrafficRecorder::Start() {
+  int fd = open(file_name_.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC,
+                0644);
+  if (fd == -1) {
+    return false;
+  }
+  start_ns_ = ClockNanos(CLOCK_MONOTONIC);
+  string header(kMagic, sizeof(kMagic));
+  AppendUint32(kVersion, &header);
+  AppendUint32(sample_every_, &header);
+  AppendUint64(ClockNanos(CLOCK_REALTIME), &header);
+  BatchWriter::WriteAll(fd, &header);
+
+  writer_.Start(fd, [this](string* const out) {
+      for (Ring* ring : rings_.Shards()) {
+        Drain(ring, out);
+        if (out->size() >= kFlushBytes) {
+          writer_.Write(out);
+        }
+      }
+    });
+  return true;
+}
+
+void TrafficRecorder::Stop() {
+  writer_.Stop();
+}
+
+void TrafficRecorder::Record(string_view header, string_view body) {
+  if (sample_every_ == 0) {
+    return;
+  }
+  if (sample_every_ > 1) {
+    uint64_t x = thread_random;
+    if (x == 0) {
+      x = (ClockNanos(CLOCK_MONOTONIC) ^
+           reinterpret_cast<uintptr_t>(&thread_random)) | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    thread_random = x;
+    if (x % sample_every_ != 0) {
+      return;
+    }
+  }
+
+  // Only this thread writes its ring's counters, so they needn't be
+  // atomic read-modify-writes.  The recorder owns the ring, so it
+  // outlives the thread if need be.
+  Ring* ring = rings_.Get();
+  size_t length = header.size() + 4 + body.size();
+  if (length > kMaxRequestBytes) {
+    ring->oversize.store(ring->oversize.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    return;
+  }
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (kRingBytes - (head - ring->tail.load(std::memory_order_acquire)) <
+      kRecordHeaderBytes + length) {
+    ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    return;
+  }
+
+  string record_header;
+  AppendUint64(ClockNanos(CLOCK_MONOTONIC) - start_ns_, &record_header);
+  AppendUint32(length, &record_header);
+  uint64_t pos = head;
+  for (string_view part : {string_view(record_header), header,
+                           string_view("\r\n\r\n", 4), body}) {
+    CopyIntoRing(part.data(), part.size(), ring->bytes, kRingBytes, pos);
+    pos += part.size();
+  }
+
+  // Publish it to the writer thread.
+  ring->records.store(ring->records.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+  ring->head.store(pos, std::memory_order_release);
+}
+
+TrafficRecorder::Stats TrafficRecorder::GetStats() const {
+  Stats stats = {0, 0, 0};
+  for (Ring* ring : rings_.Shards()) {
+    stats.recorded += ring->records.load(std::memory_order_relaxed);
+    stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+    stats.oversize += ring->oversize.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+// static
+bool TrafficRecorder::ReadFile(const string& file_name,
+                               vector<RecordedRequest>* const requests) {
+  std::ifstream in(file_name, std::ios::binary);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  if (!in) {
+    return false;
+  }
+  string data = contents.str();
+  if (data.size() < kHeaderBytes ||
+      memcmp(data.data(), kMagic, sizeof(kMagic)) != 0 ||
+      ReadUint32(data.data() + sizeof(kMagic)) != kVersion) {
+    return false;
+  }
+
+  requests->clear();
+  size_t pos = kHeaderBytes;
+  while (pos < data.size()) {
+    // A record cut short (say, the server was killed mid-write) ends it.
+    if (data.size() - pos < kRecordHeaderBytes) {
+      break;
+    }
+    uint64_t offset_ns = ReadUint64(data.data() + pos);
+    uint32_t length = ReadUint32(data.data() + pos + 8);
+    pos += kRecordHeaderBytes;
+    if (data.size() - pos < length) {
+      break;
+    }
+    requests->push_back(RecordedRequest{offset_ns, data.substr(pos, length)});
+    pos += length;
+  }
+  std::stable_sort(requests->begin(), requests->end(),
+                   [](const RecordedRequest& a, const RecordedRequest& b) {
+                     return a.offset_ns < b.offset_ns;
+                   });
+  return true;
+}
+
+// static
+void TrafficRecorder::Drain(Ring* ring, string* const out) {
+  // The ring holds whole records, already formatted, so they can be
+  // copied out as they are.
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  size_t start = tail & (kRingBytes - 1);
+  size_t length = head - tail;
+  size_t first = std::min<size_t>(length, kRingBytes - start);
+  out->append(ring->bytes + start, first);
+  out->append(ring->bytes, length - first);
+
+  // Hand the space back to the owning thread.
+  ring->tail.store(head, std::memory_order_release);
+}
+
+}  // namespace hw4
@@ -0,0 +1,119 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TRAFFICRECORDER_H_
+#define HW4_TRAFFICRECORDER_H_
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./BatchWriter.h"
+#include "./ThreadShards.h"
+
+namespace hw4 {
+
+// One request read back from a recording.
+struct RecordedRequest {
+  uint64_t offset_ns;  // when it arrived, since the recording started
+  std::string text;    // exactly what the client sent: headers, then body
+};
+
+// A TrafficRecorder captures a sample of the requests the server reads,
+// byte for byte, with when each arrived, so that http333replay can send
+// them again to another server.  Like AccessLog, it never makes the
+// thread that read the request wait: each recording thread copies
+// requests, packed end to end, into a ring of kRingBytes of its own, and
+// a writer thread drains the rings into the file every kFlushMillis.  A
+// thread that fills its ring drops requests, and counts them, until the
+// writer catches up.
+//
+// Each request is recorded with probability 1 / "sample_every"; every
+// thread draws from a random number generator of its own.  Requests of
+// more than kMaxRequestBytes, headers and body together, are skipped
+// (and counted).
+//
+// The file is a header and then one record per request, with every
+// integer in network byte order:
+//
+//   header:  "HTTP333R"  uint32 version (1)  uint32 sample_every
+//            uint64 start time, in nanoseconds since the Unix epoch
+//   record:  uint64 offset_ns  uint32 length  "length" bytes of request
+//
+// Records from different threads are only roughly in order of offset_ns.
+class TrafficRecorder {
+ public:
+  // The constructor just memorizes its arguments.  Call Start() to open
+  // the file, which is truncated.
+  TrafficRecorder(const std::string& file_name, uint32_t sample_every);
+
+  // Calls Stop().
+  virtual ~TrafficRecorder();
+
+  // Opens the file, writes its header, and starts the writer thread.
+  // Returns false if the file can't be written.
+  bool Start();
+
+  // Stops the writer thread, once it has written out whatever has been
+  // recorded, and closes the file.  Call it once no thread will record
+  // any more, e.g. when the server shuts down; it does nothing if the
+  // recorder isn't running.
+  void Stop();
+
+  // Records a request whose headers, up to but not including the blank
+  // line that ends them, are "header", and whose body is "body", if it is
+  // one to sample.  Never blocks; safe to call from any number of threads.
+  void Record(std::string_view header, std::string_view body);
+
+  // A snapshot of the recorder's counters.
+  struct Stats {
+    uint64_t recorded;  // requests sampled and kept
+    uint64_t dropped;   // requests sampled but dropped, for a full ring
+    uint64_t oversize;  // requests sampled but too large to record
+  };
+  Stats GetStats() const;
+
+  // Reads every request in the recording "file_name" into "requests", in
+  // order of offset_ns.  Returns false if the file can't be read or isn't
+  // a recording.
+  static bool ReadFile(const std::string& file_name,
+                       std::vector<RecordedRequest>* const requests);
+
+ private:
+  // The largest request kept, and the size of a thread's ring (a power
+  // of two).
+  static const size_t kMaxRequestBytes = 16 * 1024;
+  static const uint64_t kRingBytes = 256 * 1024;
+
+  // How often the writer thread drains the rings.
+  static const int kFlushMillis = 10;
+
+  struct Ring;
+
+  // Appends whatever is in "ring" onto "out", as records.
+  static void Drain(Ring* ring, std::string* const out);
+
+  std::string file_name_;
+  uint32_t sample_every_;
+  uint64_t start_ns_;  // on the monotonic clock
+  ThreadShards<Ring> rings_;
+
+  // Drains rings_ into the file; declared after them, so it stops first.
+  BatchWriter writer_;
+
+  TrafficRecorder(const TrafficRecorder&) = delete;
+  TrafficRecorder& operator=(const TrafficRecorder&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TRAFFICRECORDER_H_
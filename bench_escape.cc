@@ -0,0 +1,90 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <boost/algorithm/string/replace.hpp>
+#include <random>
+#include <string>
+
+#include "benchmark/benchmark.h"
+
+#include "./HttpUtils.h"
+
+using std::string;
+
+namespace hw4 {
+
+// The way EscapeHtml() used to work: one replace_all() per character, each
+// of them a pass over the whole string.
+static string EscapeHtmlReplaceAll(const string& from) {
+  string ret = from;
+  boost::algorithm::replace_all(ret, "&", "&amp;");
+  boost::algorithm::replace_all(ret, "<", "&lt;");
+  boost::algorithm::replace_all(ret, ">", "&gt;");
+  boost::algorithm::replace_all(ret, "\"", "&quot;");
+  boost::algorithm::replace_all(ret, "\'", "&apos;");
+  return ret;
+}
+
+// Returns "length" characters of made-up text, the same every run, in
+// which about one character in "escape_every" needs escaping (none, if
+// it is 0).
+static string Text(size_t length, int escape_every) {
+  static const char kPlain[] = "abcdefghijklmnopqrstuvwxyz0123456789 ./-_";
+  static const char kDangerous[] = "&<>\"'";
+  std::mt19937 rng(333);
+  string text;
+  for (size_t i = 0; i < length; i++) {
+    if (escape_every != 0 && rng() % escape_every == 0) {
+      text += kDangerous[rng() % (sizeof(kDangerous) - 1)];
+    } else {
+      text += kPlain[rng() % (sizeof(kPlain) - 1)];
+    }
+  }
+  return text;
+}
+
+// Arguments: the length of the input, and how often (one character in
+// N, or never if 0) a character needs escaping.  Document names and
+// queries are short and mostly clean; the long, heavy cases show how the
+// methods scale.
+static void EscapeArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"length", "every"});
+  for (int length : {16, 64, 4096}) {
+    for (int every : {0, 32, 4}) {
+      b->Args({length, every});
+    }
+  }
+}
+
+static void BM_EscapeHtmlReplaceAll(benchmark::State& state) {
+  string text = Text(state.range(0), state.range(1));
+  for (auto _ : state) {
+    string escaped = EscapeHtmlReplaceAll(text);
+    benchmark::DoNotOptimize(escaped.data());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_EscapeHtmlReplaceAll)->Apply(EscapeArgs);
+
+// Escaping into a buffer that is reused, as a response body is.
+static void BM_AppendEscapedHtml(benchmark::State& state) {
+  string text = Text(state.range(0), state.range(1));
+  string buffer;
+  for (auto _ : state) {
+    buffer.clear();
+    AppendEscapedHtml(text, &buffer);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_AppendEscapedHtml)->Apply(EscapeArgs);
+
+}  // namespace hw4
@@ -0,0 +1,140 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "./PostingIntersect.h"
+
+using std::vector;
+
+namespace hw4 {
+
+// Document IDs are drawn from [0, kUniverse).
+static const uint32_t kUniverse = 4000000;
+
+// Returns a sorted list of about "length" distinct IDs, chosen at random
+// (but the same every run).
+static vector<uint32_t> RandomList(size_t length, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::bernoulli_distribution keep(static_cast<double>(length) / kUniverse);
+  vector<uint32_t> list;
+  list.reserve(length + length / 8);
+  for (uint32_t id = 0; id < kUniverse; id++) {
+    if (keep(rng)) {
+      list.push_back(id);
+    }
+  }
+  return list;
+}
+
+// The posting lists of a query with "num_terms" words, skewed the way
+// real queries are: each word is about three times as common as the one
+// before it, from 2,000 documents up to half the collection.  The words
+// of a real query also tend to show up together, so every list shares
+// the same 500 documents.
+static const vector<vector<uint32_t>>& SkewedQuery(int num_terms) {
+  static vector<uint32_t> shared = RandomList(500, 0);
+  static vector<vector<uint32_t>> lists;
+  while (lists.size() < static_cast<size_t>(num_terms)) {
+    size_t length = 2000;
+    for (size_t i = 0; i < lists.size(); i++) {
+      length = std::min<size_t>(length * 3, kUniverse / 2);
+    }
+    vector<uint32_t> own = RandomList(length, 333 + lists.size());
+    vector<uint32_t> list;
+    std::set_union(own.begin(), own.end(), shared.begin(), shared.end(),
+                   std::back_inserter(list));
+    lists.push_back(list);
+  }
+  return lists;
+}
+
+static bool SkipUnsupported(benchmark::State& state,
+                            IntersectMethod method) {
+  state.SetLabel(IntersectMethodName(method));
+  if (!IntersectMethodSupported(method)) {
+    state.SkipWithError("not supported on this CPU");
+    return true;
+  }
+  return false;
+}
+
+// Two lists: one of 20,000 IDs and one "ratio" times as long.
+static void BM_IntersectPair(benchmark::State& state) {
+  IntersectMethod method = static_cast<IntersectMethod>(state.range(0));
+  if (SkipUnsupported(state, method)) {
+    return;
+  }
+  size_t ratio = state.range(1);
+  vector<uint32_t> a = RandomList(20000, 1);
+  vector<uint32_t> b = RandomList(20000 * ratio, 2);
+  vector<uint32_t> a_matches(a.size()), b_matches(a.size());
+
+  size_t common = 0;
+  for (auto _ : state) {
+    common = IntersectPostingsWith(method, a.data(), a.size(),
+                                   b.data(), b.size(),
+                                   a_matches.data(), b_matches.data());
+    benchmark::DoNotOptimize(common);
+  }
+  state.counters["common"] = common;
+  state.SetItemsProcessed(state.iterations() * (a.size() + b.size()));
+}
+BENCHMARK(BM_IntersectPair)
+  ->ArgNames({"method", "ratio"})
+  ->ArgsProduct({{0, 1, 2}, {1, 4, 32, 128}});
+
+// A whole multi-word query, intersected rarest word first, the way
+// IndexSet does it.
+static void BM_IntersectQuery(benchmark::State& state) {
+  IntersectMethod method = static_cast<IntersectMethod>(state.range(0));
+  if (SkipUnsupported(state, method)) {
+    return;
+  }
+  const vector<vector<uint32_t>>& all_lists = SkewedQuery(state.range(1));
+  vector<const vector<uint32_t>*> lists;
+  size_t total = 0;
+  for (int i = 0; i < state.range(1); i++) {
+    lists.push_back(&all_lists[i]);
+    total += all_lists[i].size();
+  }
+
+  vector<uint32_t> matches, in_matches, in_list;
+  for (auto _ : state) {
+    matches = *lists[0];
+    in_matches.resize(matches.size());
+    in_list.resize(matches.size());
+    for (size_t i = 1; i < lists.size() && !matches.empty(); i++) {
+      size_t common = IntersectPostingsWith(method,
+                                            matches.data(), matches.size(),
+                                            lists[i]->data(), lists[i]->size(),
+                                            in_matches.data(), in_list.data());
+      for (size_t j = 0; j < common; j++) {
+        matches[j] = matches[in_matches[j]];
+      }
+      matches.resize(common);
+    }
+    benchmark::DoNotOptimize(matches.data());
+  }
+  state.counters["matches"] = matches.size();
+  state.SetItemsProcessed(state.iterations() * total);
+}
+BENCHMARK(BM_IntersectQuery)
+  ->ArgNames({"method", "terms"})
+  ->ArgsProduct({{0, 1, 2}, {2, 3, 4, 5, 6, 7, 8}});
+
+}  // namespace hw4
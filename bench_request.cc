@@ -0,0 +1,198 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+
+#include "benchmark/benchmark.h"
+
+#include "./HttpConnection.h"
+#include "./HttpRequest.h"
+#include "./HttpResponse.h"
+#include "./HttpUtils.h"
+
+using std::string;
+
+namespace hw4 {
+
+// A search as a browser sends it, headers and all.
+static const char kBrowserRequest[] =
+  "GET /query?terms=apple+banana+%22cherry+pie%22 HTTP/1.1\r\n"
+  "Host: localhost:5333\r\n"
+  "Connection: keep-alive\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+  "(KHTML, like Gecko) Chrome/112.0.0.0 Safari/537.36\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+  "image/avif,image/webp,*/*;q=0.8\r\n"
+  "Referer: http://localhost:5333/query?terms=apple\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Accept-Language: en-US,en;q=0.9\r\n"
+  "\r\n";
+
+// The same from curl, which sends next to nothing.
+static const char kCurlRequest[] =
+  "GET /static/bikeapalooza_2011/index.html HTTP/1.1\r\n"
+  "Host: localhost:5333\r\n"
+  "User-Agent: curl/7.88.1\r\n"
+  "Accept: */*\r\n"
+  "\r\n";
+
+// How many requests a client pipelines into the connection at a time.
+static const int kPipelined = 16;
+
+// Reading and parsing requests off a connection, as a worker does.  The
+// client pipelines kPipelined of them at once, so most are parsed out of
+// what an earlier read left behind, and the cost is mostly parsing.
+static void GetNextRequestArgs(const char* request, benchmark::State& state) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    state.SkipWithError("socketpair failed");
+    return;
+  }
+  string batch;
+  for (int i = 0; i < kPipelined; i++) {
+    batch += request;
+  }
+
+  HttpConnection connection(fds[0]);
+  HttpRequest parsed;
+  for (auto _ : state) {
+    if (WrappedWrite(fds[1], reinterpret_cast<const unsigned char*>(
+                         batch.data()), batch.size()) !=
+        static_cast<int>(batch.size())) {
+      state.SkipWithError("write failed");
+      break;
+    }
+    for (int i = 0; i < kPipelined; i++) {
+      if (!connection.GetNextRequest(&parsed)) {
+        state.SkipWithError("GetNextRequest failed");
+        break;
+      }
+      benchmark::DoNotOptimize(parsed.uri().data());
+    }
+  }
+  close(fds[1]);
+  state.SetItemsProcessed(state.iterations() * kPipelined);
+  state.SetBytesProcessed(state.iterations() * batch.size());
+}
+
+static void BM_GetNextRequestBrowser(benchmark::State& state) {
+  GetNextRequestArgs(kBrowserRequest, state);
+}
+BENCHMARK(BM_GetNextRequestBrowser);
+
+static void BM_GetNextRequestCurl(benchmark::State& state) {
+  GetNextRequestArgs(kCurlRequest, state);
+}
+BENCHMARK(BM_GetNextRequestCurl);
+
+// Serializing a response whose body is "state.range(0)" bytes: a 404, a
+// page of search results, and a static file.
+static void BM_GenerateResponseString(benchmark::State& state) {
+  HttpResponse response;
+  response.set_protocol("HTTP/1.1");
+  response.set_response_code(200);
+  response.set_message("OK");
+  response.set_content_type("text/html");
+  response.AppendToBody(string(state.range(0), 'x'));
+  for (auto _ : state) {
+    string text = response.GenerateResponseString();
+    benchmark::DoNotOptimize(text.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GenerateResponseString)->Arg(128)->Arg(16 << 10)->Arg(1 << 20);
+
+// Just the headers, as a large static file's response is written.
+static void BM_GenerateHeaderString(benchmark::State& state) {
+  HttpResponse response;
+  response.set_protocol("HTTP/1.1");
+  response.set_response_code(200);
+  response.set_message("OK");
+  response.set_content_type("text/html");
+  response.AppendToBody(string(16 << 10, 'x'));
+  for (auto _ : state) {
+    string text = response.GenerateHeaderString();
+    benchmark::DoNotOptimize(text.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenerateHeaderString);
+
+// A static files directory, made afresh for the IsPathSafe() benchmarks,
+// with a file three directories down.
+class PathFixture : public benchmark::Fixture {
+ public:
+  void SetUp(const benchmark::State& state) override {
+    char dir[] = "/tmp/bench_pathXXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+      return;
+    }
+    root_ = dir;
+    string path = root_ + "/static";
+    for (const char* sub : {"/books", "/2011", "/austen"}) {
+      path += sub;
+      mkdir(path.c_str(), 0700);
+    }
+    std::ofstream(path + "/pride_and_prejudice.txt") << "It is a truth";
+    std::ofstream(root_ + "/secret.txt") << "hunter2";
+  }
+
+  void TearDown(const benchmark::State& state) override {
+    if (!root_.empty()) {
+      string command = "rm -rf '" + root_ + "'";
+      benchmark::DoNotOptimize(system(command.c_str()));
+    }
+  }
+
+ protected:
+  string root_;
+};
+
+// A file that is where it should be.
+BENCHMARK_F(PathFixture, IsPathSafeInside)(benchmark::State& state) {
+  string root = root_ + "/static";
+  string file = root + "/books/2011/austen/pride_and_prejudice.txt";
+  for (auto _ : state) {
+    bool safe = IsPathSafe(root, file);
+    benchmark::DoNotOptimize(safe);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// A file that a "../" gets out to.
+BENCHMARK_F(PathFixture, IsPathSafeTraversal)(benchmark::State& state) {
+  string root = root_ + "/static";
+  string file = root + "/books/2011/../../../secret.txt";
+  for (auto _ : state) {
+    bool safe = IsPathSafe(root, file);
+    benchmark::DoNotOptimize(safe);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// A file that doesn't exist, as scanners ask for.
+BENCHMARK_F(PathFixture, IsPathSafeMissing)(benchmark::State& state) {
+  string root = root_ + "/static";
+  string file = root + "/wp-admin/install.php";
+  for (auto _ : state) {
+    bool safe = IsPathSafe(root, file);
+    benchmark::DoNotOptimize(safe);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace hw4
@@ -0,0 +1,137 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "./SuggestTrie.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// How many distinct words the vocabulary has.
+static const size_t kVocabularySize = 200000;
+
+// A vocabulary of made-up words, sorted, with Zipf-like document
+// frequencies (the i-th most common word is in about 1/i as many
+// documents as the most common one), the same every run.  Words are
+// built from syllables, so they share prefixes the way real words do.
+static const vector<pair<string, uint32_t>>& Vocabulary() {
+  static vector<pair<string, uint32_t>> words;
+  if (!words.empty()) {
+    return words;
+  }
+  static const char* kSyllables[] = {
+    "a", "an", "ba", "be", "ca", "co", "de", "di", "er", "es", "fa", "ga",
+    "in", "is", "ka", "la", "le", "ma", "me", "na", "ne", "o", "on", "pa",
+    "po", "ra", "re", "sa", "se", "st", "ta", "te", "th", "ti", "to", "u",
+  };
+  const size_t num_syllables = sizeof(kSyllables) / sizeof(kSyllables[0]);
+  std::mt19937 rng(333);
+  std::uniform_int_distribution<size_t> syllable(0, num_syllables - 1);
+  std::uniform_int_distribution<int> length(1, 5);
+
+  vector<string> unique;
+  while (unique.size() < kVocabularySize) {
+    string word;
+    for (int n = length(rng); n > 0; n--) {
+      word += kSyllables[syllable(rng)];
+    }
+    unique.push_back(word);
+    if (unique.size() == kVocabularySize) {
+      std::sort(unique.begin(), unique.end());
+      unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    }
+  }
+
+  // Hand out the frequencies in a random order, so they don't follow the
+  // alphabet.
+  vector<uint32_t> frequencies;
+  for (size_t i = 0; i < unique.size(); i++) {
+    frequencies.push_back(1000000 / (i + 1) + 1);
+  }
+  std::shuffle(frequencies.begin(), frequencies.end(), rng);
+  for (size_t i = 0; i < unique.size(); i++) {
+    words.emplace_back(unique[i], frequencies[i]);
+  }
+  return words;
+}
+
+static const SuggestTrie& Trie() {
+  static SuggestTrie trie;
+  if (trie.size() == 0) {
+    trie.Build(Vocabulary());
+  }
+  return trie;
+}
+
+// Building the trie from the whole vocabulary, as the server does at
+// startup.  Also reports the trie's size, next to what the same words
+// and weights take as the sorted vector of strings it is built from.
+static void BM_SuggestBuild(benchmark::State& state) {
+  const vector<pair<string, uint32_t>>& words = Vocabulary();
+  SuggestTrie trie;
+  for (auto _ : state) {
+    trie.Build(words);
+  }
+  size_t vector_bytes = words.capacity() * sizeof(words[0]);
+  for (const pair<string, uint32_t>& word : words) {
+    if (word.first.capacity() > string().capacity()) {
+      vector_bytes += word.first.capacity() + 1;  // not stored inline
+    }
+  }
+  state.counters["words"] = trie.size();
+  state.counters["trie_bytes"] = trie.MemoryBytes();
+  state.counters["vector_bytes"] = vector_bytes;
+  state.SetItemsProcessed(state.iterations() * words.size());
+}
+BENCHMARK(BM_SuggestBuild)->Unit(benchmark::kMillisecond);
+
+// Completing prefixes of "prefix_length" characters, taken from words in
+// the vocabulary, into the top "max_results" words.
+static void BM_SuggestComplete(benchmark::State& state) {
+  const SuggestTrie& trie = Trie();
+  const vector<pair<string, uint32_t>>& words = Vocabulary();
+  size_t prefix_length = state.range(0);
+  size_t max_results = state.range(1);
+
+  std::mt19937 rng(1);
+  vector<string> prefixes;
+  while (prefixes.size() < 1024) {
+    const string& word = words[rng() % words.size()].first;
+    prefixes.push_back(word.substr(0, prefix_length));
+  }
+
+  vector<SuggestTrie::Suggestion> suggestions;
+  size_t i = 0, found = 0;
+  for (auto _ : state) {
+    trie.Complete(prefixes[i++ % prefixes.size()], max_results,
+                  &suggestions);
+    found += suggestions.size();
+  }
+  state.counters["found"] = benchmark::Counter(
+      found, benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SuggestComplete)
+  ->ArgNames({"prefix", "n"})
+  ->ArgsProduct({{1, 2, 3, 5}, {8, 50}});
+
+}  // namespace hw4
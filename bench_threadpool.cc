@@ -0,0 +1,90 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+extern "C" {
+#include <pthread.h>
+}
+#include <map>
+#include <memory>
+
+#include "benchmark/benchmark.h"
+
+#include "./ThreadPool.h"
+
+using std::map;
+using std::unique_ptr;
+
+namespace hw4 {
+
+// Counts finished tasks, and wakes whoever is waiting for them all.
+struct Completion {
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+  int done = 0;
+};
+
+class CountingTask : public ThreadPool::Task {
+ public:
+  explicit CountingTask(Completion* completion)
+    : ThreadPool::Task(&Run), completion_(completion) { }
+
+ private:
+  static void Run(ThreadPool::Task* t) {
+    CountingTask* task = static_cast<CountingTask*>(t);
+    Completion* completion = task->completion_;
+    delete task;
+    pthread_mutex_lock(&completion->lock);
+    completion->done++;
+    pthread_cond_signal(&completion->cond);
+    pthread_mutex_unlock(&completion->lock);
+  }
+
+  Completion* completion_;
+};
+
+// Returns a pool of "num_threads" threads.  A pool takes a second or so
+// to start up, so each size is made once and kept for every run.
+static ThreadPool* Pool(uint32_t num_threads) {
+  static map<uint32_t, unique_ptr<ThreadPool>> pools;
+  unique_ptr<ThreadPool>& pool = pools[num_threads];
+  if (!pool) {
+    pool.reset(new ThreadPool(num_threads));
+  }
+  return pool.get();
+}
+
+// Dispatching "state.range(1)" tasks at once to a pool of
+// "state.range(0)" threads, and waiting for them all to finish, as the
+// accept loop hands connections to workers.  With one task, this is the
+// round trip from Dispatch() to a worker and back.
+static void BM_ThreadPoolDispatch(benchmark::State& state) {
+  ThreadPool* pool = Pool(state.range(0));
+  int batch = state.range(1);
+  Completion completion;
+  for (auto _ : state) {
+    completion.done = 0;
+    for (int i = 0; i < batch; i++) {
+      pool->Dispatch(new CountingTask(&completion));
+    }
+    pthread_mutex_lock(&completion.lock);
+    while (completion.done < batch) {
+      pthread_cond_wait(&completion.cond, &completion.lock);
+    }
+    pthread_mutex_unlock(&completion.lock);
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_ThreadPoolDispatch)
+  ->ArgNames({"threads", "batch"})
+  ->Args({1, 1})->Args({8, 1})->Args({8, 64})
+  ->UseRealTime();
+
+}  // namespace hw4
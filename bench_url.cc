@@ -0,0 +1,179 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <boost/algorithm/string.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "./HttpUtils.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// The way URIDecode() used to work: one character at a time.
+static string OldURIDecode(const string& from) {
+  string retstr;
+  for (unsigned int pos = 0; pos < from.length(); pos++) {
+    char c1 = from[pos];
+    char c2 = (pos+1 < from.length()) ? toupper(from[pos+1]) : ' ';
+    char c3 = (pos+2 < from.length()) ? toupper(from[pos+2]) : ' ';
+    if (c1 == '+') {
+      retstr.append(1, ' ');
+      continue;
+    }
+    if (c1 != '%') {
+      retstr.append(1, c1);
+      continue;
+    }
+    if (!((('0' <= c2) && (c2 <= '9')) || (('A' <= c2) && (c2 <= 'F')))) {
+      retstr.append(1, c1);
+      continue;
+    }
+    if (!((('0' <= c3) && (c3 <= '9')) || (('A' <= c3) && (c3 <= 'F')))) {
+      retstr.append(1, c1);
+      continue;
+    }
+    uint8_t code = 16 * (c2 >= 'A' ? 10 + (c2 - 'A') : c2 - '0');
+    code += c3 >= 'A' ? 10 + (c3 - 'A') : c3 - '0';
+    if (!((code >= 32) && (code <= 127))) {
+      retstr.append(1, c1);
+      continue;
+    }
+    retstr.append(1, static_cast<char>(code));
+    pos += 2;
+  }
+  return retstr;
+}
+
+// The way URLParser used to work: copy the URL, split() it into vectors
+// of strings, and decode every piece into a map that args() copies.
+class OldURLParser {
+ public:
+  void Parse(const string& url) {
+    url_ = url;
+    vector<string> ps;
+    boost::split(ps, url, boost::is_any_of("?"));
+    path_ = OldURIDecode(ps[0]);
+    if (ps.size() < 2)
+      return;
+    vector<string> vals;
+    boost::split(vals, ps[1], boost::is_any_of("&"));
+    for (unsigned int i = 0; i < vals.size(); i++) {
+      vector<string> fv;
+      boost::split(fv, vals[i], boost::is_any_of("="));
+      if (fv.size() == 2) {
+        args_[OldURIDecode(fv[0])] = OldURIDecode(fv[1]);
+      }
+    }
+  }
+  string path() const { return path_; }
+  map<string, string> args() const { return args_; }
+
+ private:
+  string url_;
+  string path_;
+  map<string, string> args_;
+};
+
+// A query from the search box, as the server sees it.
+static const char* kQueryURL =
+  "/query?terms=apple+banana+%22cherry+pie%22+caf%C3%A9&per_page=50&page=3";
+
+// A query string that is all escapes.
+static const char* kEscapedTerms =
+  "%22how%20to%22%20%3Cb%3E%26%3C%2Fb%3E%20%28really%29%3F%21";
+
+static void BM_URIDecodeOld(benchmark::State& state) {
+  string from = kEscapedTerms;
+  for (auto _ : state) {
+    string decoded = OldURIDecode(from);
+    benchmark::DoNotOptimize(decoded.data());
+  }
+  state.SetBytesProcessed(state.iterations() * from.size());
+}
+BENCHMARK(BM_URIDecodeOld);
+
+// Decoding into a buffer that is reused, as URLParser does.
+static void BM_URIDecode(benchmark::State& state) {
+  string from = kEscapedTerms;
+  string decoded;
+  for (auto _ : state) {
+    decoded.clear();
+    AppendURIDecoded(from, &decoded);
+    benchmark::DoNotOptimize(decoded.data());
+  }
+  state.SetBytesProcessed(state.iterations() * from.size());
+}
+BENCHMARK(BM_URIDecode);
+
+// Parsing a query URL and reading its three arguments, the way
+// ProcessQueryRequest() used to.
+static void BM_URLParserOld(benchmark::State& state) {
+  string url = kQueryURL;
+  for (auto _ : state) {
+    OldURLParser parser;
+    parser.Parse(url);
+    map<string, string> args = parser.args();
+    benchmark::DoNotOptimize(args["terms"].data());
+    benchmark::DoNotOptimize(args["per_page"].data());
+    benchmark::DoNotOptimize(args["page"].data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_URLParserOld);
+
+// The same with the current parser, the way ProcessQueryRequest() does
+// it now.  A fresh parser every time, as each request gets.
+static void BM_URLParser(benchmark::State& state) {
+  string url = kQueryURL;
+  string terms, per_page, page;
+  for (auto _ : state) {
+    URLParser parser;
+    parser.Parse(url);
+    parser.GetArg("terms", &terms);
+    parser.GetArg("per_page", &per_page);
+    parser.GetArg("page", &page);
+    benchmark::DoNotOptimize(terms.data());
+    benchmark::DoNotOptimize(per_page.data());
+    benchmark::DoNotOptimize(page.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_URLParser);
+
+// The same with one parser reused for every URL, which doesn't allocate
+// at all once its buffers have grown.
+static void BM_URLParserReused(benchmark::State& state) {
+  string url = kQueryURL;
+  string terms, per_page, page;
+  URLParser parser;
+  for (auto _ : state) {
+    parser.Parse(url);
+    parser.GetArg("terms", &terms);
+    parser.GetArg("per_page", &per_page);
+    parser.GetArg("page", &page);
+    benchmark::DoNotOptimize(terms.data());
+    benchmark::DoNotOptimize(per_page.data());
+    benchmark::DoNotOptimize(page.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_URLParserReused);
+
+}  // namespace hw4
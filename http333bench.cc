@@ -0,0 +1,203 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// http333bench drives a running http333d with a mix of the requests it
+// serves, from a number of connections at once, and reports how many it
+// answered per second and how long they took, for each kind of request
+// (see LoadGenerator.h).  --mix says how often each kind is sent, e.g.
+// --mix=small:2,query:8.  The words of a query are drawn from the
+// vocabulary of the --index files: in proportion to how many documents
+// contain them (--terms=df, the default, which is roughly how real
+// searches go), or all equally likely (--terms=uniform, which mostly hits
+// rare words).
+//
+// The report is a table, or with --json a JSON object, whose lines don't
+// depend on anything but the results, so two runs can be diffed.
+
+#include <stdlib.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./HttpUtils.h"
+#include "./LoadGenerator.h"
+
+using hw4::LoadGenerator;
+using hw4::LoadOptions;
+using hw4::LoadResult;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::setw;
+using std::string;
+using std::vector;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name);
+
+// Parses the command line into "options", whose mix it also parses.
+// Returns false if it's wrong.
+static bool GetOptions(int argc, char** argv, LoadOptions* const options,
+                       bool* const json);
+
+// Prints "results" as a table, or as JSON if "json".
+static void Report(const LoadOptions& options,
+                   const vector<LoadResult>& results, bool json);
+
+int main(int argc, char** argv) {
+  LoadOptions options;
+  bool json = false;
+  if (!GetOptions(argc, argv, &options, &json)) {
+    Usage(argv[0]);
+  }
+
+  LoadGenerator generator(options);
+  string error;
+  if (!generator.Prepare(&error)) {
+    cerr << error << endl;
+    return EXIT_FAILURE;
+  }
+  vector<LoadResult> results;
+  if (!generator.Run(&results)) {
+    cerr << "Couldn't connect to " << options.host << ":" << options.port
+         << endl;
+    return EXIT_FAILURE;
+  }
+  Report(options, results, json);
+  return results.back().errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name << " [options] port" << endl;
+  cerr << "Options:" << endl;
+  cerr << "  --host=NAME          the server's host (default localhost)"
+       << endl;
+  cerr << "  --seconds=S          measure for S seconds (default 5)" << endl;
+  cerr << "  --warmup=S           after S seconds of warmup (default 1)"
+       << endl;
+  cerr << "  --connections=N      from N connections at once (default 8)"
+       << endl;
+  cerr << "  --pipeline=N         with up to N requests in flight on each"
+       << " (default 1)" << endl;
+  cerr << "  --close              a new connection for every request"
+       << endl;
+  cerr << "  --mix=KIND:W,...     send each KIND of request in proportion"
+       << " to W;" << endl
+       << "                       kinds are small, medium, large, missing,"
+       << " query, api" << endl
+       << "                       (default query:1)" << endl;
+  cerr << "  --docroot=DIR        the server's static files, for small,"
+       << " medium and large" << endl;
+  cerr << "  --index=FILE         an index file to draw query words from;"
+       << " repeat for more" << endl;
+  cerr << "  --terms=df|uniform   draw words by document frequency"
+       << " (default) or uniformly" << endl;
+  cerr << "  --max_terms=N        up to N words per query (default 3)"
+       << endl;
+  cerr << "  --json               report in JSON" << endl;
+  exit(EXIT_FAILURE);
+}
+
+static bool GetOptions(int argc, char** argv, LoadOptions* const options,
+                       bool* const json) {
+  bool have_port = false;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.substr(0, 2) != "--") {
+      int port = atoi(arg.c_str());
+      if (have_port || port <= 0 || port > 65535) {
+        return false;
+      }
+      options->port = port;
+      have_port = true;
+      continue;
+    }
+
+    string value;
+    size_t eq = arg.find('=');
+    if (eq != string::npos) {
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    }
+    if (arg == "--host" && !value.empty()) {
+      options->host = value;
+    } else if (arg == "--seconds") {
+      options->seconds = atof(value.c_str());
+    } else if (arg == "--warmup") {
+      options->warmup = atof(value.c_str());
+    } else if (arg == "--connections") {
+      options->connections = atoi(value.c_str());
+    } else if (arg == "--pipeline") {
+      options->pipeline = atoi(value.c_str());
+    } else if (arg == "--close" && eq == string::npos) {
+      options->close = true;
+    } else if (arg == "--mix" && !value.empty()) {
+      options->mix = value;
+    } else if (arg == "--docroot" && !value.empty()) {
+      options->docroot = value;
+    } else if (arg == "--index" && !value.empty()) {
+      options->index_files.push_back(value);
+    } else if (arg == "--terms" && (value == "df" || value == "uniform")) {
+      options->uniform_terms = value == "uniform";
+    } else if (arg == "--max_terms") {
+      options->max_terms = atoi(value.c_str());
+    } else if (arg == "--json" && eq == string::npos) {
+      *json = true;
+    } else {
+      cerr << "Unknown option " << arg << endl;
+      return false;
+    }
+  }
+
+  if (!hw4::ParseLoadMix(options)) {
+    cerr << "Bad --mix=" << options->mix << endl;
+    return false;
+  }
+  // Pipelining needs the connection to outlive the request.
+  return have_port && options->seconds > 0 && options->warmup >= 0 &&
+         options->connections > 0 && options->pipeline > 0 &&
+         !(options->close && options->pipeline > 1) &&
+         options->max_terms > 0;
+}
+
+static void Report(const LoadOptions& options,
+                   const vector<LoadResult>& results, bool json) {
+  cout << std::fixed << std::setprecision(1);
+  if (json) {
+    string out;
+    hw4::AppendLoadResultsJson(results, &out);
+    cout << "{\"mix\":\"" << hw4::EscapeJson(options.mix) << "\""
+         << ",\"connections\":" << options.connections
+         << ",\"pipeline\":" << options.pipeline
+         << ",\"keep_alive\":" << (options.close ? "false" : "true")
+         << ",\"seconds\":" << options.seconds
+         << ",\"results\":" << out << "}" << endl;
+    return;
+  }
+
+  cout << "mix " << options.mix << ", " << options.connections
+       << " connection(s), " << (options.close ? "close" : "keep-alive")
+       << ", pipeline " << options.pipeline << ", " << options.seconds
+       << " s" << endl << endl;
+  cout << "kind      requests  requests/s     MiB/s  p50 (us)  p99 (us)"
+       << "  p99.9 (us)  errors" << endl;
+  for (const LoadResult& result : results) {
+    cout << std::left << setw(8) << result.kind << std::right
+         << setw(10) << result.requests
+         << setw(12) << result.requests_per_second
+         << setw(10) << result.mib_per_second
+         << setw(10) << result.p50_us
+         << setw(10) << result.p99_us
+         << setw(12) << result.p999_us
+         << setw(8) << result.errors << endl;
+  }
+}
@@ -11,6 +11,7 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -19,6 +20,7 @@
 #include <cstdio>
 #include <iostream>
 #include <list>
+#include <vector>
 
 #include "./ServerSocket.h"
 #include "./HttpServer.h"
@@ -28,6 +30,7 @@ using std::cout;
 using std::endl;
 using std::list;
 using std::string;
+using std::vector;
 
 static const int fileHeaderLen = 4;
 
@@ -53,6 +56,29 @@ static void GetPortAndPath(int argc,
                     string* const path,
                     list<string>* const indices);
 
+// Pull the "--name" flags out of the command line, wherever they appear,
+// and apply them to "options".  The remaining (positional) arguments are
+// returned through "args", starting with the program name, so that they
+// can be handed to GetPortAndPath().
+//
+// Calls Usage() on an unrecognized flag.
+static void GetOptions(int argc,
+                       char** argv,
+                       vector<char*>* const args,
+                       hw4::ServerOptions* const options);
+
+// The signals that stop the server, and the server they stop.
+static sigset_t stop_signals;
+static hw4::HttpServer* server;
+
+// The body of a thread that waits for one of stop_signals and then stops
+// the server, so that Run() returns and main() with it, rather than the
+// process just dying.  Everything shuts down in order: the access log and
+// the recorder write out what they hold, and a build made with
+// -fprofile-generate (see "make pgo") writes out its profile.  A second
+// signal exits at once.
+static void* StopOnSignal(void* arg);
+
 int main(int argc, char** argv) {
   // Print out welcome message.
   cout << "Welcome to http333d, the UW cse333 web server!" << endl;
@@ -66,16 +92,39 @@ int main(int argc, char** argv) {
   // disconnects unexpectedly.
   signal(SIGPIPE, SIG_IGN);
 
-  // Get the port number and list of index files.
+  // Leave SIGINT and SIGTERM to a thread of their own.  They have to be
+  // blocked before any other thread starts, so that all of them inherit
+  // the mask.
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  if (pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr) != 0) {
+    cerr << "  couldn't block the stop signals" << endl;
+    return EXIT_FAILURE;
+  }
+
+  // Get the options, port number and list of index files.
+  vector<char*> args;
+  hw4::ServerOptions options;
+  GetOptions(argc, argv, &args, &options);
+
   uint16_t port_num;
   string static_dir;
   list<string> indices;
-  GetPortAndPath(argc, argv, &port_num, &static_dir, &indices);
+  GetPortAndPath(args.size(), args.data(), &port_num, &static_dir, &indices);
   cout << "    port: " << port_num << endl;
   cout << "    path: " << static_dir << endl;
 
-  // Run the server.
-  hw4::HttpServer hs(port_num, static_dir, indices);
+  // Run the server, until a signal stops it.  (One that arrives before
+  // the thread is waiting for it stays pending until then.)
+  hw4::HttpServer hs(port_num, static_dir, indices, options);
+  server = &hs;
+  pthread_t stop_thread;
+  if (pthread_create(&stop_thread, nullptr, &StopOnSignal, nullptr) != 0) {
+    cerr << "  couldn't set up the signal handling thread" << endl;
+    return EXIT_FAILURE;
+  }
+  pthread_detach(stop_thread);
   if (!hs.Run()) {
     cerr << "  server failed to run!?" << endl;
   }
@@ -85,12 +134,102 @@ int main(int argc, char** argv) {
 }
 
 
+static void* StopOnSignal(void* arg) {
+  int signal_num;
+  if (sigwait(&stop_signals, &signal_num) != 0) {
+    return nullptr;
+  }
+  cout << "caught signal " << signal_num << "; shutting down." << endl;
+  server->Stop();
+  if (sigwait(&stop_signals, &signal_num) == 0) {
+    cout << "caught signal " << signal_num << " again; exiting." << endl;
+    _exit(EXIT_FAILURE);
+  }
+  return nullptr;
+}
+
 static void Usage(char* prog_name) {
-  cerr << "Usage: " << prog_name << " port staticfiles_directory indices+";
-  cerr << endl;
+  cerr << "Usage: " << prog_name
+       << " [options] port staticfiles_directory indices+" << endl;
+  cerr << "Options:" << endl;
+  cerr << "  --preload_indices   pre-fault and mlock() the index files"
+       << endl;
+  cerr << "  --in_memory_indices copy the index files into compact in-memory"
+       << " indices" << endl;
+  cerr << "  --query_cache_entries=N" << endl
+       << "                      cache at most N query answers (default 10000,"
+       << " 0 = off)" << endl;
+  cerr << "  --query_cache_mb=N  cap the query cache at N MiB (default 64)"
+       << endl;
+  cerr << "  --mime_types=FILE   also serve the types listed in FILE, in the"
+       << " format of /etc/mime.types" << endl;
+  cerr << "  --access_log=FILE   append a line per request to FILE (- for"
+       << " standard output)" << endl;
+  cerr << "  --record=FILE       record the requests read to FILE, for"
+       << " http333replay" << endl;
+  cerr << "  --record_sample=N   record one in every N requests (default 1)"
+       << endl;
+  cerr << "  --trace_sample=N    trace one in every N requests, for"
+       << " /debug/trace (default 0 = off)" << endl;
   exit(EXIT_FAILURE);
 }
 
+// Parses "value" as a non-negative integer.  Returns false if it isn't one.
+static bool GetSize(const string& value, size_t* const size) {
+  if (value.empty() || value.find_first_not_of("0123456789") != string::npos) {
+    return false;
+  }
+  *size = strtoull(value.c_str(), nullptr, 10);
+  return true;
+}
+
+static void GetOptions(int argc,
+                       char** argv,
+                       vector<char*>* const args,
+                       hw4::ServerOptions* const options) {
+  args->push_back(argv[0]);
+  size_t size;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.substr(0, 2) != "--") {
+      args->push_back(argv[i]);
+      continue;
+    }
+
+    string value;
+    size_t eq = arg.find('=');
+    if (eq != string::npos) {
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    }
+
+    if (arg == "--preload_indices" && eq == string::npos) {
+      options->preload_indices = true;
+    } else if (arg == "--in_memory_indices" && eq == string::npos) {
+      options->in_memory_indices = true;
+    } else if (arg == "--query_cache_entries" && GetSize(value, &size)) {
+      options->query_cache_entries = size;
+    } else if (arg == "--query_cache_mb" && GetSize(value, &size)) {
+      options->query_cache_mb = size;
+    } else if (arg == "--mime_types" && !value.empty()) {
+      options->mime_types_file = value;
+    } else if (arg == "--access_log" && !value.empty()) {
+      options->access_log_file = value;
+    } else if (arg == "--record" && !value.empty()) {
+      options->record_file = value;
+    } else if (arg == "--record_sample" && GetSize(value, &size) &&
+               size >= 1 && size <= UINT32_MAX) {
+      options->record_sample = size;
+    } else if (arg == "--trace_sample" && GetSize(value, &size) &&
+               size <= UINT32_MAX) {
+      options->trace_sample = size;
+    } else {
+      cerr << "Unknown option " << arg << endl;
+      Usage(argv[0]);
+    }
+  }
+}
+
 static void GetPortAndPath(int argc,
                     char** argv,
                     uint16_t* const port,
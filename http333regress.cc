@@ -0,0 +1,569 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// http333regress checks that a build of http333d is no slower than the
+// reference server in sol_binaries/, or than a baseline saved from an
+// earlier run.  It starts both servers on random ports, with the same
+// documents and indices, and runs the same fixed load (see
+// LoadGenerator.h) against each in turn, --rounds times, taking the
+// median of the rounds.  Then for each kind of request it compares our
+// throughput and p99 latency with the reference's and the baseline's,
+// and fails if either is worse by more than its threshold.
+//
+// The report is a table, or with --json a JSON object; --save_baseline
+// writes our results in a form --baseline reads back.  With neither a
+// reference nor a baseline, it just measures our server.
+
+extern "C" {
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+}
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "./HttpUtils.h"
+#include "./LoadGenerator.h"
+
+using hw4::LoadGenerator;
+using hw4::LoadOptions;
+using hw4::LoadResult;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::setw;
+using std::string;
+using std::vector;
+
+// The mix of requests, unless --mix says otherwise: only what the
+// reference server also answers.
+static const char kDefaultMix[] = "small:2,medium:1,large:1,missing:1,query:5";
+
+// How long a server gets to load its indices and start listening.
+static const int kStartupSeconds = 60;
+
+// How many ports to try before giving up on starting a server.
+static const int kPortAttempts = 5;
+
+struct Options {
+  string reference = "sol_binaries/http333d";
+  string baseline_file;
+  string save_baseline_file;
+  double throughput_threshold = 10;  // percent
+  double p99_threshold = 25;         // percent
+  int rounds = 3;
+  bool report_only = false;  // don't fail on a regression
+  bool json = false;
+  string server;
+  vector<string> server_args;  // the document root, then the indices
+  LoadOptions load;
+};
+
+// A server that we started.
+struct Server {
+  string name;
+  pid_t pid = -1;
+  uint16_t port = 0;
+};
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name);
+
+// Parses the command line into "options".  Returns false if it's wrong.
+static bool GetOptions(int argc, char** argv, Options* const options);
+
+// Starts "binary" with "args" on a random port, and waits for it to
+// start listening.  Returns false if it won't.
+static bool StartServer(const string& binary, const vector<string>& args,
+                        Server* const server);
+
+// Returns true if a server on "port" answers a request.  (It listens
+// before its workers are up, so connecting isn't enough.)
+static bool IsServing(uint16_t port);
+
+// Stops "server".
+static void StopServer(Server* const server);
+
+// Returns, for each kind, the median over "rounds" of each figure, and
+// the total of the errors.
+static vector<LoadResult> Median(const vector<vector<LoadResult>>& rounds);
+
+// Compares "ours" with "theirs", named "against", adding a description
+// of each regression to "regressions".
+static void Compare(const Options& options, const vector<LoadResult>& ours,
+                    const vector<LoadResult>& theirs, const string& against,
+                    vector<string>* const regressions);
+
+// Prints the results, as a table or as JSON.
+static void Report(const Options& options, const vector<LoadResult>& ours,
+                   const vector<LoadResult>& reference,
+                   const vector<LoadResult>& baseline,
+                   const vector<string>& regressions);
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!GetOptions(argc, argv, &options)) {
+    Usage(argv[0]);
+  }
+
+  vector<LoadResult> baseline;
+  if (!options.baseline_file.empty()) {
+    std::ifstream in(options.baseline_file);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    if (!in || !hw4::ReadLoadResultsJson(contents.str(), &baseline)) {
+      cerr << "Couldn't read a baseline from " << options.baseline_file
+           << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Generate the load once, so every run sends the same requests.
+  LoadGenerator generator(options.load);
+  string error;
+  if (!generator.Prepare(&error)) {
+    cerr << error << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<Server> servers(1);
+  servers[0].name = "ours";
+  if (!options.reference.empty()) {
+    if (access(options.reference.c_str(), X_OK) != 0) {
+      cerr << options.reference << " isn't executable; chmod +x it, or "
+           << "pass --reference= to compare with a baseline only" << endl;
+      return EXIT_FAILURE;
+    }
+    servers.push_back(Server());
+    servers[1].name = "reference";
+  }
+  if (!StartServer(options.server, options.server_args, &servers[0]) ||
+      (servers.size() > 1 && !StartServer(options.reference,
+                                          options.server_args,
+                                          &servers[1]))) {
+    for (Server& server : servers) {
+      StopServer(&server);
+    }
+    return EXIT_FAILURE;
+  }
+
+  // Alternate which server goes first, so neither always gets the
+  // machine while it's warmer.
+  vector<vector<LoadResult>> rounds[2];
+  bool ok = true;
+  for (int round = 0; round < options.rounds && ok; round++) {
+    for (size_t i = 0; i < servers.size() && ok; i++) {
+      Server* server = &servers[(i + round) % servers.size()];
+      generator.set_port(server->port);
+      vector<LoadResult> results;
+      ok = generator.Run(&results);
+      if (!ok) {
+        cerr << "Couldn't run the load against " << server->name << endl;
+      }
+      rounds[server == &servers[0] ? 0 : 1].push_back(results);
+    }
+  }
+  for (Server& server : servers) {
+    StopServer(&server);
+  }
+  if (!ok) {
+    return EXIT_FAILURE;
+  }
+
+  vector<LoadResult> ours = Median(rounds[0]);
+  vector<LoadResult> reference = Median(rounds[1]);
+  vector<string> regressions;
+  for (const LoadResult& result : ours) {
+    if (result.errors != 0) {
+      std::stringstream line;
+      line << result.kind << ": " << result.errors << " errors";
+      regressions.push_back(line.str());
+    }
+  }
+  if (!options.report_only) {
+    Compare(options, ours, reference, "the reference", &regressions);
+    Compare(options, ours, baseline, "the baseline", &regressions);
+  }
+  Report(options, ours, reference, baseline, regressions);
+
+  if (!options.save_baseline_file.empty()) {
+    string out = "{\"results\":";
+    hw4::AppendLoadResultsJson(ours, &out);
+    out += "}\n";
+    std::ofstream file(options.save_baseline_file);
+    file << out;
+    if (!file) {
+      cerr << "Couldn't write " << options.save_baseline_file << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return regressions.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name << " [options] ./http333d docroot"
+       << " index_files+" << endl;
+  cerr << "Options:" << endl;
+  cerr << "  --reference=BIN      the server to compare with (default"
+       << " sol_binaries/http333d);" << endl
+       << "                       empty to compare with --baseline only,"
+       << " or just measure" << endl;
+  cerr << "  --baseline=FILE      also compare with results saved by"
+       << " --save_baseline" << endl;
+  cerr << "  --save_baseline=FILE save our results there" << endl;
+  cerr << "  --threshold=PCT      fail if our throughput is PCT% lower"
+       << " (default 10)" << endl;
+  cerr << "  --p99_threshold=PCT  fail if our p99 latency is PCT% higher"
+       << " (default 25)" << endl;
+  cerr << "  --rounds=N           run the load N times against each, and"
+       << " take the median" << endl
+       << "                       (default 3)" << endl;
+  cerr << "  --seconds=S          measure each round for S seconds"
+       << " (default 5)" << endl;
+  cerr << "  --warmup=S           after S seconds of warmup (default 1)"
+       << endl;
+  cerr << "  --connections=N      from N connections at once (default 8)"
+       << endl;
+  cerr << "  --mix=KIND:W,...     the mix of requests, as for http333bench"
+       << endl << "                       (default " << kDefaultMix << ")"
+       << endl;
+  cerr << "  --report_only        report the comparison, but only fail on"
+       << " wrong answers" << endl;
+  cerr << "  --json               report in JSON" << endl;
+  exit(EXIT_FAILURE);
+}
+
+static bool GetOptions(int argc, char** argv, Options* const options) {
+  options->load.mix = kDefaultMix;
+  // The reference may not have every kind of file the mix asks for.
+  options->load.drop_unavailable_kinds = true;
+  vector<string> positional;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.substr(0, 2) != "--") {
+      positional.push_back(arg);
+      continue;
+    }
+
+    string value;
+    size_t eq = arg.find('=');
+    if (eq != string::npos) {
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    }
+    if (arg == "--reference" && eq != string::npos) {
+      options->reference = value;
+    } else if (arg == "--baseline" && !value.empty()) {
+      options->baseline_file = value;
+    } else if (arg == "--save_baseline" && !value.empty()) {
+      options->save_baseline_file = value;
+    } else if (arg == "--threshold") {
+      options->throughput_threshold = atof(value.c_str());
+    } else if (arg == "--p99_threshold") {
+      options->p99_threshold = atof(value.c_str());
+    } else if (arg == "--rounds") {
+      options->rounds = atoi(value.c_str());
+    } else if (arg == "--seconds") {
+      options->load.seconds = atof(value.c_str());
+    } else if (arg == "--warmup") {
+      options->load.warmup = atof(value.c_str());
+    } else if (arg == "--connections") {
+      options->load.connections = atoi(value.c_str());
+    } else if (arg == "--mix" && !value.empty()) {
+      options->load.mix = value;
+    } else if (arg == "--report_only" && eq == string::npos) {
+      options->report_only = true;
+    } else if (arg == "--json" && eq == string::npos) {
+      options->json = true;
+    } else {
+      cerr << "Unknown option " << arg << endl;
+      return false;
+    }
+  }
+  if (positional.size() < 3) {
+    return false;
+  }
+  options->server = positional[0];
+  options->server_args.assign(positional.begin() + 1, positional.end());
+  options->load.docroot = positional[1];
+  options->load.index_files.assign(positional.begin() + 2, positional.end());
+
+  if (!hw4::ParseLoadMix(&options->load)) {
+    cerr << "Bad --mix=" << options->load.mix << endl;
+    return false;
+  }
+  return options->rounds > 0 && options->load.seconds > 0 &&
+         options->load.warmup >= 0 && options->load.connections > 0 &&
+         options->throughput_threshold >= 0 && options->p99_threshold >= 0;
+}
+
+static bool StartServer(const string& binary, const vector<string>& args,
+                        Server* const server) {
+  for (int attempt = 0; attempt < kPortAttempts; attempt++) {
+    uint16_t port = hw4::GetRandPort();
+    string port_str = std::to_string(port);
+    vector<char*> argv;
+    argv.push_back(const_cast<char*>(binary.c_str()));
+    argv.push_back(const_cast<char*>(port_str.c_str()));
+    for (const string& arg : args) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+      cerr << "Couldn't fork to start " << binary << endl;
+      return false;
+    }
+    if (pid == 0) {
+      // Its chatter would get in the way of the report.
+      int null_fd = open("/dev/null", O_WRONLY);
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+      execv(binary.c_str(), argv.data());
+      _exit(127);
+    }
+
+    // Wait for it to listen, or to give up (most likely because the
+    // port was taken).
+    for (int i = 0; i < kStartupSeconds * 10; i++) {
+      int status;
+      if (waitpid(pid, &status, WNOHANG) == pid) {
+        pid = -1;
+        break;
+      }
+      if (IsServing(port)) {
+        server->pid = pid;
+        server->port = port;
+        return true;
+      }
+      usleep(100000);
+    }
+    if (pid != -1) {
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+      break;
+    }
+  }
+  cerr << "Couldn't start " << binary << endl;
+  return false;
+}
+
+static bool IsServing(uint16_t port) {
+  int fd;
+  if (!hw4::ConnectToServer("localhost", port, &fd)) {
+    return false;
+  }
+  static const char kRequest[] =
+    "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+  unsigned char buffer[64];
+  bool serving =
+    hw4::WrappedWrite(fd, reinterpret_cast<const unsigned char*>(kRequest),
+                      sizeof(kRequest) - 1) == sizeof(kRequest) - 1 &&
+    hw4::WrappedRead(fd, buffer, sizeof(buffer)) > 0;
+  close(fd);
+  return serving;
+}
+
+static void StopServer(Server* const server) {
+  if (server->pid == -1) {
+    return;
+  }
+  kill(server->pid, SIGTERM);
+  waitpid(server->pid, nullptr, 0);
+  server->pid = -1;
+}
+
+// Returns the median of "values", which it reorders.
+static double MedianOf(vector<double>* values) {
+  std::nth_element(values->begin(), values->begin() + values->size() / 2,
+                   values->end());
+  return (*values)[values->size() / 2];
+}
+
+static vector<LoadResult> Median(const vector<vector<LoadResult>>& rounds) {
+  vector<LoadResult> median;
+  if (rounds.empty()) {
+    return median;
+  }
+  // Every round has the same kinds, in the same order.
+  for (size_t k = 0; k < rounds[0].size(); k++) {
+    vector<double> requests, rps, mibps, p50, p99, p999;
+    LoadResult result = rounds[0][k];
+    result.errors = 0;
+    for (const vector<LoadResult>& round : rounds) {
+      const LoadResult& r = round[k];
+      requests.push_back(r.requests);
+      rps.push_back(r.requests_per_second);
+      mibps.push_back(r.mib_per_second);
+      p50.push_back(r.p50_us);
+      p99.push_back(r.p99_us);
+      p999.push_back(r.p999_us);
+      result.errors += r.errors;
+    }
+    result.requests = MedianOf(&requests);
+    result.requests_per_second = MedianOf(&rps);
+    result.mib_per_second = MedianOf(&mibps);
+    result.p50_us = MedianOf(&p50);
+    result.p99_us = MedianOf(&p99);
+    result.p999_us = MedianOf(&p999);
+    median.push_back(result);
+  }
+  return median;
+}
+
+// Returns the result for "kind" in "results", or null.
+static const LoadResult* Find(const vector<LoadResult>& results,
+                              const string& kind) {
+  for (const LoadResult& result : results) {
+    if (result.kind == kind) {
+      return &result;
+    }
+  }
+  return nullptr;
+}
+
+// Returns how much bigger "ours" is than "theirs", in percent.
+static double Change(double ours, double theirs) {
+  return theirs == 0 ? 0 : (ours - theirs) / theirs * 100;
+}
+
+static void Compare(const Options& options, const vector<LoadResult>& ours,
+                    const vector<LoadResult>& theirs, const string& against,
+                    vector<string>* const regressions) {
+  for (const LoadResult& result : ours) {
+    const LoadResult* other = Find(theirs, result.kind);
+    if (other == nullptr) {
+      continue;
+    }
+    std::stringstream line;
+    line << std::fixed << std::setprecision(1);
+    double change = Change(result.requests_per_second,
+                           other->requests_per_second);
+    if (-change > options.throughput_threshold) {
+      line << result.kind << ": throughput " << result.requests_per_second
+           << " requests/s is " << -change << "% below " << against
+           << "'s " << other->requests_per_second;
+      regressions->push_back(line.str());
+      line.str("");
+    }
+    change = Change(result.p99_us, other->p99_us);
+    if (change > options.p99_threshold) {
+      line << result.kind << ": p99 latency " << result.p99_us
+           << " us is " << change << "% above " << against << "'s "
+           << other->p99_us;
+      regressions->push_back(line.str());
+    }
+  }
+}
+
+// Prints a table comparing "ours" with "theirs".
+static void PrintComparison(const vector<LoadResult>& ours,
+                            const vector<LoadResult>& theirs,
+                            const string& name) {
+  cout << endl << "vs " << name << ":" << endl;
+  cout << "kind      requests/s  " << setw(10) << name.substr(0, 10)
+       << "   change  p99 (us)  " << setw(10) << name.substr(0, 10)
+       << "   change  errors" << endl;
+  for (const LoadResult& result : ours) {
+    const LoadResult* other = Find(theirs, result.kind);
+    cout << std::left << setw(8) << result.kind << std::right
+         << setw(12) << result.requests_per_second;
+    if (other == nullptr) {
+      cout << setw(12) << "-" << setw(8) << "-";
+    } else {
+      cout << setw(12) << other->requests_per_second << setw(8)
+           << std::showpos
+           << Change(result.requests_per_second, other->requests_per_second)
+           << std::noshowpos << "%";
+    }
+    cout << setw(10) << result.p99_us;
+    if (other == nullptr) {
+      cout << setw(12) << "-" << setw(9) << "-";
+    } else {
+      cout << setw(12) << other->p99_us << setw(8) << std::showpos
+           << Change(result.p99_us, other->p99_us) << std::noshowpos << "%";
+    }
+    cout << setw(8) << result.errors << endl;
+  }
+}
+
+static void Report(const Options& options, const vector<LoadResult>& ours,
+                   const vector<LoadResult>& reference,
+                   const vector<LoadResult>& baseline,
+                   const vector<string>& regressions) {
+  const LoadOptions& load = options.load;
+  if (options.json) {
+    string out = "{\"workload\":{\"mix\":\"" + hw4::EscapeJson(load.mix) +
+                 "\",\"connections\":" + std::to_string(load.connections) +
+                 ",\"seconds\":" + std::to_string(load.seconds) +
+                 ",\"rounds\":" + std::to_string(options.rounds) + "}" +
+                 ",\n\"thresholds\":{\"throughput_percent\":" +
+                 std::to_string(options.throughput_threshold) +
+                 ",\"p99_percent\":" +
+                 std::to_string(options.p99_threshold) + "}" +
+                 ",\n\"ours\":";
+    hw4::AppendLoadResultsJson(ours, &out);
+    if (!reference.empty()) {
+      out += ",\n\"reference\":";
+      hw4::AppendLoadResultsJson(reference, &out);
+    }
+    if (!baseline.empty()) {
+      out += ",\n\"baseline\":";
+      hw4::AppendLoadResultsJson(baseline, &out);
+    }
+    out += ",\n\"regressions\":[";
+    for (size_t i = 0; i < regressions.size(); i++) {
+      out += (i == 0 ? "\"" : ",\"") + hw4::EscapeJson(regressions[i]) + "\"";
+    }
+    out += string("],\n\"passed\":") +
+           (regressions.empty() ? "true" : "false") + "}";
+    cout << out << endl;
+    return;
+  }
+
+  cout << std::fixed << std::setprecision(1);
+  cout << "mix " << load.mix << ", " << load.connections
+       << " connection(s), median of " << options.rounds << " x "
+       << load.seconds << " s" << endl;
+  if (!reference.empty()) {
+    PrintComparison(ours, reference, "reference");
+  }
+  if (!baseline.empty()) {
+    PrintComparison(ours, baseline, "baseline");
+  }
+  if (reference.empty() && baseline.empty()) {
+    cout << endl << "kind      requests/s  p50 (us)  p99 (us)  errors" << endl;
+    for (const LoadResult& result : ours) {
+      cout << std::left << setw(8) << result.kind << std::right
+           << setw(12) << result.requests_per_second
+           << setw(10) << result.p50_us << setw(10) << result.p99_us
+           << setw(8) << result.errors << endl;
+    }
+  }
+  cout << endl;
+  for (const string& regression : regressions) {
+    cout << "REGRESSION " << regression << endl;
+  }
+  cout << (regressions.empty() ? "PASS" : "FAIL");
+  if (!options.report_only && !(reference.empty() && baseline.empty())) {
+    cout << " (thresholds: " << options.throughput_threshold
+         << "% throughput, " << options.p99_threshold << "% p99)";
+  }
+  cout << endl;
+}
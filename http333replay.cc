@@ -0,0 +1,404 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// http333replay sends the requests an http333d recorded with --record
+// (see TrafficRecorder.h) to a running server, and reports how many it
+// answered per second and how long they took, for each kind of request
+// the server routes ("static", "query", "api_query", and so on).
+//
+// By default the requests go out when they originally arrived, relative
+// to the first; --speed=2 sends them twice as fast, and --speed=max as
+// fast as the server answers.  At a given speed, a request's latency is
+// counted from when it was due to be sent, not when it was, so a server
+// that falls behind shows it in its latencies rather than by quietly
+// being sent less.  The requests are dealt out in turn to --connections
+// connections, each of which sends one at a time.  A request recorded
+// with "Connection: close" closes its connection, as it did then.
+
+extern "C" {
+#include <pthread.h>
+}
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./HttpUtils.h"
+#include "./LoadGenerator.h"
+#include "./TrafficRecorder.h"
+
+using hw4::LoadGenerator;
+using hw4::LoadResult;
+using hw4::RecordedRequest;
+using hw4::TrafficRecorder;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::setw;
+using std::string;
+using std::vector;
+
+// The kinds of request, by how the server routes them.
+enum Route { kStatic, kQuery, kApiQuery, kSuggest, kBatch, kStats, kDebug,
+             kOther, kNumRoutes };
+static const char* const kRouteNames[kNumRoutes] = {
+  "static", "query", "api_query", "suggest", "batch", "stats", "debug",
+  "other"
+};
+
+struct ReplayOptions {
+  string host = "localhost";
+  uint16_t port = 0;
+  double speed = 1;  // 0 for as fast as possible
+  int connections = 8;
+};
+
+// A request to replay.
+struct Replay {
+  const RecordedRequest* request;
+  Route route;
+  bool close;  // it asks for the connection to be closed after it
+};
+
+// What one connection thread measured.
+struct Measurements {
+  vector<uint64_t> latencies_ns[kNumRoutes];
+  uint64_t bytes[kNumRoutes] = {};
+  uint64_t errors[kNumRoutes] = {};
+};
+
+// A connection thread: it replays every connections'th request, from
+// "first".
+struct Connection {
+  const ReplayOptions* options;
+  const vector<Replay>* replays;
+  size_t first;
+  uint64_t start_ns;  // when the first recorded request is due
+  Measurements measurements;
+};
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name);
+
+// Parses the command line into "options" and "file_name".  Returns false
+// if it's wrong.
+static bool GetOptions(int argc, char** argv, ReplayOptions* const options,
+                       string* const file_name, bool* const json);
+
+// Returns how the server routes "text", a whole request.
+static Route GetRoute(const string& text);
+
+// The body of a connection thread; "arg" is its Connection.
+static void* RunConnection(void* arg);
+
+// Prints "results" as a table, or as JSON if "json".
+static void Report(const ReplayOptions& options, size_t recorded,
+                   double recorded_seconds, double seconds,
+                   const vector<LoadResult>& results, bool json);
+
+static uint64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+  ReplayOptions options;
+  string file_name;
+  bool json = false;
+  if (!GetOptions(argc, argv, &options, &file_name, &json)) {
+    Usage(argv[0]);
+  }
+
+  vector<RecordedRequest> requests;
+  if (!TrafficRecorder::ReadFile(file_name, &requests)) {
+    cerr << "Couldn't read a recording from " << file_name << endl;
+    return EXIT_FAILURE;
+  }
+  if (requests.empty()) {
+    cerr << file_name << " has no requests in it" << endl;
+    return EXIT_FAILURE;
+  }
+  vector<Replay> replays;
+  for (const RecordedRequest& request : requests) {
+    string header = request.text.substr(0, request.text.find("\r\n\r\n"));
+    std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+    replays.push_back(Replay{&request, GetRoute(request.text),
+                             header.find("\r\nconnection: close") !=
+                             string::npos});
+  }
+
+  // Make sure the server is there before starting the clock.
+  int fd;
+  if (!hw4::ConnectToServer(options.host, options.port, &fd)) {
+    cerr << "Couldn't connect to " << options.host << ":" << options.port
+         << endl;
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  int connections = std::min<size_t>(options.connections, replays.size());
+  vector<Connection> conns(connections);
+  vector<pthread_t> threads(connections);
+  uint64_t start = MonotonicNanos();
+  int started = 0;
+  for (; started < connections; started++) {
+    Connection* conn = &conns[started];
+    conn->options = &options;
+    conn->replays = &replays;
+    conn->first = started;
+    conn->start_ns = start;
+    if (pthread_create(&threads[started], nullptr, &RunConnection,
+                       conn) != 0) {
+      break;
+    }
+  }
+  Measurements total;
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], nullptr);
+    const Measurements& m = conns[i].measurements;
+    for (int r = 0; r < kNumRoutes; r++) {
+      total.latencies_ns[r].insert(total.latencies_ns[r].end(),
+                                   m.latencies_ns[r].begin(),
+                                   m.latencies_ns[r].end());
+      total.bytes[r] += m.bytes[r];
+      total.errors[r] += m.errors[r];
+    }
+  }
+  double seconds = (MonotonicNanos() - start) / 1e9;
+  if (started == 0) {
+    cerr << "Couldn't start a connection thread" << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<LoadResult> results;
+  vector<uint64_t> all;
+  uint64_t all_bytes = 0, all_errors = 0;
+  for (int r = 0; r < kNumRoutes; r++) {
+    if (total.latencies_ns[r].empty() && total.errors[r] == 0) {
+      continue;
+    }
+    all.insert(all.end(), total.latencies_ns[r].begin(),
+               total.latencies_ns[r].end());
+    all_bytes += total.bytes[r];
+    all_errors += total.errors[r];
+    results.push_back(hw4::SummarizeLoad(kRouteNames[r],
+                                         &total.latencies_ns[r],
+                                         total.bytes[r], total.errors[r],
+                                         seconds));
+  }
+  results.push_back(hw4::SummarizeLoad("all", &all, all_bytes, all_errors,
+                                       seconds));
+  Report(options, requests.size(),
+         (requests.back().offset_ns - requests.front().offset_ns) / 1e9,
+         seconds, results, json);
+  return all_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name << " [options] recording port" << endl;
+  cerr << "Options:" << endl;
+  cerr << "  --host=NAME          the server's host (default localhost)"
+       << endl;
+  cerr << "  --speed=X|max        send the requests X times as fast as"
+       << " they were recorded" << endl
+       << "                       (default 1), or as fast as they're"
+       << " answered" << endl;
+  cerr << "  --connections=N      over N connections at once (default 8)"
+       << endl;
+  cerr << "  --json               report in JSON" << endl;
+  exit(EXIT_FAILURE);
+}
+
+static bool GetOptions(int argc, char** argv, ReplayOptions* const options,
+                       string* const file_name, bool* const json) {
+  vector<string> args;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.substr(0, 2) != "--") {
+      args.push_back(arg);
+      continue;
+    }
+
+    string value;
+    size_t eq = arg.find('=');
+    if (eq != string::npos) {
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    }
+    if (arg == "--host" && !value.empty()) {
+      options->host = value;
+    } else if (arg == "--speed" && value == "max") {
+      options->speed = 0;
+    } else if (arg == "--speed") {
+      options->speed = atof(value.c_str());
+      if (options->speed <= 0) {
+        return false;
+      }
+    } else if (arg == "--connections") {
+      options->connections = atoi(value.c_str());
+    } else if (arg == "--json" && eq == string::npos) {
+      *json = true;
+    } else {
+      cerr << "Unknown option " << arg << endl;
+      return false;
+    }
+  }
+
+  if (args.size() != 2) {
+    return false;
+  }
+  *file_name = args[0];
+  int port = atoi(args[1].c_str());
+  if (port <= 0 || port > 65535) {
+    return false;
+  }
+  options->port = port;
+  return options->connections > 0;
+}
+
+static Route GetRoute(const string& text) {
+  // "GET /static/a.html HTTP/1.1": the URI is the second word.
+  size_t start = text.find(' ');
+  if (start == string::npos) {
+    return kOther;
+  }
+  string uri = text.substr(start + 1, text.find(' ', start + 1) - start - 1);
+  if (uri.substr(0, 8) == "/static/") {
+    return kStatic;
+  }
+  if (uri.substr(0, 9) == "/suggest?") {
+    return kSuggest;
+  }
+  if (uri.substr(0, 11) == "/api/query?") {
+    return kApiQuery;
+  }
+  if (uri == "/batch" || uri.substr(0, 7) == "/batch?") {
+    return kBatch;
+  }
+  if (uri == "/stats") {
+    return kStats;
+  }
+  if (uri.substr(0, 7) == "/debug/") {
+    return kDebug;
+  }
+  if (uri.find("query?terms=") != string::npos) {
+    return kQuery;
+  }
+  return kOther;
+}
+
+static void* RunConnection(void* arg) {
+  Connection* conn = static_cast<Connection*>(arg);
+  const ReplayOptions& options = *conn->options;
+  const vector<Replay>& replays = *conn->replays;
+  uint64_t first_offset = replays.front().request->offset_ns;
+  Measurements* m = &conn->measurements;
+  string buffer;
+  int fd = -1;
+
+  for (size_t i = conn->first; i < replays.size();
+       i += options.connections) {
+    const Replay& replay = replays[i];
+
+    // Wait until it's due.  As fast as possible, it's due now.
+    uint64_t due = MonotonicNanos();
+    if (options.speed > 0) {
+      due = conn->start_ns +
+            (replay.request->offset_ns - first_offset) / options.speed;
+      uint64_t now = MonotonicNanos();
+      if (due > now) {
+        struct timespec ts;
+        ts.tv_sec = (due - now) / 1000000000;
+        ts.tv_nsec = (due - now) % 1000000000;
+        while (nanosleep(&ts, &ts) == -1) { }
+      }
+    }
+
+    if (fd == -1) {
+      if (!hw4::ConnectToServer(options.host, options.port, &fd)) {
+        m->errors[replay.route]++;
+        fd = -1;
+        continue;
+      }
+      buffer.clear();
+    }
+    const string& text = replay.request->text;
+    int status = 0;
+    uint64_t bytes = 0;
+    bool ok = hw4::WrappedWrite(fd, reinterpret_cast<const unsigned char*>(
+                                    text.data()), text.size()) ==
+              static_cast<int>(text.size()) &&
+              LoadGenerator::ReadResponse(fd, &buffer, &status, &bytes);
+    if (ok && status < 500) {
+      m->latencies_ns[replay.route].push_back(MonotonicNanos() - due);
+      m->bytes[replay.route] += bytes;
+    } else {
+      m->errors[replay.route]++;
+    }
+    if (!ok || replay.close) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  return nullptr;
+}
+
+static void Report(const ReplayOptions& options, size_t recorded,
+                   double recorded_seconds, double seconds,
+                   const vector<LoadResult>& results, bool json) {
+  cout << std::fixed << std::setprecision(1);
+  if (json) {
+    string out;
+    hw4::AppendLoadResultsJson(results, &out);
+    cout << "{\"recorded\":" << recorded
+         << ",\"recorded_seconds\":" << recorded_seconds
+         << ",\"speed\":";
+    if (options.speed > 0) {
+      cout << options.speed;
+    } else {
+      cout << "\"max\"";
+    }
+    cout << ",\"connections\":" << options.connections
+         << ",\"seconds\":" << seconds
+         << ",\"results\":" << out << "}" << endl;
+    return;
+  }
+
+  cout << recorded << " request(s) recorded over " << recorded_seconds
+       << " s, replayed at ";
+  if (options.speed > 0) {
+    cout << options.speed << "x";
+  } else {
+    cout << "full speed";
+  }
+  cout << " over " << options.connections << " connection(s) in "
+       << seconds << " s" << endl << endl;
+  cout << "kind        requests  requests/s     MiB/s  p50 (us)  p99 (us)"
+       << "  p99.9 (us)  errors" << endl;
+  for (const LoadResult& result : results) {
+    cout << std::left << setw(10) << result.kind << std::right
+         << setw(10) << result.requests
+         << setw(12) << result.requests_per_second
+         << setw(10) << result.mib_per_second
+         << setw(10) << result.p50_us
+         << setw(10) << result.p99_us
+         << setw(12) << result.p999_us
+         << setw(8) << result.errors << endl;
+  }
+}
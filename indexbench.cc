@@ -0,0 +1,270 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// indexbench compares the two ways http333d can answer queries: straight
+// from the mapped index files, or from MemoryIndex copies of them.  It
+// loads the index files both ways, reports how long each took and how
+// much memory each uses, checks that both give the same answers, and
+// then measures how many queries per second each sustains on a single
+// thread.  It also reports how much of the ranking work the in-memory
+// layout's top-K evaluation skips: how many position counts it decoded,
+// out of the ones ranking every match decodes (all of the query words'
+// postings).
+//
+// The queries are drawn from the indices' own vocabulary, weighted by
+// document frequency, so common words show up in queries more often, as
+// they do in real traffic.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "./IndexSet.h"
+#include "./MappedIndex.h"
+#include "./MemoryIndex.h"
+
+using hw4::IndexSet;
+using hw4::MappedIndex;
+using hw4::MemoryIndex;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::list;
+using std::setw;
+using std::string;
+using std::vector;
+
+// How many distinct queries to generate, how many of them to check for
+// agreement, and how many results each query asks for (one page).
+static const size_t kNumQueries = 10000;
+static const size_t kNumChecked = 1000;
+static const size_t kMaxResults = 50;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name);
+
+// Returns the current time on the monotonic clock, in seconds.
+static double Now();
+
+// Builds "num_queries" queries of one to "max_terms" words each from the
+// vocabulary of "index_files".
+static bool MakeQueries(const list<string>& index_files, size_t max_terms,
+                        size_t num_queries,
+                        vector<vector<string>>* const queries);
+
+// Runs "queries" against a MemoryIndex of each of "index_files", and sets
+// "scored" to the number of position counts the top-K evaluation decoded
+// and "exhaustive" to the number in the query words' posting lists.
+static bool MeasureScoring(const list<string>& index_files,
+                           const vector<vector<string>>& queries,
+                           size_t* const scored, size_t* const exhaustive);
+
+// Runs "queries" against "index_set" round-robin for about "seconds"
+// seconds, and returns the number of queries answered per second.
+static double MeasureQps(const IndexSet& index_set,
+                         const vector<vector<string>>& queries,
+                         double seconds);
+
+int main(int argc, char** argv) {
+  double seconds = 3;
+  size_t max_terms = 3;
+  list<string> index_files;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.substr(0, 10) == "--seconds=") {
+      seconds = atof(arg.c_str() + 10);
+    } else if (arg.substr(0, 12) == "--max_terms=") {
+      max_terms = atoi(arg.c_str() + 12);
+    } else if (arg.substr(0, 2) == "--") {
+      Usage(argv[0]);
+    } else {
+      index_files.push_back(arg);
+    }
+  }
+  if (index_files.empty() || seconds <= 0 || max_terms < 1) {
+    Usage(argv[0]);
+  }
+
+  double start = Now();
+  IndexSet mapped;
+  if (!mapped.Load(index_files, false)) {
+    return EXIT_FAILURE;
+  }
+  double mapped_load = Now() - start;
+
+  start = Now();
+  IndexSet in_memory;
+  if (!in_memory.Load(index_files, false, true)) {
+    return EXIT_FAILURE;
+  }
+  double in_memory_load = Now() - start;
+
+  vector<vector<string>> queries;
+  if (!MakeQueries(index_files, max_terms, kNumQueries, &queries)) {
+    cerr << "Couldn't read the vocabulary of the index files." << endl;
+    return EXIT_FAILURE;
+  }
+
+  // Both layouts must give the same answers, in the same order.
+  size_t mismatches = 0;
+  for (size_t i = 0; i < kNumChecked && i < queries.size(); i++) {
+    size_t mapped_matches, in_memory_matches;
+    vector<IndexSet::QueryResult> a =
+      mapped.ProcessQuery(queries[i], kMaxResults, &mapped_matches);
+    vector<IndexSet::QueryResult> b =
+      in_memory.ProcessQuery(queries[i], kMaxResults, &in_memory_matches);
+    bool same = mapped_matches == in_memory_matches && a.size() == b.size();
+    for (size_t j = 0; same && j < a.size(); j++) {
+      same = a[j].document_name == b[j].document_name &&
+             a[j].rank == b[j].rank;
+    }
+    if (!same) {
+      mismatches++;
+    }
+  }
+
+  size_t scored, exhaustive;
+  if (!MeasureScoring(index_files, queries, &scored, &exhaustive)) {
+    return EXIT_FAILURE;
+  }
+
+  // Touch every page of both before timing either.
+  MeasureQps(mapped, queries, seconds / 10);
+  MeasureQps(in_memory, queries, seconds / 10);
+  double mapped_qps = MeasureQps(mapped, queries, seconds);
+  double in_memory_qps = MeasureQps(in_memory, queries, seconds);
+
+  cout << index_files.size() << " index file(s), " << queries.size()
+       << " queries of 1-" << max_terms << " words, " << kMaxResults
+       << " results each" << endl << endl;
+  cout << std::fixed << std::setprecision(1);
+  cout << "layout         load (ms)  memory (MiB)   queries/s   mean (us)"
+       << endl;
+  cout << "file-backed " << setw(12) << mapped_load * 1e3
+       << setw(14) << mapped.MemoryBytes() / 1048576.0
+       << setw(12) << mapped_qps << setw(12) << 1e6 / mapped_qps << endl;
+  cout << "in-memory   " << setw(12) << in_memory_load * 1e3
+       << setw(14) << in_memory.MemoryBytes() / 1048576.0
+       << setw(12) << in_memory_qps << setw(12) << 1e6 / in_memory_qps
+       << endl << endl;
+  cout << "speedup: " << std::setprecision(2) << in_memory_qps / mapped_qps
+       << "x; results " << (mismatches == 0 ? "agree" : "DIFFER") << " on "
+       << std::min(kNumChecked, queries.size()) << " queries" << endl;
+  cout << "top-" << kMaxResults << " ranking decoded "
+       << static_cast<double>(scored) / queries.size()
+       << " position counts per query, of "
+       << static_cast<double>(exhaustive) / queries.size() << " ("
+       << std::setprecision(1)
+       << (exhaustive == 0 ? 0 : 100.0 * scored / exhaustive) << "%)" << endl;
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name
+       << " [--seconds=N] [--max_terms=N] index_file+" << endl;
+  exit(EXIT_FAILURE);
+}
+
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool MakeQueries(const list<string>& index_files, size_t max_terms,
+                        size_t num_queries,
+                        vector<vector<string>>* const queries) {
+  // Every (word, document) pair is a ticket; drawing tickets at random
+  // picks words in proportion to how many documents contain them.
+  vector<string> words;
+  vector<uint64_t> tickets;  // running total of document frequencies
+  for (const string& file : index_files) {
+    MappedIndex index(file);
+    if (!index.Map(false) ||
+        !index.ForEachWord([&words, &tickets](
+                               const string& word,
+                               const vector<MappedIndex::Posting>& postings) {
+          words.push_back(word);
+          tickets.push_back((tickets.empty() ? 0 : tickets.back()) +
+                            postings.size());
+        })) {
+      return false;
+    }
+  }
+  if (words.empty() || tickets.back() == 0) {
+    return false;
+  }
+
+  // Use a fixed seed, so runs are comparable.
+  std::mt19937_64 rng(333);
+  std::uniform_int_distribution<uint64_t> ticket(0, tickets.back() - 1);
+  std::uniform_int_distribution<size_t> length(1, max_terms);
+  for (size_t i = 0; i < num_queries; i++) {
+    vector<string> query;
+    size_t num_words = length(rng);
+    for (size_t j = 0; j < num_words; j++) {
+      size_t w = std::upper_bound(tickets.begin(), tickets.end(),
+                                  ticket(rng)) - tickets.begin();
+      query.push_back(words[w]);
+    }
+    queries->push_back(query);
+  }
+  return true;
+}
+
+static bool MeasureScoring(const list<string>& index_files,
+                           const vector<vector<string>>& queries,
+                           size_t* const scored, size_t* const exhaustive) {
+  *scored = *exhaustive = 0;
+  for (const string& file : index_files) {
+    MappedIndex mapped(file);
+    MemoryIndex index;
+    if (!mapped.Map(false) || !index.Build(mapped)) {
+      return false;
+    }
+    vector<MemoryIndex::Posting> top, postings;
+    for (const vector<string>& query : queries) {
+      size_t num_matches;
+      index.TopMatches(query, kMaxResults, &top, &num_matches, scored);
+      for (const string& word : query) {
+        if (index.LookupWord(word, &postings)) {
+          *exhaustive += postings.size();
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static double MeasureQps(const IndexSet& index_set,
+                         const vector<vector<string>>& queries,
+                         double seconds) {
+  size_t answered = 0;
+  double start = Now(), elapsed = 0;
+  do {
+    // Check the clock every so often, not after every query.
+    for (size_t i = 0; i < 64; i++) {
+      size_t num_matches;
+      index_set.ProcessQuery(queries[answered % queries.size()],
+                             kMaxResults, &num_matches);
+      answered++;
+    }
+    elapsed = Now() - start;
+  } while (elapsed < seconds);
+  return answered / elapsed;
+}
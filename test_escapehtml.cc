@@ -0,0 +1,93 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <boost/algorithm/string.hpp>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "./HttpUtils.h"
+
+using std::string;
+
+namespace hw4 {
+
+// EscapeHtml() as it was written before AppendEscapedHtml(), one
+// replace_all() per character, to compare against.
+static string ReplaceAllEscapeHtml(const string& from) {
+  string ret = from;
+  boost::replace_all(ret, "&", "&amp;");
+  boost::replace_all(ret, "<", "&lt;");
+  boost::replace_all(ret, ">", "&gt;");
+  boost::replace_all(ret, "\"", "&quot;");
+  boost::replace_all(ret, "\'", "&apos;");
+  return ret;
+}
+
+// Checks both EscapeHtml() and AppendEscapedHtml() (onto a non-empty
+// string) against ReplaceAllEscapeHtml().
+static void ExpectEscapedLikeReplaceAll(const string& from) {
+  string expected = ReplaceAllEscapeHtml(from);
+  EXPECT_EQ(expected, EscapeHtml(from)) << "escaping \"" << from << "\"";
+  string to = "prefix";
+  AppendEscapedHtml(from, &to);
+  EXPECT_EQ("prefix" + expected, to) << "escaping \"" << from << "\"";
+}
+
+TEST(Test_EscapeHtml, MatchesReplaceAll) {
+  // The scan looks at 16 bytes at a time, so put each dangerous character
+  // at every offset of strings from 0 to 40 bytes long: before, on and
+  // after the 16- and 32-byte boundaries, and in the tail.  The filler
+  // includes bytes with the high bit set, which a signed compare could
+  // mistake for something else.
+  const string kDangerous = "&<>\"'";
+  const string kFillers[] = {"abcdefghijklmnopqrstuvwxyz0123456789ABCDEFG",
+                             string(41, '\xa6'), string(41, '\xbc')};
+  for (const string& filler : kFillers) {
+    for (size_t length = 0; length <= 40; length++) {
+      string plain = filler.substr(0, length);
+      ExpectEscapedLikeReplaceAll(plain);
+      for (char c : kDangerous) {
+        for (size_t offset = 0; offset < length; offset++) {
+          string one = plain;
+          one[offset] = c;
+          ExpectEscapedLikeReplaceAll(one);
+        }
+      }
+    }
+  }
+
+  // Two dangerous characters at every pair of offsets, so that runs
+  // between them start and end everywhere.
+  for (size_t length = 2; length <= 40; length++) {
+    for (size_t first = 0; first < length; first++) {
+      for (size_t second = first + 1; second < length; second++) {
+        string two(length, 'x');
+        two[first] = kDangerous[(first + second) % kDangerous.size()];
+        two[second] = kDangerous[second % kDangerous.size()];
+        ExpectEscapedLikeReplaceAll(two);
+      }
+    }
+  }
+
+  // Nothing but dangerous characters, and already-escaped text.
+  for (size_t length = 0; length <= 40; length++) {
+    string all;
+    for (size_t i = 0; i < length; i++) {
+      all.push_back(kDangerous[i % kDangerous.size()]);
+    }
+    ExpectEscapedLikeReplaceAll(all);
+  }
+  ExpectEscapedLikeReplaceAll("&amp;&lt;&gt; already escaped &quot;&apos;");
+  ExpectEscapedLikeReplaceAll(string("nul\0<in>\0the middle", 20));
+}
+
+}  // namespace hw4
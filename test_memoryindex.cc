@@ -0,0 +1,347 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "./MappedIndex.h"
+#include "./MemoryIndex.h"
+
+extern "C" {
+  #include "libhw1/HashTable.h"  // for FNVHash64()
+}
+
+using std::function;
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// The documents of a test index: document ID -> (name, word -> count).
+typedef map<uint64_t, pair<string, map<string, int32_t>>> TestDocs;
+
+// Returns an element of a hash table, given the file offset it starts at.
+typedef function<string(uint32_t)> ElementFn;
+
+static void AppendInt16(uint16_t value, string* const out) {
+  out->push_back(static_cast<char>(value >> 8));
+  out->push_back(static_cast<char>(value));
+}
+
+static void AppendInt32(uint32_t value, string* const out) {
+  AppendInt16(value >> 16, out);
+  AppendInt16(value, out);
+}
+
+static void AppendInt64(uint64_t value, string* const out) {
+  AppendInt32(value >> 32, out);
+  AppendInt32(value, out);
+}
+
+// Lays out an on-disk hash table of "elements", keyed as given, that
+// starts at file offset "base": the bucket count, a (chain length, chain
+// offset) record per bucket, then each chain's element offsets followed
+// by its elements.
+static string HashTableBytes(const vector<pair<uint64_t, ElementFn>>& elements,
+                             uint32_t base) {
+  uint32_t num_buckets = std::max<size_t>(1, elements.size() / 2);
+  vector<vector<const ElementFn*>> buckets(num_buckets);
+  for (const auto& element : elements) {
+    buckets[element.first % num_buckets].push_back(&element.second);
+  }
+  string records, chains;
+  uint32_t pos = base + 4 + 8 * num_buckets;
+  for (const auto& bucket : buckets) {
+    AppendInt32(bucket.size(), &records);
+    AppendInt32(pos, &records);
+    pos += 4 * bucket.size();
+    string offsets, bytes;
+    for (const ElementFn* fn : bucket) {
+      AppendInt32(pos, &offsets);
+      string element = (*fn)(pos);
+      pos += element.size();
+      bytes += element;
+    }
+    chains += offsets + bytes;
+  }
+  string table;
+  AppendInt32(num_buckets, &table);
+  return table + records + chains;
+}
+
+// Writes "docs" to "file_name" as an index file, the way hw3's
+// buildfileindex would.
+static void WriteTestIndex(const TestDocs& docs, const string& file_name) {
+  const uint32_t kHeaderBytes = 16;
+  vector<pair<uint64_t, ElementFn>> doc_elements;
+  map<string, map<uint64_t, int32_t>> words;
+  for (const auto& doc : docs) {
+    uint64_t doc_id = doc.first;
+    string name = doc.second.first;
+    doc_elements.emplace_back(doc_id, [doc_id, name](uint32_t) {
+      string element;
+      AppendInt64(doc_id, &element);
+      AppendInt16(name.size(), &element);
+      return element + name;
+    });
+    for (const auto& word : doc.second.second) {
+      words[word.first][doc_id] = word.second;
+    }
+  }
+  string doctable = HashTableBytes(doc_elements, kHeaderBytes);
+
+  vector<pair<uint64_t, ElementFn>> word_elements;
+  for (const auto& word : words) {
+    string text = word.first;
+    map<uint64_t, int32_t> postings = word.second;
+    uint64_t key = FNVHash64(
+        reinterpret_cast<unsigned char*>(const_cast<char*>(text.data())),
+        text.size());
+    word_elements.emplace_back(key, [text, postings](uint32_t offset) {
+      vector<pair<uint64_t, ElementFn>> posting_elements;
+      for (const auto& posting : postings) {
+        uint64_t doc_id = posting.first;
+        int32_t count = posting.second;
+        posting_elements.emplace_back(doc_id, [doc_id, count](uint32_t) {
+          string element;
+          AppendInt64(doc_id, &element);
+          AppendInt32(count, &element);
+          for (int32_t i = 0; i < count; i++) {
+            AppendInt32(i, &element);
+          }
+          return element;
+        });
+      }
+      string table = HashTableBytes(posting_elements,
+                                    offset + 6 + text.size());
+      string element;
+      AppendInt16(text.size(), &element);
+      AppendInt32(table.size(), &element);
+      return element + text + table;
+    });
+  }
+  string index = HashTableBytes(word_elements,
+                                kHeaderBytes + doctable.size());
+
+  string header;
+  AppendInt32(0xCAFEF00D, &header);
+  AppendInt32(0, &header);  // checksum, which isn't checked
+  AppendInt32(doctable.size(), &header);
+  AppendInt32(index.size(), &header);
+  FILE* f = fopen(file_name.c_str(), "wb");
+  ASSERT_NE(nullptr, f);
+  string file = header + doctable + index;
+  ASSERT_EQ(file.size(), fwrite(file.data(), 1, file.size(), f));
+  ASSERT_EQ(0, fclose(f));
+}
+
+// A ranked match, by document name, for comparing the two layouts.
+typedef pair<string, int32_t> NamedMatch;
+
+// The reference answer, straight from the MappedIndex: intersect the
+// words' posting lists, add up the counts, sort by rank, best first, then
+// by document ID, and keep the first "max_results".
+static void MappedTopMatches(const MappedIndex& index,
+                             const vector<string>& query,
+                             size_t max_results,
+                             vector<NamedMatch>* const top,
+                             size_t* const num_matches) {
+  top->clear();
+  *num_matches = 0;
+  map<uint64_t, int32_t> ranks;
+  for (size_t i = 0; i < query.size(); i++) {
+    vector<MappedIndex::Posting> postings;
+    if (!index.LookupWord(query[i], &postings)) {
+      return;
+    }
+    map<uint64_t, int32_t> next;
+    for (const auto& posting : postings) {
+      if (i == 0) {
+        next[posting.doc_id] = posting.num_positions;
+      } else if (ranks.count(posting.doc_id) != 0) {
+        next[posting.doc_id] = ranks[posting.doc_id] + posting.num_positions;
+      }
+    }
+    ranks.swap(next);
+  }
+  vector<pair<uint64_t, int32_t>> matches(ranks.begin(), ranks.end());
+  std::stable_sort(matches.begin(), matches.end(),
+                   [](const pair<uint64_t, int32_t>& a,
+                      const pair<uint64_t, int32_t>& b) {
+                     return a.second > b.second;
+                   });
+  *num_matches = matches.size();
+  for (size_t i = 0; i < matches.size() && i < max_results; i++) {
+    string name;
+    ASSERT_TRUE(index.LookupDocID(matches[i].first, &name));
+    top->emplace_back(name, matches[i].second);
+  }
+}
+
+// Checks that MemoryIndex::TopMatches() agrees with MappedTopMatches().
+static void ExpectSameTopMatches(const MappedIndex& mapped,
+                                 const MemoryIndex& memory,
+                                 const vector<string>& query,
+                                 size_t max_results) {
+  vector<NamedMatch> expected;
+  size_t expected_matches;
+  MappedTopMatches(mapped, query, max_results, &expected, &expected_matches);
+
+  vector<MemoryIndex::Posting> top;
+  size_t num_matches = 12345;
+  memory.TopMatches(query, max_results, &top, &num_matches);
+  vector<NamedMatch> actual;
+  for (const auto& posting : top) {
+    string name;
+    ASSERT_TRUE(memory.LookupDocID(posting.doc_id, &name));
+    actual.emplace_back(name, posting.num_positions);
+  }
+
+  string what = "query \"";
+  for (const string& word : query) {
+    what += (&word == &query[0] ? "" : " ") + word;
+  }
+  what += "\", max_results " + std::to_string(max_results);
+  EXPECT_EQ(expected_matches, num_matches) << what;
+  EXPECT_EQ(expected, actual) << what;
+}
+
+class Test_MemoryIndex : public ::testing::Test {
+ protected:
+  // Builds a collection whose common words have posting lists of several
+  // blocks, and whose counts are drawn from a narrow range, so that many
+  // documents tie.  The documents' IDs are spread out and added in no
+  // particular order.
+  void SetUp() override {
+    char file_name[] = "/tmp/test_memoryindex.XXXXXX";
+    int fd = mkstemp(file_name);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    file_name_ = file_name;
+
+    std::mt19937 rng(333);
+    TestDocs docs;
+    for (uint64_t i = 0; i < kNumDocs; i++) {
+      uint64_t doc_id = 1 + (i * 7919) % 100003;
+      map<string, int32_t>& words = docs[doc_id].second;
+      docs[doc_id].first = "doc" + std::to_string(doc_id) + ".txt";
+      // "common" is in every document, "half" in about half of them, and
+      // "tenth" in about a tenth; "rare" is in just a few, and "unique"
+      // in one.
+      words["common"] = 1 + rng() % 4;
+      if (rng() % 2 == 0) {
+        words["half"] = 1 + rng() % 3;
+      }
+      if (rng() % 10 == 0) {
+        words["tenth"] = 1 + rng() % 20;
+      }
+      if (i % 300 == 7) {
+        words["rare"] = 2;
+      }
+      if (i == 555) {
+        words["unique"] = 9;
+      }
+    }
+    WriteTestIndex(docs, file_name_);
+
+    mapped_.reset(new MappedIndex(file_name_));
+    ASSERT_TRUE(mapped_->Map(false));
+    ASSERT_TRUE(memory_.Build(*mapped_));
+  }
+
+  void TearDown() override {
+    mapped_.reset();
+    unlink(file_name_.c_str());
+  }
+
+  // Enough documents for posting lists of many 128-posting blocks.
+  static const uint64_t kNumDocs = 1500;
+
+  string file_name_;
+  std::unique_ptr<MappedIndex> mapped_;
+  MemoryIndex memory_;
+};
+
+// static
+const uint64_t Test_MemoryIndex::kNumDocs;
+
+TEST_F(Test_MemoryIndex, MultiBlockLists) {
+  vector<MemoryIndex::Posting> postings;
+  ASSERT_TRUE(memory_.LookupWord("common", &postings));
+  ASSERT_EQ(kNumDocs, postings.size());
+
+  for (size_t max_results : {1, 10, 127, 128, 129, 1000}) {
+    ExpectSameTopMatches(*mapped_, memory_, {"common", "half"}, max_results);
+    ExpectSameTopMatches(*mapped_, memory_, {"half", "tenth"}, max_results);
+    ExpectSameTopMatches(*mapped_, memory_, {"tenth", "common", "half"},
+                         max_results);
+  }
+}
+
+TEST_F(Test_MemoryIndex, TiesAtTheCutoff) {
+  // "common" counts are 1 to 4, so every cut-off falls inside a run of
+  // documents with the same rank; the lowest-numbered ones must win.
+  for (size_t max_results = 1; max_results <= 400; max_results += 13) {
+    ExpectSameTopMatches(*mapped_, memory_, {"common"}, max_results);
+    ExpectSameTopMatches(*mapped_, memory_, {"common", "half"}, max_results);
+  }
+}
+
+TEST_F(Test_MemoryIndex, SingleWordQueries) {
+  for (const char* word : {"common", "half", "tenth", "rare", "unique"}) {
+    ExpectSameTopMatches(*mapped_, memory_, {word}, 10);
+    ExpectSameTopMatches(*mapped_, memory_, {word}, kNumDocs);
+  }
+}
+
+TEST_F(Test_MemoryIndex, MissingWord) {
+  vector<MemoryIndex::Posting> top;
+  size_t num_matches = 12345;
+  memory_.TopMatches({"nonesuch"}, 10, &top, &num_matches);
+  EXPECT_EQ(0U, num_matches);
+  EXPECT_TRUE(top.empty());
+
+  ExpectSameTopMatches(*mapped_, memory_, {"nonesuch"}, 10);
+  ExpectSameTopMatches(*mapped_, memory_, {"common", "nonesuch"}, 10);
+  ExpectSameTopMatches(*mapped_, memory_, {"nonesuch", "common"}, 10);
+  ExpectSameTopMatches(*mapped_, memory_, {"unique", "rare"}, 10);
+}
+
+TEST_F(Test_MemoryIndex, MaxResultsAroundMatchCount) {
+  for (const char* word : {"rare", "tenth", "half"}) {
+    vector<MemoryIndex::Posting> top;
+    size_t num_matches;
+    memory_.TopMatches({word, "common"}, kNumDocs, &top, &num_matches);
+    ASSERT_GT(num_matches, 1U);
+    ASSERT_EQ(num_matches, top.size());
+
+    for (size_t max_results : {num_matches - 1, num_matches,
+                               num_matches + 1, 2 * num_matches}) {
+      ExpectSameTopMatches(*mapped_, memory_, {word, "common"}, max_results);
+    }
+  }
+  ExpectSameTopMatches(*mapped_, memory_, {"common"}, 0);
+}
+
+}  // namespace hw4
@@ -0,0 +1,131 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Spring Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "./HttpUtils.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_URLParser, PathAndArgs) {
+  URLParser p;
+  p.Parse("/query?terms=apple+pie&page=2");
+  EXPECT_EQ("/query", p.path());
+  map<string, string> expected = {{"terms", "apple pie"}, {"page", "2"}};
+  EXPECT_EQ(expected, p.args());
+
+  p.Parse("/static/index.html");
+  EXPECT_EQ("/static/index.html", p.path());
+  EXPECT_TRUE(p.args().empty());
+
+  p.Parse("");
+  EXPECT_EQ("", p.path());
+  EXPECT_TRUE(p.args().empty());
+
+  // Only the text between the first '?' and any second one is args.
+  p.Parse("/a?x=1?y=2");
+  EXPECT_EQ("/a", p.path());
+  expected = {{"x", "1"}};
+  EXPECT_EQ(expected, p.args());
+}
+
+TEST(Test_URLParser, Decoding) {
+  URLParser p;
+  p.Parse("/my%20dir/a+b?na%6De=%3Cb%3E%26+x%2b1&q=100%&r=%zz%4");
+  EXPECT_EQ("/my dir/a b", p.path());
+  map<string, string> expected = {
+    {"name", "<b>& x+1"}, {"q", "100%"}, {"r", "%zz%4"}};
+  EXPECT_EQ(expected, p.args());
+
+  string value;
+  ASSERT_TRUE(p.GetArg("name", &value));
+  EXPECT_EQ("<b>& x+1", value);
+}
+
+TEST(Test_URLParser, EmptyAndMalformedArgs) {
+  URLParser p;
+  // An empty value counts; a chunk without exactly one '=' doesn't.
+  p.Parse("/a?empty=&flag&=nameless&a=b=c&&ok=1&");
+  map<string, string> expected = {{"empty", ""}, {"", "nameless"},
+                                  {"ok", "1"}};
+  EXPECT_EQ(expected, p.args());
+
+  string value = "unchanged";
+  ASSERT_TRUE(p.GetArg("empty", &value));
+  EXPECT_EQ("", value);
+  value = "unchanged";
+  EXPECT_FALSE(p.GetArg("flag", &value));
+  EXPECT_FALSE(p.GetArg("a", &value));
+  EXPECT_FALSE(p.GetArg("missing", &value));
+  EXPECT_EQ("unchanged", value);
+
+  p.Parse("/a?");
+  EXPECT_TRUE(p.args().empty());
+}
+
+TEST(Test_URLParser, RepeatedArgs) {
+  URLParser p;
+  p.Parse("/batch?q=first&n=3&q=second+one&q=&Q=other&q%3D=no");
+  string value;
+  ASSERT_TRUE(p.GetArg("q", &value));
+  EXPECT_EQ("", value);
+  EXPECT_EQ("", p.args().at("q"));
+  EXPECT_EQ("3", p.args().at("n"));
+
+  vector<string> values = {"kept"};
+  p.GetArgs("q", &values);
+  vector<string> expected = {"kept", "first", "second one", ""};
+  EXPECT_EQ(expected, values);
+
+  values.clear();
+  p.GetArgs("missing", &values);
+  EXPECT_TRUE(values.empty());
+
+  // The last value wins, encoded names included.
+  p.Parse("/a?x=1&%78=2");
+  ASSERT_TRUE(p.GetArg("x", &value));
+  EXPECT_EQ("2", value);
+  EXPECT_EQ("2", p.args().at("x"));
+  values.clear();
+  p.GetArgs("x", &values);
+  expected = {"1", "2"};
+  EXPECT_EQ(expected, values);
+}
+
+TEST(Test_URLParser, ParseArgs) {
+  URLParser p;
+  p.Parse("/batch?n=3");
+  ASSERT_EQ("3", p.args().at("n"));
+
+  // A form-encoded body; the path and the earlier args are gone.
+  string body = "q=apple+pie&q=banana&n=%35";
+  p.ParseArgs(body);
+  EXPECT_EQ("", p.path());
+  map<string, string> expected = {{"q", "banana"}, {"n", "5"}};
+  EXPECT_EQ(expected, p.args());
+  vector<string> values;
+  p.GetArgs("q", &values);
+  vector<string> expected_values = {"apple pie", "banana"};
+  EXPECT_EQ(expected_values, values);
+
+  p.ParseArgs("");
+  EXPECT_TRUE(p.args().empty());
+}
+
+}  // namespace hw4